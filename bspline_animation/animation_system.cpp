@@ -0,0 +1,557 @@
+#include "animation_system.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #include <immintrin.h>
+    #define ANIM_AVX2 1
+    #define ANIM_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#elif defined(_M_X64) && defined(__AVX2__)
+    #include <immintrin.h>
+    #define ANIM_AVX2 1
+    #define ANIM_TARGET_AVX2
+#endif
+
+
+// Table samples of segment i, the end sample of the path is not counted
+static uint32_t segmentSamples(const BSpline& spline, size_t i) noexcept
+{
+    const float* arc = spline.arcLength.data() + (i - 1) * BSpline::ARC_SUBDIVISIONS;
+    const float samples = std::round((arc[BSpline::ARC_SUBDIVISIONS] - arc[0]) / AnimationSystem::TABLE_SPACING);
+
+    return std::max<uint32_t>(1, static_cast<uint32_t>(samples));
+}
+
+// Fewer than 4 control points or a failed load
+static bool isEmpty(const BSpline& spline) noexcept
+{
+    return spline.arcLength.size() < 2;
+}
+
+// First sample of every segment and the end sample, a spline without segments gets two
+// samples at the origin
+static void tableLayout(const BSpline& spline, std::vector<uint32_t>& segmentBegin) noexcept
+{
+    const size_t segments = isEmpty(spline) ? 0 : spline.segmentCount();
+
+    segmentBegin.resize(segments + 1);
+    segmentBegin[0] = segments > 0 ? 0 : 1;
+
+    for(size_t i = 1; i <= segments; ++i)
+    {
+        segmentBegin[i] = segmentBegin[i - 1] + segmentSamples(spline, i);
+    }
+}
+
+// Position and frame at distance s along the path, hint as for BSpline::locate
+static size_t sampleAt(const BSpline& spline, float s, size_t hint, glm::vec3& pos, glm::quat& q) noexcept
+{
+    int segment = 1;
+    float t = 0.f;
+    hint = spline.locate(s, segment, t, hint);
+
+    pos = spline.position(t, segment);
+    q = spline.frame(t, segment);
+
+    return hint;
+}
+
+std::array<std::vector<float>*, 7> AnimationSystem::tables() noexcept
+{
+    return {&px_, &py_, &pz_, &qw_, &qx_, &qy_, &qz_};
+}
+
+uint32_t AnimationSystem::addSpline(const BSpline& spline) noexcept
+{
+    const uint32_t id = static_cast<uint32_t>(length_.size());
+
+    length_.push_back(0.f);
+    invLength_.push_back(0.f);
+    invStep_.push_back(0.f);
+    base_.push_back(static_cast<int32_t>(px_.size()));
+    last_.push_back(0);
+    segmentBegin_.emplace_back();
+
+    tableLayout(spline, segmentBegin_[id]);
+
+    for(std::vector<float>* table : tables())
+    {
+        table->resize(table->size() + segmentBegin_[id].back() + 1);
+    }
+
+    sample(id, spline, 1, segmentBegin_[id].size() - 1);
+    updateConstants(id, spline);
+
+    return id;
+}
+
+void AnimationSystem::rebuildSpline(uint32_t id, const BSpline& spline) noexcept
+{
+    std::vector<uint32_t>& segmentBegin = segmentBegin_[id];
+    const size_t oldCount = segmentBegin.back() + 1;
+
+    tableLayout(spline, segmentBegin);
+
+    const size_t count = segmentBegin.back() + 1;
+    if(count > oldCount)
+    {
+        resizeTable(id, oldCount, static_cast<int32_t>(count - oldCount));
+    }
+    else if(count < oldCount)
+    {
+        resizeTable(id, count, static_cast<int32_t>(count) - static_cast<int32_t>(oldCount));
+    }
+
+    sample(id, spline, 1, segmentBegin.size() - 1);
+    updateConstants(id, spline);
+}
+
+void AnimationSystem::rebuildSpline(uint32_t id, const BSpline& spline, size_t firstSegment, size_t lastSegment) noexcept
+{
+    std::vector<uint32_t>& segmentBegin = segmentBegin_[id];
+    const size_t segments = segmentBegin.size() - 1;
+
+    if(isEmpty(spline) || spline.segmentCount() != segments || firstSegment > lastSegment)
+    {
+        rebuildSpline(id, spline);
+        return;
+    }
+
+    // The samples of the edited segments are resized at their end, later ones move along
+    uint32_t count = 0;
+    for(size_t i = firstSegment; i <= lastSegment; ++i)
+    {
+        count += segmentSamples(spline, i);
+    }
+
+    const uint32_t oldCount = segmentBegin[lastSegment] - segmentBegin[firstSegment - 1];
+    const int32_t delta = static_cast<int32_t>(count) - static_cast<int32_t>(oldCount);
+
+    if(delta > 0)
+    {
+        resizeTable(id, segmentBegin[lastSegment], delta);
+    }
+    else if(delta < 0)
+    {
+        resizeTable(id, segmentBegin[firstSegment - 1] + count, delta);
+    }
+
+    for(size_t i = firstSegment; i <= lastSegment; ++i)
+    {
+        segmentBegin[i] = segmentBegin[i - 1] + segmentSamples(spline, i);
+    }
+
+    for(size_t i = lastSegment + 1; i <= segments; ++i)
+    {
+        segmentBegin[i] += delta;
+    }
+
+    sample(id, spline, firstSegment, lastSegment);
+    updateConstants(id, spline);
+
+    if(lastSegment == segments)
+    {
+        return;
+    }
+
+    // Later segments keep their positions, their frames all turn by the same twist about the
+    // tangent. It is found from the first later sample, matched to the hemisphere of the sample
+    // before it, and applied to every later frame.
+    const size_t first = base_[id] + segmentBegin[lastSegment];
+    const size_t end = base_[id] + segmentBegin[segments] + 1;
+
+    glm::vec3 pos;
+    glm::quat q;
+    const size_t arc = lastSegment * BSpline::ARC_SUBDIVISIONS;
+    sampleAt(spline, spline.arcLength[arc], arc, pos, q);
+
+    const glm::quat previous{qw_[first - 1], qx_[first - 1], qy_[first - 1], qz_[first - 1]};
+    if(glm::dot(q, previous) < 0.f)
+    {
+        q = -q;
+    }
+
+    const glm::quat old{qw_[first], qx_[first], qy_[first], qz_[first]};
+    const glm::quat twist = glm::inverse(old) * q;
+
+    for(size_t j = first; j < end; ++j)
+    {
+        const glm::quat turned = glm::quat(qw_[j], qx_[j], qy_[j], qz_[j]) * twist;
+        qw_[j] = turned.w;
+        qx_[j] = turned.x;
+        qy_[j] = turned.y;
+        qz_[j] = turned.z;
+    }
+}
+
+void AnimationSystem::resizeTable(uint32_t id, size_t at, int32_t delta) noexcept
+{
+    const size_t index = base_[id] + at;
+
+    for(std::vector<float>* table : tables())
+    {
+        if(delta > 0)
+        {
+            table->insert(table->begin() + index, delta, 0.f);
+        }
+        else
+        {
+            table->erase(table->begin() + index, table->begin() + (index - delta));
+        }
+    }
+
+    for(size_t j = id + 1; j < base_.size(); ++j)
+    {
+        base_[j] += delta;
+    }
+}
+
+void AnimationSystem::updateConstants(uint32_t id, const BSpline& spline) noexcept
+{
+    const float length = isEmpty(spline) ? 0.f : spline.length();
+    const uint32_t end = segmentBegin_[id].back();
+
+    length_[id] = length;
+    invLength_[id] = length > 0.f ? 1.f / length : 0.f;
+    invStep_[id] = length > 0.f ? end / length : 0.f;
+    last_[id] = static_cast<int32_t>(end - 1);
+}
+
+void AnimationSystem::sample(uint32_t id, const BSpline& spline, size_t firstSegment, size_t lastSegment) noexcept
+{
+    const std::vector<uint32_t>& segmentBegin = segmentBegin_[id];
+    const size_t base = base_[id];
+
+    const auto store = [&](size_t j, const glm::vec3& pos, const glm::quat& q)
+    {
+        px_[j] = pos.x;
+        py_[j] = pos.y;
+        pz_[j] = pos.z;
+        qw_[j] = q.w;
+        qx_[j] = q.x;
+        qy_[j] = q.y;
+        qz_[j] = q.z;
+    };
+
+    // A spline without segments parks its objects at the origin
+    if(isEmpty(spline))
+    {
+        store(base, glm::vec3(0.f), glm::quat(1.f, 0.f, 0.f, 0.f));
+        store(base + 1, glm::vec3(0.f), glm::quat(1.f, 0.f, 0.f, 0.f));
+        return;
+    }
+
+    // Quaternions continue in the hemisphere of the sample before the range
+    const size_t begin = base + segmentBegin[firstSegment - 1];
+    glm::quat previous = begin > base ? glm::quat(qw_[begin - 1], qx_[begin - 1], qy_[begin - 1], qz_[begin - 1])
+                                      : glm::quat(1.f, 0.f, 0.f, 0.f);
+
+    size_t hint = (firstSegment - 1) * BSpline::ARC_SUBDIVISIONS;
+    glm::vec3 pos;
+    glm::quat q;
+
+    const auto next = [&](size_t j, float s)
+    {
+        hint = sampleAt(spline, s, hint, pos, q);
+
+        if(glm::dot(q, previous) < 0.f)
+        {
+            q = -q;
+        }
+        previous = q;
+
+        store(j, pos, q);
+    };
+
+    for(size_t i = firstSegment; i <= lastSegment; ++i)
+    {
+        const float start = spline.arcLength[(i - 1) * BSpline::ARC_SUBDIVISIONS];
+        const float length = spline.arcLength[i * BSpline::ARC_SUBDIVISIONS] - start;
+        const uint32_t count = segmentBegin[i] - segmentBegin[i - 1];
+
+        for(uint32_t k = 0; k < count; ++k)
+        {
+            next(base + segmentBegin[i - 1] + k, start + length * k / count);
+        }
+    }
+
+    if(lastSegment + 1 == segmentBegin.size())
+    {
+        next(base + segmentBegin[lastSegment], spline.length());
+    }
+}
+
+uint32_t AnimationSystem::add(uint32_t spline, float dist, float objectSpeed) noexcept
+{
+    distance.push_back(dist);
+    speed.push_back(objectSpeed);
+    splineId.push_back(spline);
+
+    return static_cast<uint32_t>(distance.size() - 1);
+}
+
+void AnimationSystem::clear() noexcept
+{
+    distance.clear();
+    speed.clear();
+    splineId.clear();
+
+    length_.clear();
+    invLength_.clear();
+    invStep_.clear();
+    base_.clear();
+    last_.clear();
+    segmentBegin_.clear();
+
+    for(std::vector<float>* table : tables())
+    {
+        table->clear();
+    }
+}
+
+size_t AnimationSystem::size() const noexcept
+{
+    return distance.size();
+}
+
+namespace
+{
+
+// Everything a kernel reads, as raw pointers so the kernels stay free functions
+struct Tables
+{
+    const float* distance;
+    const float* speed;
+    const uint32_t* splineId;
+
+    const float* length;
+    const float* invLength;
+    const float* invStep;
+    const int32_t* base;
+    const int32_t* last;
+
+    const float* px;
+    const float* py;
+    const float* pz;
+    const float* qw;
+    const float* qx;
+    const float* qy;
+    const float* qz;
+
+    float scale;
+};
+
+// Rows of T(p) * R(q) * S(scale), q does not have to be normalized
+inline void writeTransform(InstanceTransform& out,
+                           float px, float py, float pz,
+                           float w, float x, float y, float z,
+                           float scale) noexcept
+{
+    const float s = 2.f / (w * w + x * x + y * y + z * z);
+
+    const float xx = x * x * s, yy = y * y * s, zz = z * z * s;
+    const float xy = x * y * s, xz = x * z * s, yz = y * z * s;
+    const float wx = w * x * s, wy = w * y * s, wz = w * z * s;
+
+    out.rows[0] = glm::vec4((1.f - yy - zz) * scale, (xy - wz) * scale, (xz + wy) * scale, px);
+    out.rows[1] = glm::vec4((xy + wz) * scale, (1.f - xx - zz) * scale, (yz - wx) * scale, py);
+    out.rows[2] = glm::vec4((xz - wy) * scale, (yz + wx) * scale, (1.f - xx - yy) * scale, pz);
+}
+
+// Every tick is applied on its own, in the same order, so the distances after n ticks do not
+// depend on how the ticks were split between frames
+void tickObjects(float* distance, const float* speed, const uint32_t* splineId,
+                 const float* length, const float* invLength,
+                 uint32_t ticks, float tickDt, size_t begin, size_t end) noexcept
+{
+    for(size_t i = begin; i < end; ++i)
+    {
+        const uint32_t sp = splineId[i];
+        const float step = speed[i] * tickDt;
+
+        float d = distance[i];
+        for(uint32_t n = 0; n < ticks; ++n)
+        {
+            d += step;
+            d -= std::floor(d * invLength[sp]) * length[sp];
+        }
+        distance[i] = d;
+    }
+}
+
+void writeScalar(const Tables& tb, float offset, size_t begin, size_t end, InstanceTransform* out) noexcept
+{
+    for(size_t i = begin; i < end; ++i)
+    {
+        const uint32_t sp = tb.splineId[i];
+
+        float d = tb.distance[i] + tb.speed[i] * offset;
+        d -= std::floor(d * tb.invLength[sp]) * tb.length[sp];
+
+        const float x = d * tb.invStep[sp];
+        const int32_t k = std::min(static_cast<int32_t>(x), tb.last[sp]);
+        const float f = x - k;
+        const int32_t a = tb.base[sp] + k;
+        const int32_t b = a + 1;
+
+        writeTransform(out[i],
+                       tb.px[a] + (tb.px[b] - tb.px[a]) * f,
+                       tb.py[a] + (tb.py[b] - tb.py[a]) * f,
+                       tb.pz[a] + (tb.pz[b] - tb.pz[a]) * f,
+                       tb.qw[a] + (tb.qw[b] - tb.qw[a]) * f,
+                       tb.qx[a] + (tb.qx[b] - tb.qx[a]) * f,
+                       tb.qy[a] + (tb.qy[b] - tb.qy[a]) * f,
+                       tb.qz[a] + (tb.qz[b] - tb.qz[a]) * f,
+                       tb.scale);
+    }
+}
+
+#if ANIM_AVX2
+
+ANIM_TARGET_AVX2
+inline __m256 lerpGather(const float* table, __m256i a, __m256 f) noexcept
+{
+    const __m256 v0 = _mm256_i32gather_ps(table, a, 4);
+    const __m256 v1 = _mm256_i32gather_ps(table + 1, a, 4);
+    return _mm256_fmadd_ps(_mm256_sub_ps(v1, v0), f, v0);
+}
+
+// Transposes four columns of 8 objects into row r of their instance transforms
+ANIM_TARGET_AVX2
+inline void storeRow(InstanceTransform* out, int r, __m256 c0, __m256 c1, __m256 c2, __m256 c3) noexcept
+{
+    const __m256 t0 = _mm256_unpacklo_ps(c0, c1);
+    const __m256 t1 = _mm256_unpackhi_ps(c0, c1);
+    const __m256 t2 = _mm256_unpacklo_ps(c2, c3);
+    const __m256 t3 = _mm256_unpackhi_ps(c2, c3);
+
+    const __m256 u[4] =
+    {
+        _mm256_shuffle_ps(t0, t2, 0x44),
+        _mm256_shuffle_ps(t0, t2, 0xEE),
+        _mm256_shuffle_ps(t1, t3, 0x44),
+        _mm256_shuffle_ps(t1, t3, 0xEE)
+    };
+
+    // u[j] holds lane j in its low half and lane j + 4 in its high half
+    for(int j = 0; j < 4; ++j)
+    {
+        _mm_storeu_ps(&out[j].rows[r].x, _mm256_castps256_ps128(u[j]));
+        _mm_storeu_ps(&out[j + 4].rows[r].x, _mm256_extractf128_ps(u[j], 1));
+    }
+}
+
+// Handles 8 objects per iteration, returns the index where the scalar tail has to start
+ANIM_TARGET_AVX2
+size_t writeAVX2(const Tables& tb, float offset, size_t begin, size_t end, InstanceTransform* out) noexcept
+{
+    const __m256 voffset = _mm256_set1_ps(offset);
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 two = _mm256_set1_ps(2.f);
+    const __m256 scale = _mm256_set1_ps(tb.scale);
+
+    size_t i = begin;
+    for(; i + 8 <= end; i += 8)
+    {
+        const __m256i sp = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tb.splineId + i));
+
+        const __m256 length = _mm256_i32gather_ps(tb.length, sp, 4);
+        const __m256 invLength = _mm256_i32gather_ps(tb.invLength, sp, 4);
+        const __m256 invStep = _mm256_i32gather_ps(tb.invStep, sp, 4);
+        const __m256i base = _mm256_i32gather_epi32(tb.base, sp, 4);
+        const __m256i last = _mm256_i32gather_epi32(tb.last, sp, 4);
+
+        __m256 d = _mm256_fmadd_ps(_mm256_loadu_ps(tb.speed + i), voffset, _mm256_loadu_ps(tb.distance + i));
+        d = _mm256_fnmadd_ps(_mm256_floor_ps(_mm256_mul_ps(d, invLength)), length, d);
+
+        const __m256 x = _mm256_mul_ps(d, invStep);
+        const __m256i k = _mm256_min_epi32(_mm256_cvttps_epi32(x), last);
+        const __m256 f = _mm256_sub_ps(x, _mm256_cvtepi32_ps(k));
+        const __m256i a = _mm256_add_epi32(base, k);
+
+        const __m256 px = lerpGather(tb.px, a, f);
+        const __m256 py = lerpGather(tb.py, a, f);
+        const __m256 pz = lerpGather(tb.pz, a, f);
+        const __m256 w = lerpGather(tb.qw, a, f);
+        const __m256 qx = lerpGather(tb.qx, a, f);
+        const __m256 qy = lerpGather(tb.qy, a, f);
+        const __m256 qz = lerpGather(tb.qz, a, f);
+
+        __m256 norm = _mm256_mul_ps(w, w);
+        norm = _mm256_fmadd_ps(qx, qx, norm);
+        norm = _mm256_fmadd_ps(qy, qy, norm);
+        norm = _mm256_fmadd_ps(qz, qz, norm);
+        const __m256 s = _mm256_div_ps(two, norm);
+
+        const __m256 xs = _mm256_mul_ps(qx, s);
+        const __m256 ys = _mm256_mul_ps(qy, s);
+        const __m256 zs = _mm256_mul_ps(qz, s);
+
+        const __m256 xx = _mm256_mul_ps(qx, xs), yy = _mm256_mul_ps(qy, ys), zz = _mm256_mul_ps(qz, zs);
+        const __m256 xy = _mm256_mul_ps(qx, ys), xz = _mm256_mul_ps(qx, zs), yz = _mm256_mul_ps(qy, zs);
+        const __m256 wx = _mm256_mul_ps(w, xs), wy = _mm256_mul_ps(w, ys), wz = _mm256_mul_ps(w, zs);
+
+        storeRow(out + i, 0, _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, yy), zz), scale),
+                             _mm256_mul_ps(_mm256_sub_ps(xy, wz), scale),
+                             _mm256_mul_ps(_mm256_add_ps(xz, wy), scale),
+                             px);
+        storeRow(out + i, 1, _mm256_mul_ps(_mm256_add_ps(xy, wz), scale),
+                             _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, xx), zz), scale),
+                             _mm256_mul_ps(_mm256_sub_ps(yz, wx), scale),
+                             py);
+        storeRow(out + i, 2, _mm256_mul_ps(_mm256_sub_ps(xz, wy), scale),
+                             _mm256_mul_ps(_mm256_add_ps(yz, wx), scale),
+                             _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, xx), yy), scale),
+                             pz);
+    }
+
+    return i;
+}
+
+#endif
+
+} // namespace
+
+
+void AnimationSystem::tick(uint32_t ticks, float tickDt) noexcept
+{
+    if(0 == ticks)
+    {
+        return;
+    }
+
+    WorkerPool::shared().parallelFor(size(), GRAIN, [&](size_t begin, size_t end)
+    {
+        tickObjects(distance.data(), speed.data(), splineId.data(),
+                    length_.data(), invLength_.data(),
+                    ticks, tickDt, begin, end);
+    });
+}
+
+void AnimationSystem::write(float timeOffset, InstanceTransform* out) const noexcept
+{
+    const Tables tables
+    {
+        distance.data(), speed.data(), splineId.data(),
+        length_.data(), invLength_.data(), invStep_.data(), base_.data(), last_.data(),
+        px_.data(), py_.data(), pz_.data(),
+        qw_.data(), qx_.data(), qy_.data(), qz_.data(),
+        scale
+    };
+
+    WorkerPool::shared().parallelFor(size(), GRAIN, [&](size_t begin, size_t end)
+    {
+        size_t done = begin;
+
+#if ANIM_AVX2
+        if(hasAVX2())
+        {
+            done = writeAVX2(tables, timeOffset, begin, end, out);
+        }
+#endif
+
+        writeScalar(tables, timeOffset, done, end, out);
+    });
+}
@@ -0,0 +1,130 @@
+#ifndef ANIMATION_SYSTEM_H
+#define ANIMATION_SYSTEM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include "bspline.h"
+
+// Per instance model matrix as the first three rows of an affine transform,
+// read by the vertex shader from three vec4 instance attributes
+struct InstanceTransform
+{
+    glm::vec4 rows[3];
+
+    static constexpr uint32_t BINDING = 1;
+    static constexpr uint32_t FIRST_LOCATION = 3;
+
+    static constexpr VkVertexInputBindingDescription bindingDescription() noexcept
+    {
+        VkVertexInputBindingDescription inputBinding{};
+        inputBinding.binding = BINDING;
+        inputBinding.stride = sizeof(InstanceTransform);
+        inputBinding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+        return inputBinding;
+    }
+
+    static constexpr std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions() noexcept
+    {
+        std::array<VkVertexInputAttributeDescription, 3> descriptions{};
+
+        for(uint32_t i = 0; i < descriptions.size(); ++i)
+        {
+            descriptions[i].binding = BINDING;
+            descriptions[i].location = FIRST_LOCATION + i;
+            descriptions[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            descriptions[i].offset = static_cast<uint32_t>(sizeof(glm::vec4) * i);
+        }
+
+        return descriptions;
+    }
+};
+
+// Moves many objects along shared splines at constant speed. Object state is kept as SoA
+// (distance along the path, speed, spline id) and every spline is resampled once into a
+// table spaced evenly by arc length, so a step is a lerp of two positions and an nlerp of
+// two rotation minimizing frames. Every segment gets a whole number of table samples spaced
+// evenly over its own arc length, so an edit only resamples the segments it changed, and the
+// speed on a segment is off by at most half a sample spacing over its length. Ticks and
+// transforms run in batches on the shared WorkerPool, transforms 8 objects at a time with AVX2
+// when available.
+struct AnimationSystem
+{
+    // Distance between two motion table samples in path units
+    static constexpr float TABLE_SPACING = 0.01f;
+
+    // Objects per worker task
+    static constexpr size_t GRAIN = 4096;
+
+    // Returns the spline id, the spline is only read while adding
+    uint32_t addSpline(const BSpline& spline) noexcept;
+
+    // Resamples spline id after spline was edited. Its objects keep their distance, which
+    // wraps around if the path got shorter.
+    void rebuildSpline(uint32_t splineId, const BSpline& spline) noexcept;
+
+    // Same for an edit of segments firstSegment..lastSegment that kept the segment count, like
+    // BSpline::setControlPoint. Only their samples are evaluated again and the table is only
+    // resized when their sample count changed. Later samples get the twist the edit left on
+    // their frames.
+    void rebuildSpline(uint32_t splineId, const BSpline& spline, size_t firstSegment, size_t lastSegment) noexcept;
+
+    uint32_t add(uint32_t splineId, float distance, float speed) noexcept;
+
+    // Removes every object and every spline
+    void clear() noexcept;
+
+    size_t size() const noexcept;
+
+    // Advances every object by ticks fixed steps of tickDt in one pass over the objects.
+    // The result depends only on the total number of ticks, not on how they were batched.
+    void tick(uint32_t ticks, float tickDt) noexcept;
+
+    // Writes size() transforms to out, each one being the object's frame on its path times a
+    // uniform scale, timeOffset seconds away from the last tick. Object state is not changed,
+    // so a negative offset of (alpha - 1) * tickDt interpolates between the last two ticks.
+    void write(float timeOffset, InstanceTransform* out) const noexcept;
+
+    float scale = 1.f;
+
+    // Object state, index is the object id
+    std::vector<float> distance;
+    std::vector<float> speed;
+    std::vector<uint32_t> splineId;
+
+private:
+    // Fills the samples of segments firstSegment..lastSegment of spline id, and the end sample
+    // when lastSegment is the last one
+    void sample(uint32_t id, const BSpline& spline, size_t firstSegment, size_t lastSegment) noexcept;
+
+    // Inserts (delta > 0) or erases samples of spline id at table index at, relative to base_[id]
+    void resizeTable(uint32_t id, size_t at, int32_t delta) noexcept;
+
+    // Length, step and last sample of spline id from its segmentBegin_
+    void updateConstants(uint32_t id, const BSpline& spline) noexcept;
+
+    std::array<std::vector<float>*, 7> tables() noexcept;
+
+    // Per spline constants
+    std::vector<float> length_;
+    std::vector<float> invLength_;
+    std::vector<float> invStep_;
+    std::vector<int32_t> base_;
+    std::vector<int32_t> last_;
+
+    // segmentBegin_[id][i - 1] is the first sample of segment i relative to base_[id], the
+    // entry after the last segment is the end sample
+    std::vector<std::vector<uint32_t>> segmentBegin_;
+
+    // Motion tables of every spline back to back. Neighbouring quaternions are kept in the same
+    // hemisphere so nlerp needs no sign test.
+    std::vector<float> px_, py_, pz_;
+    std::vector<float> qw_, qx_, qy_, qz_;
+};
+
+#endif
@@ -4,7 +4,9 @@
 #include "uniform.h"
 #include "formats.h"
 #include "models.h"
+#include "mesh_optimizer.h"
 #include "textures.h"
+#include "png_writer.h"
 
 #include <optional>
 #include <vector>
@@ -15,6 +17,8 @@
 #include <string>
 #include <cstring>
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DETPH_ZERO_TO_ONE
@@ -55,6 +59,48 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityF
     return VK_FALSE;
 }
 
+// Push constants of bspline_curve.tesc, after DrawPushConstants
+struct CurveParams
+{
+    glm::vec2 viewport;
+    float pixelsPerSegment;
+    float maxLevel;
+};
+
+static constexpr std::array<const char*, static_cast<size_t>(CurveMode::COUNT)> CURVE_MODE_NAMES =
+{
+    "points",
+    "geometry",
+    "tessellation"
+};
+
+// GPU zone of the spline draw in every curve mode, measured by the curve benchmark
+static constexpr std::array<const char*, static_cast<size_t>(CurveMode::COUNT)> CURVE_ZONE_NAMES =
+{
+    "spline points",
+    "spline geometry",
+    "spline tessellation"
+};
+
+const char* curveModeName(CurveMode mode) noexcept
+{
+    return CURVE_MODE_NAMES[static_cast<size_t>(mode)];
+}
+
+bool parseCurveMode(const char* name, CurveMode& mode) noexcept
+{
+    for(size_t i = 0; i < CURVE_MODE_NAMES.size(); ++i)
+    {
+        if(0 == strcmp(name, CURVE_MODE_NAMES[i]))
+        {
+            mode = static_cast<CurveMode>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) noexcept {
     createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
@@ -77,10 +123,13 @@ constexpr std::array<const char*, 1> deviceExtensions = {
 
 
 
-std::vector<const char*> getRequiredExtensions() {
+std::vector<const char*> getRequiredExtensions(bool headless) {
     uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    const char** glfwExtensions = nullptr;
+    // Without a surface no window system extension is needed
+    if (!headless) {
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    }
 
     std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
 
@@ -164,19 +213,45 @@ void App::initWindow(int width, int height) {
     glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods)
                                 {
                                     auto app = reinterpret_cast<App*>(glfwGetWindowUserPointer(window));
-                                    
+
+                                    if(GLFW_KEY_F12 == key && GLFW_PRESS == action)
+                                    {
+                                        app->exportProfile();
+                                    }
                                 });
+
+    glfwSetMouseButtonCallback(window, [](GLFWwindow* window, int button, int action, int mods)
+                                        {
+                                            auto app = reinterpret_cast<App*>(glfwGetWindowUserPointer(window));
+                                            app->mouseButton(button, action);
+                                        });
+
+    glfwSetCursorPosCallback(window, [](GLFWwindow* window, double x, double y)
+                                      {
+                                          auto app = reinterpret_cast<App*>(glfwGetWindowUserPointer(window));
+                                          app->cursorMoved(x, y);
+                                      });
 }
 
 void App::initVulkan() noexcept {
     createInstance();
     setupDebugMessenger();
-    createSurface();
+    if(!headless_)
+    {
+        createSurface();
+    }
 
     pickPhysicalDevice();
     createLogicalDevice();
 
-    createSwapChain();
+    if(headless_)
+    {
+        createOffscreenImages();
+    }
+    else
+    {
+        createSwapChain();
+    }
     createImageViews();
 
     createRenderPass();
@@ -184,8 +259,29 @@ void App::initVulkan() noexcept {
     createPipes();
 
 
-    createCommandPool(drawCmdPool, false, [](QueueFamilyIndices indices) { return indices.graphicsFamily().value();});
-    createCommandPool(transferCmdPool, true, [](QueueFamilyIndices indices) { return indices.transferFamily().value(); });
+    // Draw command buffers are re-recorded every frame
+    createCommandPool(drawCmdPool, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, [](QueueFamilyIndices indices) { return indices.graphicsFamily().value();});
+    createCommandPool(transferCmdPool, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, [](QueueFamilyIndices indices) { return indices.transferFamily().value(); });
+
+    stagingRing.create(device, physicalDevice, findQueueFamilies(physicalDevice, surface).graphicsFamily().value(), STAGING_RING_SIZE);
+    // Headless timings and the curve benchmark are read back from the profiler, so it keeps all of their frames
+    uint32_t profiledFrames = FrameProfiler::HISTORY;
+    if(headless_)
+    {
+        profiledFrames = std::max(profiledFrames, headlessFrames_);
+    }
+    if(benchmarkCurves_)
+    {
+        profiledFrames = std::max(profiledFrames, static_cast<uint32_t>(CurveMode::COUNT) * (CURVE_BENCH_WARMUP + CURVE_BENCH_FRAMES));
+    }
+
+    profiler.create(device, physicalDevice, findQueueFamilies(physicalDevice, surface).graphicsFamily().value(), MAX_FRAMES_IN_FLIGHT, profiledFrames);
+
+    if(benchmarkCurves_ && !profiler.gpuTimestamps())
+    {
+        fprintf(stderr, "Timestamp queries are not supported, the curve benchmark is off\n");
+        benchmarkCurves_ = false;
+    }
 
     createDepthResources();
     createFramebuffers();
@@ -196,9 +292,11 @@ void App::initVulkan() noexcept {
 
     loadModels();
     createVertexBuffers();
+    createCurveBuffers();
     createIndexBuffer();
 
     createUniformBuffers();
+    createInstanceBuffer();
     createDescriptorPool();
     createDescriptorSets();
 
@@ -208,12 +306,69 @@ void App::initVulkan() noexcept {
 }
 
 void App::mainLoop() noexcept {
-    while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
-        drawFrame();
+    // Loading time is not simulation time
+    frameClock.reset();
+
+    if(headless_)
+    {
+        // Wall time of every frame, the only timing a build without the profiler has
+        std::vector<double> frameTimes;
+        frameTimes.reserve(headlessFrames_);
+
+        for(uint32_t frame = 0; frame < headlessFrames_ && !quit_; ++frame)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            drawFrame();
+            frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        // The device is idle, so the GPU times of the last frames in flight are in
+        vkDeviceWaitIdle(device);
+        profiler.flush();
+
+        printFrameTimings(frameTimes);
+
+        if(pngPath_ && headlessFrames_ > 0)
+        {
+            saveImage(lastImage_, pngPath_);
+        }
+    }
+    else
+    {
+        while (!glfwWindowShouldClose(window) && !quit_) {
+            glfwPollEvents();
+            updateDrag();
+            drawFrame();
+        }
+
+        vkDeviceWaitIdle(device);
     }
 
-    vkDeviceWaitIdle(device);
+    if(profilePath_)
+    {
+        // The device is idle, so the GPU times of the last frames in flight are in
+        profiler.flush();
+        exportProfile();
+    }
+}
+
+void App::exportProfile() const noexcept
+{
+#if BSPLINE_PROFILER
+    const std::string path = profilePath_ ? profilePath_ : "frame_profile.json";
+    const bool csv = path.size() >= 4 && 0 == path.compare(path.size() - 4, 4, ".csv");
+
+    if(csv ? profiler.writeCsv(path.c_str()) : profiler.writeChromeTrace(path.c_str()))
+    {
+        printf("Frame profile written to %s\n", path.c_str());
+    }
+    else
+    {
+        fprintf(stderr, "Error while trying to write the frame profile to %s\n", path.c_str());
+    }
+#else
+    fprintf(stderr, "Built without BSPLINE_PROFILER, there is no frame profile to export\n");
+#endif
 }
 
 
@@ -241,6 +396,7 @@ void App::recreateSwapchain() noexcept
     createDepthResources();
     createFramebuffers();
     createUniformBuffers();
+    createInstanceBuffer();
     createDescriptorPool();
     createDescriptorSets();
     createCommandBuffers();
@@ -259,8 +415,14 @@ void App::cleanupSwapchain() noexcept
     }
 
     vkFreeCommandBuffers(device, drawCmdPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    for(std::vector<VkCommandBuffer>& cmds : objectCommands)
+    {
+        vkFreeCommandBuffers(device, drawCmdPool, static_cast<uint32_t>(cmds.size()), cmds.data());
+    }
 
     vkDestroyPipeline(device, splineObj.pipeline, nullptr);
+    vkDestroyPipeline(device, splineObj.geomPipeline, nullptr);
+    vkDestroyPipeline(device, splineObj.tessPipeline, nullptr);
     vkDestroyPipelineLayout(device, splineObj.pipelayout, nullptr);
 
     vkDestroyPipeline(device, planeObj.pipeline, nullptr);
@@ -273,13 +435,24 @@ void App::cleanupSwapchain() noexcept
         vkDestroyImageView(device, swapChainImageViews[i], nullptr);
     }
 
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
-
-    for(size_t i = 0; i < uniformBuffers.size(); ++i)
+    if(headless_)
     {
-        vkDestroyBuffer(device, uniformBuffers[i], nullptr);
+        for(size_t i = 0; i < swapChainImages.size(); ++i)
+        {
+            vkDestroyImage(device, swapChainImages[i], nullptr);
+            vkFreeMemory(device, offscreenMemory[i], nullptr);
+        }
+    }
+    else
+    {
+        vkDestroySwapchainKHR(device, swapChain, nullptr);
     }
-    vkFreeMemory(device, uniformBuffersMemory, nullptr);
+
+    uniformRing.destroy();
+
+    vkUnmapMemory(device, instanceMemory);
+    vkDestroyBuffer(device, instanceBuffer, nullptr);
+    vkFreeMemory(device, instanceMemory, nullptr);
 
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 }
@@ -293,13 +466,20 @@ void App::cleanup() noexcept {
     vkDestroyImage(device, textureImage, nullptr);
     vkFreeMemory(device, textureMemory, nullptr);
 
+    vkDestroyDescriptorSetLayout(device, viewDescriptorLayout, nullptr);
     vkDestroyDescriptorSetLayout(device, planeObj.descriptorLayout, nullptr);
-    vkDestroyDescriptorSetLayout(device, splineObj.descriptorLayout, nullptr);
 
     vkDestroyBuffer(device, planeObj.vertBuffer, nullptr);
     vkFreeMemory(device, planeObj.vertexBuffMem, nullptr);
     vkDestroyBuffer(device, splineObj.vertBuffer, nullptr);
     vkFreeMemory(device, splineObj.vertexBuffMem, nullptr);
+    vkDestroyBuffer(device, splineObj.pointBuffer, nullptr);
+    vkFreeMemory(device, splineObj.pointBuffMem, nullptr);
+    vkDestroyBuffer(device, splineObj.patchBuffer, nullptr);
+    vkFreeMemory(device, splineObj.patchBuffMem, nullptr);
+    splineCompute.destroy();
+    stagingRing.destroy();
+    profiler.destroy();
 
     vkDestroyBuffer(device, planeObj.indBuffer, nullptr);
     vkFreeMemory(device, planeObj.indexBufferMemory, nullptr);
@@ -321,12 +501,18 @@ void App::cleanup() noexcept {
         DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
     }
 
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if(!headless_)
+    {
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+    }
     vkDestroyInstance(instance, nullptr);
 
-    glfwDestroyWindow(window);
+    if(!headless_)
+    {
+        glfwDestroyWindow(window);
 
-    glfwTerminate();
+        glfwTerminate();
+    }
 }
 
 void App::createInstance() noexcept {
@@ -346,7 +532,7 @@ void App::createInstance() noexcept {
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     createInfo.pApplicationInfo = &appInfo;
 
-    auto extensions = getRequiredExtensions();
+    auto extensions = getRequiredExtensions(headless_);
     createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
     createInfo.ppEnabledExtensionNames = extensions.data();
 
@@ -440,9 +626,20 @@ void App::createLogicalDevice() noexcept
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    tessellationSupported_ = VK_TRUE == supportedFeatures.tessellationShader;
+
+    if(CurveMode::TESSELLATION == curveMode_ && !tessellationSupported_)
+    {
+        fprintf(stderr, "Tessellation shaders are not supported, the spline is drawn with the geometry shader\n");
+        curveMode_ = CurveMode::GEOMETRY;
+    }
+
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
     deviceFeatures.geometryShader = VK_TRUE;
+    deviceFeatures.tessellationShader = supportedFeatures.tessellationShader;
     deviceFeatures.wideLines = VK_TRUE;
 
     VkDeviceCreateInfo createInfo{};
@@ -453,7 +650,8 @@ void App::createLogicalDevice() noexcept
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+    // Nothing is presented when headless, so the swapchain extension is not needed either
+    createInfo.enabledExtensionCount = headless_ ? 0 : static_cast<uint32_t>(deviceExtensions.size());
     createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
     if (enableValidationLayers)
@@ -593,7 +791,8 @@ void App::createRenderPass() noexcept
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // Offscreen frames are only ever copied out
+    colorAttachment.finalLayout = headless_ ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentDescription depthAttachment{};
     depthAttachment.format = findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
@@ -650,6 +849,16 @@ void App::createRenderPass() noexcept
     }
 }
 
+std::string App::shaderPath(const char* name) const
+{
+    return std::string(shaderDir_) + "/" + name;
+}
+
+std::string App::assetPath(const char* name) const
+{
+    return std::string(assetDir_) + "/" + name;
+}
+
 std::vector<uint8_t> readFile(const char* filename)
 {
     FILE* file = fopen(filename, "rb");
@@ -678,50 +887,74 @@ void App::createDescriptorSetLayouts() noexcept
 //        BSplineGeomUniform::getBinding()
 //    };
 
+    // Set 0 of every pipeline, the camera. The curve pipelines project after the vertex shader.
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
     uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
+    if(tessellationSupported_)
+    {
+        uboLayoutBinding.stageFlags |= VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    }
 
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &uboLayoutBinding;
+
+    if(VK_SUCCESS != vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &viewDescriptorLayout))
+    {
+        VK_ERR("Failed to create descriptor set layout!\n");
+    }
+
+    // Set 1 of the model pipeline, its texture
     VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-    samplerLayoutBinding.binding = 1;
+    samplerLayoutBinding.binding = 0;
     samplerLayoutBinding.descriptorCount = 1;
     samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     samplerLayoutBinding.pImmutableSamplers = nullptr;
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
 
-    VkDescriptorSetLayoutCreateInfo layoutInfo{};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutInfo.pBindings = bindings.data();
+    layoutInfo.pBindings = &samplerLayoutBinding;
 
     if(VK_SUCCESS != vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &planeObj.descriptorLayout))
     {
         VK_ERR("Failed to create descriptor set layout!\n");
     }
 
-    // VkDescriptorSetLayoutBinding splineUboLayoutBinding{};
-    // uboLayoutBinding.binding = 0;
-    // uboLayoutBinding.descriptorCount = 1;
-    // uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    // uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT;
-    // uboLayoutBinding.pImmutableSamplers = nullptr;
-    // uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT;
-    // VkDescriptorSetLayoutCreateInfo splineLayoutInfo{};
-    // layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
-    layoutInfo.pBindings = &uboLayoutBinding;
 
-    if(VK_SUCCESS != vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &splineObj.descriptorLayout))
+}
+
+VkPipelineLayout App::createPipelineLayout(std::initializer_list<VkDescriptorSetLayout> setLayouts) noexcept
+{
+    std::vector<VkDescriptorSetLayout> layouts{viewDescriptorLayout};
+    layouts.insert(layouts.end(), setLayouts.begin(), setLayouts.end());
+
+    std::array<VkPushConstantRange, 2> pushRanges{};
+    pushRanges[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushRanges[0].offset = 0;
+    pushRanges[0].size = sizeof(DrawPushConstants);
+
+    pushRanges[1].stageFlags = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    pushRanges[1].offset = sizeof(DrawPushConstants);
+    pushRanges[1].size = sizeof(CurveParams);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
+    pipelineLayoutInfo.pSetLayouts = layouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = tessellationSupported_ ? 2 : 1;
+    pipelineLayoutInfo.pPushConstantRanges = pushRanges.data();
+
+    VkPipelineLayout layout;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS)
     {
-        VK_ERR("Failed to create descriptor set layout!\n");
+        VK_ERR("failed to create pipeline layout!");
     }
 
-
+    return layout;
 }
 
 
@@ -738,18 +971,18 @@ void App::createPipes() noexcept
         VK_ERR("Failed to create pipeline cache!");
     }
 
-    static constexpr const char* MODEL_VERTEX_SHADER = "D:/workspace_cpp/lab1_rg/build/shaders/texturedModel.vert.spv"; 
-    static constexpr const char* MODEL_FRAGMENT_SHADER = "D:/workspace_cpp/lab1_rg/build/shaders/texturedModel.frag.spv";
+    static constexpr const char* MODEL_VERTEX_SHADER = "texturedModel.vert.spv"; 
+    static constexpr const char* MODEL_FRAGMENT_SHADER = "texturedModel.frag.spv";
 
-    static constexpr const char* BSPLINE_VERTEX_SHADER = "D:/workspace_cpp/lab1_rg/build/shaders/bspline.vert.spv";
-    static constexpr const char* BSPLINE_GEOMETRY_SHADER = "D:/workspace_cpp/lab1_rg/build/shaders/bspline.geom.spv";
-    static constexpr const char* BSPLINE_FRAGMENT_SHADER = "D:/workspace_cpp/lab1_rg/build/shaders/bspline.frag.spv";
+    static constexpr const char* BSPLINE_VERTEX_SHADER = "bspline.vert.spv";
+    static constexpr const char* BSPLINE_GEOMETRY_SHADER = "bspline.geom.spv";
+    static constexpr const char* BSPLINE_FRAGMENT_SHADER = "bspline.frag.spv";
 
-    auto modelVertShaderCode = readFile(MODEL_VERTEX_SHADER);
-    auto modelFragShaderCode = readFile(MODEL_FRAGMENT_SHADER);
-    auto bsplineVertShaderCode = readFile(BSPLINE_VERTEX_SHADER);
+    auto modelVertShaderCode = readFile(shaderPath(MODEL_VERTEX_SHADER).c_str());
+    auto modelFragShaderCode = readFile(shaderPath(MODEL_FRAGMENT_SHADER).c_str());
+    auto bsplineVertShaderCode = readFile(shaderPath(BSPLINE_VERTEX_SHADER).c_str());
     // auto bsplineGeomShaderCode = readFile(BSPLINE_GEOMETRY_SHADER);
-    auto bsplineFragShaderCode = readFile(BSPLINE_FRAGMENT_SHADER);
+    auto bsplineFragShaderCode = readFile(shaderPath(BSPLINE_FRAGMENT_SHADER).c_str());
 
     VkShaderModule modelVertShaderModule = createShaderModule(modelVertShaderCode);
     VkShaderModule modelFragShaderModule = createShaderModule(modelFragShaderCode);
@@ -801,15 +1034,26 @@ void App::createPipes() noexcept
         bsplineFragShaderStageInfo
     };
 
-    auto modelBindingDescription = Vertex::getBindingDescription();
-    auto modelAttributeDescriptions = Vertex::getAttributeDescriptions();
+    // Per vertex data from the model plus the per instance transform written by animationSystem
+    const std::array<VkVertexInputBindingDescription, 2> modelBindingDescriptions =
+    {
+        GpuVertex::getBindingDescription(),
+        InstanceTransform::bindingDescription()
+    };
+
+    constexpr auto vertexAttributes = GpuVertex::getAttributeDescriptions();
+    constexpr auto instanceAttributes = InstanceTransform::attributeDescriptions();
+    std::array<VkVertexInputAttributeDescription, vertexAttributes.size() + instanceAttributes.size()> modelAttributeDescriptions;
+    std::copy(vertexAttributes.begin(), vertexAttributes.end(), modelAttributeDescriptions.begin());
+    std::copy(instanceAttributes.begin(), instanceAttributes.end(), modelAttributeDescriptions.begin() + vertexAttributes.size());
+
     auto bsplineBindingDescription = BSplineVertex::bindingDescription();
     auto bsplineAttributeDescriptions = BSplineVertex::attributeDescriptions();
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &modelBindingDescription;
+    vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(modelBindingDescriptions.size());
+    vertexInputInfo.pVertexBindingDescriptions = modelBindingDescriptions.data();
     
     vertexInputInfo.pVertexAttributeDescriptions = modelAttributeDescriptions.data();
     vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(modelAttributeDescriptions.size());
@@ -883,16 +1127,7 @@ void App::createPipes() noexcept
     
 
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &planeObj.descriptorLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &planeObj.pipeLayout) != VK_SUCCESS)
-    {
-        VK_ERR("failed to create pipeline layout!");
-    }
+    planeObj.pipeLayout = createPipelineLayout({planeObj.descriptorLayout});
 
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -915,11 +1150,7 @@ void App::createPipes() noexcept
         VK_ERR("failed to create graphics pipeline!");
     }
 
-    pipelineLayoutInfo.pSetLayouts = &splineObj.descriptorLayout;
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &splineObj.pipelayout) != VK_SUCCESS)
-    {
-        VK_ERR("failed to create pipeline layout!");
-    }
+    splineObj.pipelayout = createPipelineLayout({});
 
     // TODO: OVO JOS PROVJERI
     depthStencil.depthWriteEnable = VK_FALSE;
@@ -943,6 +1174,88 @@ void App::createPipes() noexcept
         VK_ERR("failed to create graphics pipeline!");
     }
 
+    // Curve pipelines, both read the control points and splineObj.patchBuffer
+    static constexpr const char* CURVE_VERTEX_SHADER = "bspline_curve.vert.spv";
+    static constexpr const char* CURVE_TESS_CONTROL_SHADER = "bspline_curve.tesc.spv";
+    static constexpr const char* CURVE_TESS_EVALUATION_SHADER = "bspline_curve.tese.spv";
+
+    VkShaderModule curveVertShaderModule = createShaderModule(readFile(shaderPath(CURVE_VERTEX_SHADER).c_str()));
+    VkShaderModule bsplineGeomShaderModule = createShaderModule(readFile(shaderPath(BSPLINE_GEOMETRY_SHADER).c_str()));
+
+    VkPipelineShaderStageCreateInfo curveVertShaderStageInfo = bsplineVertShaderStageInfo;
+    curveVertShaderStageInfo.module = curveVertShaderModule;
+
+    VkPipelineShaderStageCreateInfo bsplineGeomShaderStageInfo{};
+    bsplineGeomShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    bsplineGeomShaderStageInfo.stage = VK_SHADER_STAGE_GEOMETRY_BIT;
+    bsplineGeomShaderStageInfo.module = bsplineGeomShaderModule;
+    bsplineGeomShaderStageInfo.pName = "main";
+
+    std::array<VkPipelineShaderStageCreateInfo, 3> geomShaderStages =
+    {
+        curveVertShaderStageInfo,
+        bsplineGeomShaderStageInfo,
+        bsplineFragShaderStageInfo
+    };
+
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY;
+
+    pipelineInfo.pStages = geomShaderStages.data();
+    pipelineInfo.stageCount = static_cast<uint32_t>(geomShaderStages.size());
+
+    if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &splineObj.geomPipeline) != VK_SUCCESS)
+    {
+        VK_ERR("failed to create graphics pipeline!");
+    }
+
+    vkDestroyShaderModule(device, bsplineGeomShaderModule, nullptr);
+
+    if(tessellationSupported_)
+    {
+        VkShaderModule curveTescShaderModule = createShaderModule(readFile(shaderPath(CURVE_TESS_CONTROL_SHADER).c_str()));
+        VkShaderModule curveTeseShaderModule = createShaderModule(readFile(shaderPath(CURVE_TESS_EVALUATION_SHADER).c_str()));
+
+        VkPipelineShaderStageCreateInfo curveTescShaderStageInfo{};
+        curveTescShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        curveTescShaderStageInfo.stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        curveTescShaderStageInfo.module = curveTescShaderModule;
+        curveTescShaderStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo curveTeseShaderStageInfo{};
+        curveTeseShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        curveTeseShaderStageInfo.stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        curveTeseShaderStageInfo.module = curveTeseShaderModule;
+        curveTeseShaderStageInfo.pName = "main";
+
+        std::array<VkPipelineShaderStageCreateInfo, 4> tessShaderStages =
+        {
+            curveVertShaderStageInfo,
+            curveTescShaderStageInfo,
+            curveTeseShaderStageInfo,
+            bsplineFragShaderStageInfo
+        };
+
+        VkPipelineTessellationStateCreateInfo tessellationState{};
+        tessellationState.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
+        tessellationState.patchControlPoints = 4;
+
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+
+        pipelineInfo.pStages = tessShaderStages.data();
+        pipelineInfo.stageCount = static_cast<uint32_t>(tessShaderStages.size());
+        pipelineInfo.pTessellationState = &tessellationState;
+
+        if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &splineObj.tessPipeline) != VK_SUCCESS)
+        {
+            VK_ERR("failed to create graphics pipeline!");
+        }
+
+        vkDestroyShaderModule(device, curveTescShaderModule, nullptr);
+        vkDestroyShaderModule(device, curveTeseShaderModule, nullptr);
+    }
+
+    vkDestroyShaderModule(device, curveVertShaderModule, nullptr);
+
 
     vkDestroyShaderModule(device, modelFragShaderModule, nullptr);
     vkDestroyShaderModule(device, modelVertShaderModule, nullptr);
@@ -1128,19 +1441,27 @@ void App::createDepthResources() noexcept
 
 void App::createTextureImage() noexcept
 {
-    static constexpr const char* TEXTURE_PATH = "D:/workspace_cpp/lab1_rg/assets/textures/viking_room.png";
+    static constexpr const char* TEXTURE_PATH = "textures/viking_room.png";
+
+    // The texture is not part of the repository, without it the model is drawn plain white
+    static constexpr uint8_t WHITE_PIXEL[4] = {255, 255, 255, 255};
 
     VkBuffer stagingBuffer;
     VkDeviceMemory stageBuffMemory;
     
-    const TextureData texture = loadTexture(TEXTURE_PATH);
+    const std::string texturePath = assetPath(TEXTURE_PATH);
+    const TextureData texture = loadTexture(texturePath.c_str());
 
     if(!texture.pixels)
     {
-        VK_ERR("Error in loading texture data from file");
+        fprintf(stderr, "Could not load %s, using a white texture\n", texturePath.c_str());
     }
 
-    VkDeviceSize bufferSize = texture.size;
+    const uint8_t* pixels = texture.pixels ? texture.pixels : WHITE_PIXEL;
+    const int textureWidth = texture.pixels ? texture.width : 1;
+    const int textureHeight = texture.pixels ? texture.height : 1;
+
+    VkDeviceSize bufferSize = texture.pixels ? texture.size : sizeof(WHITE_PIXEL);
 
     createBuffer(bufferSize,
                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -1150,11 +1471,11 @@ void App::createTextureImage() noexcept
 
     void* data;
     vkMapMemory(device, stageBuffMemory, 0, bufferSize, 0, &data);
-    memcpy(data, texture.pixels, static_cast<size_t>(bufferSize));
+    memcpy(data, pixels, static_cast<size_t>(bufferSize));
     vkUnmapMemory(device, stageBuffMemory);
 
-    createImage(texture.width,
-                texture.height,
+    createImage(textureWidth,
+                textureHeight,
                 VK_FORMAT_R8G8B8A8_SRGB,
                 VK_IMAGE_TILING_OPTIMAL,
                 VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
@@ -1173,8 +1494,8 @@ void App::createTextureImage() noexcept
     copyBufferImage(commandBuffer,
                     stagingBuffer,
                     textureImage,
-                    static_cast<uint32_t>(texture.width),
-                    static_cast<uint32_t>(texture.height));
+                    static_cast<uint32_t>(textureWidth),
+                    static_cast<uint32_t>(textureHeight));
 
     transitionImageLayout(textureImage,
                           VK_FORMAT_R8G8B8A8_SRGB,
@@ -1235,73 +1556,222 @@ void App::createCommandBuffers() noexcept {
         VK_ERR("failed to allocate command buffers!");
     }
 
-    for (size_t i = 0, n = commandBuffers.size(); i < n; i++)
+    // Pipelines, framebuffers and the render pass are new, every object records from scratch
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+    for(uint32_t object = 0; object < SCENE_OBJECT_COUNT; ++object)
     {
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        
-        if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS)
+        objectCommands[object].resize(swapChainFramebuffers.size());
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, objectCommands[object].data()) != VK_SUCCESS)
+        {
+            VK_ERR("failed to allocate command buffers!");
+        }
+
+        objectDirty[object].assign(swapChainFramebuffers.size(), true);
+    }
+}
+
+void App::markDirty(SceneObject object) noexcept
+{
+    objectDirty[object].assign(objectDirty[object].size(), true);
+}
+
+void App::recordCommandBuffer(uint32_t i) noexcept
+{
+    // The image's fence has been waited on, so its secondaries are no longer in use
+    for(uint32_t object = 0; object < SCENE_OBJECT_COUNT; ++object)
+    {
+        if(objectDirty[object][i])
+        {
+            recordObject(static_cast<SceneObject>(object), i);
+            objectDirty[object][i] = false;
+        }
+    }
+
+    // Implicitly reset, the pool allows it
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS)
+    {
+        VK_ERR("failed to begin recording command buffer!");
+    }
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = swapChainFramebuffers[i];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = swapChainExtent;
+
+    std::array<VkClearValue, 2> clearValues;
+    clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+    renderPassInfo.clearValueCount = clearValues.size();
+    renderPassInfo.pClearValues = clearValues.data();
+
+    vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        std::array<VkCommandBuffer, SCENE_OBJECT_COUNT> objects;
+        for(uint32_t object = 0; object < SCENE_OBJECT_COUNT; ++object)
         {
-            VK_ERR("failed to begin recording command buffer!");
+            objects[object] = objectCommands[object][i];
         }
 
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[i];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = swapChainExtent;
-
-        std::array<VkClearValue, 2> clearValues;
-        clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
-        clearValues[1].depthStencil = {1.0f, 0};
-
-        renderPassInfo.clearValueCount = clearValues.size();
-        renderPassInfo.pClearValues = clearValues.data();
-
-        vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-            vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, planeObj.pipeline);
-
-            VkBuffer vertexBuffers[] = {planeObj.vertBuffer};
-            VkDeviceSize offsets[] = {0};
-            vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
-
-            vkCmdBindIndexBuffer(commandBuffers[i], planeObj.indBuffer, 0, VK_INDEX_TYPE_UINT32);
-            
-            vkCmdBindDescriptorSets(commandBuffers[i],
-                                    VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                    planeObj.pipeLayout,
-                                    0,
-                                    1,
-                                    &descriptorSets[i],
-                                    0,
-                                    nullptr);
-            // vkCmdDraw(commandBuffers[i], static_cast<uint32_t>(spline.points.size()), 1, 0, 0);
-            vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(planeObj.indices.size()), 1, 0, 0, 0);
-
-            vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, splineObj.pipeline);
-            vertexBuffers[0] = splineObj.vertBuffer;
-
-            vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
-
-            vkCmdBindDescriptorSets(commandBuffers[i],
-                                    VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                    splineObj.pipelayout,
-                                    0,
-                                    1,
-                                    &descriptorSets[n + i],
-                                    0,
-                                    nullptr);
-            
-            vkCmdDraw(commandBuffers[i], static_cast<uint32_t>(spline.points.size()), 1, 0, 0);
-
-        vkCmdEndRenderPass(commandBuffers[i]);
-
-        if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
+        vkCmdExecuteCommands(commandBuffers[i], static_cast<uint32_t>(objects.size()), objects.data());
+
+    vkCmdEndRenderPass(commandBuffers[i]);
+
+    if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
+    {
+        VK_ERR("failed to record command buffer!");
+    }
+}
+
+void App::recordObject(SceneObject object, uint32_t i) noexcept
+{
+    const VkCommandBuffer cmd = objectCommands[object][i];
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = swapChainFramebuffers[i];
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    if (vkBeginCommandBuffer(cmd, &beginInfo) != VK_SUCCESS)
+    {
+        VK_ERR("failed to begin recording command buffer!");
+    }
+
+    // Nothing bound is inherited from the primary, every object binds the camera itself
+    const VkPipelineLayout layout = SCENE_MODEL == object ? planeObj.pipeLayout : splineObj.pipelayout;
+
+    vkCmdBindDescriptorSets(cmd,
+                            VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            layout,
+                            0,
+                            1,
+                            &descriptorSets[0],
+                            1,
+                            &frameUniforms[i].viewOffset);
+
+    switch(object)
+    {
+    case SCENE_MODEL:
+        recordModel(cmd, i);
+        break;
+
+    case SCENE_SPLINE:
+        recordSpline(cmd, i);
+        break;
+
+    case SCENE_OBJECT_COUNT:
+        break;
+    }
+
+    if (vkEndCommandBuffer(cmd) != VK_SUCCESS)
+    {
+        VK_ERR("failed to record command buffer!");
+    }
+}
+
+void App::recordModel(VkCommandBuffer cmd, uint32_t i) noexcept
+{
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, planeObj.pipeline);
+
+    VkBuffer vertexBuffers[] = {planeObj.vertBuffer, instanceBuffer};
+    VkDeviceSize offsets[] = {0, sizeof(InstanceTransform) * animatedInstances_ * i};
+    vkCmdBindVertexBuffers(cmd, 0, 2, vertexBuffers, offsets);
+
+    vkCmdBindIndexBuffer(cmd, planeObj.indBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+    vkCmdBindDescriptorSets(cmd,
+                            VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            planeObj.pipeLayout,
+                            1,
+                            1,
+                            &descriptorSets[1],
+                            0,
+                            nullptr);
+
+    const DrawPushConstants draw{planeObj.model * planeObj.dequantization.position, planeObj.dequantization.texCoord};
+    vkCmdPushConstants(cmd, planeObj.pipeLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(draw), &draw);
+
+    vkCmdDrawIndexed(cmd,
+                     static_cast<uint32_t>(planeObj.indices.size()),
+                     static_cast<uint32_t>(animationSystem.size()),
+                     0, 0, 0);
+}
+
+void App::recordSpline(VkCommandBuffer cmd, uint32_t i) noexcept
+{
+    // Both timestamps wait for everything submitted before them, so the interval covers the
+    // spline draw and not the tail of the model draw. The benchmark records this every frame.
+    const bool timed = benchmarkCurves_ && curveBenchFrame >= CURVE_BENCH_WARMUP;
+    const uint32_t zone = timed ? profiler.beginGpuZone(cmd, CURVE_ZONE_NAMES[static_cast<size_t>(curveMode_)]) : 0;
+
+    const DrawPushConstants draw{splineObj.model};
+    vkCmdPushConstants(cmd, splineObj.pipelayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(draw), &draw);
+
+    VkBuffer vertexBuffer;
+    const VkDeviceSize offset = 0;
+
+    switch(curveMode_)
+    {
+    case CurveMode::PATH_POINTS:
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, splineObj.pipeline);
+        vertexBuffer = splineObj.vertBuffer;
+        vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, &offset);
+
+        vkCmdDraw(cmd, splineVertexCount, 1, 0, 0);
+        break;
+
+    case CurveMode::GEOMETRY:
+    case CurveMode::TESSELLATION:
+        if(CurveMode::GEOMETRY == curveMode_)
+        {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, splineObj.geomPipeline);
+        }
+        else
         {
-            VK_ERR("failed to record command buffer!");
+            const CurveParams params
+            {
+                glm::vec2(swapChainExtent.width, swapChainExtent.height),
+                PIXELS_PER_CURVE_SEGMENT,
+                MAX_CURVE_TESS_LEVEL
+            };
+
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, splineObj.tessPipeline);
+            vkCmdPushConstants(cmd,
+                               splineObj.pipelayout,
+                               VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+                               sizeof(DrawPushConstants),
+                               sizeof(params),
+                               &params);
         }
+
+        vertexBuffer = splineObj.pointBuffer;
+        vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, &offset);
+        vkCmdBindIndexBuffer(cmd, splineObj.patchBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+        vkCmdDrawIndexed(cmd, splineObj.patchIndexCount, 1, 0, 0, 0);
+        break;
+
+    case CurveMode::COUNT:
+        break;
+    }
+
+    if(timed)
+    {
+        profiler.endGpuZone(cmd, zone);
     }
 }
 
@@ -1391,68 +1861,82 @@ void App::createBuffer(VkDeviceSize size,
    
 }
 
-void loadBSplineModel(BSpline& obj)
+void loadBSplineModel(BSpline& obj, SplineCache& cache, const char* pathFile)
 {
-    static constexpr const char* SPLINE_OBJ_PATH = "D:/workspace_cpp/lab1_rg/assets/models/path.obj";
+    static constexpr float SPLINE_CHORD_TOLERANCE = 0.001f;
 
-    BSpline::load(obj, SPLINE_OBJ_PATH);
+    obj.tessellation.chordTolerance = SPLINE_CHORD_TOLERANCE;
+    cache.load(obj, pathFile);
 }
 
 
 void App::loadModels() noexcept
 {
-    loadBSplineModel(spline);
-    animation = spline.animate();
-    // static constexpr const char* MODEL_PATH = "../assets/models/viking_room.obj";
-    // static constexpr const char* MODEL_PATH = "D:/workspace_cpp/lab1_rg/assets/models/aircraft747.obj";
-    static constexpr const char* MODEL_PATH = "D:/fileovi/teddy.obj";
-    Model model;
+    static constexpr const char* SPLINE_OBJ_PATH = "models/path.obj";
 
-    loadModel(MODEL_PATH, model);
+    loadBSplineModel(spline, splineCache, assetPath(SPLINE_OBJ_PATH).c_str());
 
-    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-    for(const auto& shape : model.shapes)
-    {
-        for(const auto& index : shape.mesh.indices)
-        {
-            
-            
-            Vertex vertex{};
+    // Frames are sampled by the animations, the path itself stays in the cache until an edit needs it
+    splineCache.restore(spline, SplineCache::SAMPLE_T);
+    splineCache.restore(spline, SplineCache::FRAMES);
 
-            vertex.pos = 
-            {
-                model.attributes.vertices[3 * index.vertex_index + 0],
-                model.attributes.vertices[3 * index.vertex_index + 1],
-                model.attributes.vertices[3 * index.vertex_index + 2]
-            };
-            if(!model.attributes.texcoords.empty())
-            {
-                vertex.texCoord = 
-                {
-                    model.attributes.texcoords[2 * index.texcoord_index + 0],
-                    // vulkan je top to bottom, a tinyobjloader je u koord sustavu gdje je 0 donja
-                    1.0f - model.attributes.texcoords[2 * index.texcoord_index + 1]
-                };
+    splineIndex.clear();
+    splineIndex.addSpline(spline);
+    splineIndex.build();
 
-            }
+    // Spread evenly along the path with slightly different speeds
+    static constexpr float MIN_SPEED = 6.f;
+    static constexpr float SPEED_RANGE = 4.f;
 
-            vertex.color = {1.0f, 1.0f, 1.0f};
+    animationSystem.clear();
+    animationSystem.scale = 0.3f;
+    animatedSpline = animationSystem.addSpline(spline);
+    for(uint32_t i = 0; i < animatedInstances_; ++i)
+    {
+        animationSystem.add(animatedSpline,
+                            spline.length() * i / animatedInstances_,
+                            MIN_SPEED + SPEED_RANGE * (i % 17) / 17.f);
+    }
 
-            const auto [emplaceIt, emplaceHappened] = uniqueVertices.try_emplace(vertex, static_cast<uint32_t>(planeObj.vertices.size()));
-            if(emplaceHappened)
-            {
-                planeObj.vertices.emplace_back(std::move(vertex));
-            }
-            planeObj.indices.emplace_back(emplaceIt->second);
+    // static constexpr const char* MODEL_PATH = "../assets/models/viking_room.obj";
+    static constexpr const char* MODEL_PATH = "models/aircraft747.obj";
+    Model model;
 
-        }
-    }
+    loadModel(assetPath(MODEL_PATH).c_str(), model);
+
+    std::vector<Vertex> vertices;
+    buildMesh(model, vertices, planeObj.indices);
+
+    const MeshOptimizationStats stats = optimizeMesh(vertices, planeObj.indices);
+    printf("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (FIFO cache of %u)\n",
+           MODEL_PATH, stats.before.acmr, stats.after.acmr, stats.before.atvr, stats.after.atvr, VERTEX_CACHE_SIZE);
+
+    // Welding and optimizing compare full precision vertices, only the upload is packed
+    const VertexBounds bounds = vertexBounds(vertices);
+    packVertices(vertices, bounds, planeObj.vertices);
+    planeObj.dequantization = GpuVertex::dequantization(bounds);
 }
 
 void App::createVertexBuffers() noexcept
 {
-    VkDeviceSize planeBufferSize = sizeof(Vertex) * planeObj.vertices.size();
-    VkDeviceSize splineBufferSize = sizeof(spline.path[0]) * spline.path.size();
+    // On a cache hit the path is only mapped and goes from the cache file straight into staging
+    const glm::vec3* path = splineCache.section<glm::vec3>(SplineCache::PATH);
+    if(!path)
+    {
+        path = spline.path.data();
+    }
+
+    // Every segment of a CPU tessellated path gets its own slot, so edits rewrite it in place
+    if(!gpuTessellation_)
+    {
+        splineSlots.build(spline);
+    }
+
+    VkDeviceSize planeBufferSize = sizeof(GpuVertex) * planeObj.vertices.size();
+    // The compute path writes the vertices itself, nothing goes through the staging buffer
+    VkDeviceSize splineBufferSize = gpuTessellation_ ? SplineCompute::pathSize(spline)
+                                                     : sizeof(glm::vec3) * splineSlots.capacity();
+    VkDeviceSize splineStagingSize = gpuTessellation_ ? 0 : sizeof(glm::vec3) * splineSlots.vertexCount();
     VkBuffer stagingBuffer;
     VkDeviceMemory stageBuffMemory;
     
@@ -1463,12 +1947,13 @@ void App::createVertexBuffers() noexcept
                  planeObj.vertexBuffMem);
     
     createBuffer(splineBufferSize,
-                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                 (gpuTessellation_ ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0),
                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                  splineObj.vertBuffer,
                  splineObj.vertexBuffMem);
 
-    createBuffer(planeBufferSize + splineBufferSize,
+    createBuffer(planeBufferSize + splineStagingSize,
                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                  stagingBuffer,
@@ -1514,18 +1999,340 @@ void App::createVertexBuffers() noexcept
         vkUnmapMemory(device, stageBuffMemory);
         vkCmdCopyBuffer(commandBuffer, stagingBuffer, planeObj.vertBuffer, 1, &cpy);
         
-        cpy.size = splineBufferSize;
-        cpy.srcOffset = planeBufferSize;
-        data = nullptr;
-        vkMapMemory(device, stageBuffMemory, planeBufferSize, splineBufferSize, 0, &data);
-        memcpy(data, spline.path.data(), static_cast<size_t>(splineBufferSize));
-        vkUnmapMemory(device, stageBuffMemory);
-        vkCmdCopyBuffer(commandBuffer, stagingBuffer, splineObj.vertBuffer, 1, &cpy);
+        if(!gpuTessellation_)
+        {
+            cpy.size = splineStagingSize;
+            cpy.srcOffset = planeBufferSize;
+            data = nullptr;
+            vkMapMemory(device, stageBuffMemory, planeBufferSize, splineStagingSize, 0, &data);
+            splineSlots.writeAll(spline, path, static_cast<glm::vec3*>(data));
+            vkUnmapMemory(device, stageBuffMemory);
+            vkCmdCopyBuffer(commandBuffer, stagingBuffer, splineObj.vertBuffer, 1, &cpy);
+        }
 
     endTempCommandBuffer(commandBuffer, transferQueue, transferCmdPool);
 
     vkDestroyBuffer(device, stagingBuffer, nullptr);
     vkFreeMemory(device, stageBuffMemory, nullptr);
+
+    if(gpuTessellation_)
+    {
+        static constexpr const char* BSPLINE_TESSELLATE_SHADER = "bspline_tessellate.comp.spv";
+
+        splineCompute.create(device, physicalDevice, readFile(shaderPath(BSPLINE_TESSELLATE_SHADER).c_str()), spline, splineObj.vertBuffer);
+
+        // Compute runs on the graphics queue, every graphics family supports it
+        commandBuffer = beginTempCommandBuffer(drawCmdPool);
+            splineCompute.recordAll(commandBuffer);
+        endTempCommandBuffer(commandBuffer, graphicsQueue, drawCmdPool);
+
+        splineVertexCount = splineCompute.vertexCount();
+    }
+    else
+    {
+        splineVertexCount = splineSlots.vertexCount();
+    }
+}
+
+void App::uploadSplinePath() noexcept
+{
+    const size_t oldCapacity = splineSlots.capacity();
+    splineSlots.build(spline, oldCapacity);
+
+    const VkDeviceSize bufferSize = sizeof(glm::vec3) * splineSlots.vertexCount();
+
+    vkDeviceWaitIdle(device);
+
+    // Only a path that grew past the room left for it needs a larger buffer
+    if(splineSlots.capacity() != oldCapacity)
+    {
+        vkDestroyBuffer(device, splineObj.vertBuffer, nullptr);
+        vkFreeMemory(device, splineObj.vertexBuffMem, nullptr);
+
+        createBuffer(sizeof(glm::vec3) * splineSlots.capacity(),
+                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                     splineObj.vertBuffer,
+                     splineObj.vertexBuffMem);
+    }
+
+    // New count and possibly a new buffer, only the spline's draws change
+    splineVertexCount = splineSlots.vertexCount();
+    markDirty(SCENE_SPLINE);
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+
+    createBuffer(bufferSize,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 stagingBuffer,
+                 stagingMemory);
+
+    void* data;
+    vkMapMemory(device, stagingMemory, 0, bufferSize, 0, &data);
+    splineSlots.writeAll(spline, spline.path.data(), static_cast<glm::vec3*>(data));
+    vkUnmapMemory(device, stagingMemory);
+
+    copyBuffer(stagingBuffer, splineObj.vertBuffer, bufferSize);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingMemory, nullptr);
+}
+
+void App::createCurveBuffers() noexcept
+{
+    const size_t segmentCount = spline.segmentCount();
+
+    // Segment s uses control points s .. s + 3, one line with adjacency or one patch each
+    std::vector<uint32_t> patchIndices(4 * segmentCount);
+    for(size_t s = 0; s < segmentCount; ++s)
+    {
+        for(uint32_t k = 0; k < 4; ++k)
+        {
+            patchIndices[4 * s + k] = static_cast<uint32_t>(s + k);
+        }
+    }
+
+    const VkDeviceSize pointsSize = sizeof(spline.points[0]) * spline.points.size();
+    const VkDeviceSize indicesSize = sizeof(patchIndices[0]) * patchIndices.size();
+
+    createBuffer(pointsSize,
+                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 splineObj.pointBuffer,
+                 splineObj.pointBuffMem);
+
+    createBuffer(indicesSize,
+                 VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 splineObj.patchBuffer,
+                 splineObj.patchBuffMem);
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+
+    createBuffer(pointsSize + indicesSize,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 stagingBuffer,
+                 stagingMemory);
+
+    void* data;
+    vkMapMemory(device, stagingMemory, 0, pointsSize + indicesSize, 0, &data);
+    memcpy(data, spline.points.data(), static_cast<size_t>(pointsSize));
+    memcpy(static_cast<uint8_t*>(data) + pointsSize, patchIndices.data(), static_cast<size_t>(indicesSize));
+    vkUnmapMemory(device, stagingMemory);
+
+    VkCommandBuffer commandBuffer = beginTempCommandBuffer(transferCmdPool);
+
+        VkBufferCopy cpy{};
+        cpy.srcOffset = 0;
+        cpy.dstOffset = 0;
+        cpy.size = pointsSize;
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, splineObj.pointBuffer, 1, &cpy);
+
+        cpy.srcOffset = pointsSize;
+        cpy.size = indicesSize;
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, splineObj.patchBuffer, 1, &cpy);
+
+    endTempCommandBuffer(commandBuffer, transferQueue, transferCmdPool);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingMemory, nullptr);
+
+    splineObj.patchIndexCount = static_cast<uint32_t>(patchIndices.size());
+}
+
+void App::moveControlPoint(size_t index, const glm::vec3& pos) noexcept
+{
+    // Edits rewrite the path tables, so they have to leave the cache file first
+    splineCache.detach(spline);
+
+    spline.setControlPoint(index, pos);
+    splineIndex.refitControlPoint(0, index);
+
+    // Only the segments that use the point are evaluated again. The CPU path and its frames
+    // are kept current on the GPU path too, the animation samples its tables from them.
+    size_t firstSegment;
+    size_t lastSegment;
+    spline.affectedSegments(index, firstSegment, lastSegment);
+    spline.retessellate(firstSegment, lastSegment);
+
+    // The point, the path slots or the dispatch all go into one fenced submit
+    VkCommandBuffer commandBuffer = stagingRing.begin();
+    std::vector<VkBufferCopy> regions;
+
+    // The curve pipelines evaluate the segments from the control points themselves
+    void* point = stageCopy(sizeof(spline.points[0]), sizeof(spline.points[0]) * index, regions);
+    if(point)
+    {
+        memcpy(point, &spline.points[index], sizeof(spline.points[0]));
+        recordCopies(commandBuffer, splineObj.pointBuffer, regions);
+    }
+
+    bool pathStaged = true;
+
+    if(!gpuTessellation_)
+    {
+        regions.clear();
+        pathStaged = stageSplineSegments(firstSegment, lastSegment, regions);
+
+        if(pathStaged)
+        {
+            recordCopies(commandBuffer, splineObj.vertBuffer, regions);
+        }
+    }
+    else
+    {
+        uint32_t firstDispatched;
+        uint32_t lastDispatched;
+        splineCompute.setControlPoint(spline, index, firstDispatched, lastDispatched);
+        splineCompute.record(commandBuffer, firstDispatched, lastDispatched);
+    }
+
+    // Same queue as the draws, so no semaphore and no wait for idle
+    stagingRing.submit(graphicsQueue);
+
+    // What did not fit the ring goes through blocking uploads of the whole buffer
+    if(!point)
+    {
+        uploadSplinePoints();
+    }
+
+    if(!pathStaged)
+    {
+        uploadSplinePath();
+    }
+
+    animationSystem.rebuildSpline(animatedSpline, spline, firstSegment, lastSegment);
+}
+
+bool App::stageSplineSegments(size_t firstSegment, size_t lastSegment, std::vector<VkBufferCopy>& regions) noexcept
+{
+    const uint32_t vertexCount = splineSlots.vertexCount();
+
+    for(size_t i = firstSegment; i <= lastSegment; ++i)
+    {
+        // A segment that outgrew its slot moves to the tail, when there is no room left
+        // every slot is packed again
+        SplineSlots::Slot abandoned;
+        if(!splineSlots.fit(spline, i, abandoned))
+        {
+            return false;
+        }
+
+        // The slot it left is still drawn, so it repeats a point of the current curve
+        if(abandoned.capacity > 0)
+        {
+            size_t begin;
+            size_t end;
+            spline.segmentSamples(i, begin, end);
+
+            void* data = stageCopy(sizeof(glm::vec3) * abandoned.capacity, sizeof(glm::vec3) * abandoned.begin, regions);
+            if(!data)
+            {
+                return false;
+            }
+
+            std::fill_n(static_cast<glm::vec3*>(data), abandoned.capacity, spline.path[begin]);
+        }
+
+        const SplineSlots::Slot& slot = splineSlots.slot(i);
+
+        void* data = stageCopy(sizeof(glm::vec3) * slot.capacity, sizeof(glm::vec3) * slot.begin, regions);
+        if(!data)
+        {
+            return false;
+        }
+
+        splineSlots.write(spline, spline.path.data(), i, static_cast<glm::vec3*>(data));
+    }
+
+    // A slot at the tail draws more vertices
+    if(splineSlots.vertexCount() != vertexCount)
+    {
+        splineVertexCount = splineSlots.vertexCount();
+        markDirty(SCENE_SPLINE);
+    }
+
+    return true;
+}
+
+void App::uploadSplinePoints() noexcept
+{
+    const VkDeviceSize bufferSize = sizeof(spline.points[0]) * spline.points.size();
+
+    // Frames in flight may still read the points
+    vkDeviceWaitIdle(device);
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+
+    createBuffer(bufferSize,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 stagingBuffer,
+                 stagingMemory);
+
+    void* data;
+    vkMapMemory(device, stagingMemory, 0, bufferSize, 0, &data);
+    memcpy(data, spline.points.data(), static_cast<size_t>(bufferSize));
+    vkUnmapMemory(device, stagingMemory);
+
+    copyBuffer(stagingBuffer, splineObj.pointBuffer, bufferSize);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingMemory, nullptr);
+}
+
+void* App::stageCopy(VkDeviceSize bytes, VkDeviceSize dstOffset, std::vector<VkBufferCopy>& regions) noexcept
+{
+    VkDeviceSize srcOffset;
+    void* data = stagingRing.allocate(bytes, srcOffset);
+    if(!data)
+    {
+        return nullptr;
+    }
+
+    VkBufferCopy region{};
+    region.srcOffset = srcOffset;
+    region.dstOffset = dstOffset;
+    region.size = bytes;
+    regions.push_back(region);
+
+    return data;
+}
+
+void App::recordCopies(VkCommandBuffer commandBuffer, VkBuffer dst, const std::vector<VkBufferCopy>& regions) noexcept
+{
+    if(regions.empty())
+    {
+        return;
+    }
+
+    // Frames still in flight may be reading the vertices that get overwritten
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+    vkCmdCopyBuffer(commandBuffer, stagingRing.buffer(), dst, static_cast<uint32_t>(regions.size()), regions.data());
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = dst;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
 }
 
 void App::createIndexBuffer() noexcept
@@ -1575,38 +2382,32 @@ void createBuff(VkDevice device, VkBuffer& buff, VkDeviceSize size, VkBufferUsag
 
 void App::createUniformBuffers() noexcept
 {
-    constexpr VkDeviceSize bufferSize = sizeof(UniformBuffObject);
-    // constexpr VkDeviceSize bufferSize = sizeof(BSplineVertUniform) + sizeof(BSplineGeomUniform);
-    uniformBuffers.reserve(swapChainImages.size() * 2);
-    
-    size_t totalMemory = 0;
-    for(size_t i = 0, n = swapChainImages.size() * 2; i < n; ++i)
-    {
-        VkBuffer& buffer = uniformBuffers.emplace_back();
-        createBuff(device, buffer, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-    }
-
-    VkMemoryRequirements memReqs;
-    vkGetBufferMemoryRequirements(device, uniformBuffers[0], &memReqs);
+    uniformRing.create(device, physicalDevice, sizeof(ViewUniform), 1, static_cast<uint32_t>(swapChainImages.size()));
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.memoryTypeIndex = findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    allocInfo.allocationSize = memReqs.size * uniformBuffers.size();
-
-    if(VK_SUCCESS != vkAllocateMemory(device, &allocInfo, nullptr, &uniformBuffersMemory))
+    // Per draw data goes through push constants, all an image needs from the ring is its camera
+    frameUniforms.resize(swapChainImages.size());
+    for(uint32_t i = 0; i < frameUniforms.size(); ++i)
     {
-        VK_ERR("Error while trying to allocate memory for uniform buffers!");
-    }
+        FrameUniforms& uniforms = frameUniforms[i];
 
-    for(size_t i = 0, n = uniformBuffers.size(); i < n; ++i)
-    {
-        vkBindBufferMemory(device, uniformBuffers[i], uniformBuffersMemory, memReqs.size * i);
+        uniformRing.begin(i);
+        uniforms.view = static_cast<ViewUniform*>(uniformRing.allocate(sizeof(ViewUniform), uniforms.viewOffset));
     }
+}
 
-    uniformBufferSize = memReqs.size;
-        
+void App::createInstanceBuffer() noexcept
+{
+    const VkDeviceSize regionSize = sizeof(InstanceTransform) * animatedInstances_;
+
+    createBuffer(regionSize * swapChainImages.size(),
+                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 instanceBuffer,
+                 instanceMemory);
+
+    void* data;
+    vkMapMemory(device, instanceMemory, 0, VK_WHOLE_SIZE, 0, &data);
+    instanceData = static_cast<InstanceTransform*>(data);
 }
 
 VkCommandBuffer App::beginTempCommandBuffer(VkCommandPool& pool) noexcept
@@ -1664,19 +2465,19 @@ void App::createDescriptorPool() noexcept
 
     std::array<VkDescriptorPoolSize, 2> poolSizes;
 
-    // Uniform buffer descriptor
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(swapChainImages.size() * 2);
+    // Camera set, shared by every pipeline
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 1;
     
     // Combined image sampler descriptor
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+    poolSizes[1].descriptorCount = 1;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes    = poolSizes.data();
-    poolInfo.maxSets       = static_cast<uint32_t>(swapChainImages.size() * 2);
+    poolInfo.maxSets       = 2;
 
     if(VK_SUCCESS != vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool))
     {
@@ -1686,198 +2487,545 @@ void App::createDescriptorPool() noexcept
 
 void App::createDescriptorSets() noexcept
 {
-    std::vector<VkDescriptorSetLayout> layouts(swapChainImages.size() * 2);
+    // Camera and model texture, the dynamic offset of the camera picks the image's block of the uniform ring
+    std::array<VkDescriptorSetLayout, 2> layouts = {viewDescriptorLayout, planeObj.descriptorLayout};
 
-    for(size_t i = 0, n = swapChainImages.size(); i < n; ++i)
-    {
-        layouts[i]     = planeObj.descriptorLayout;
-        layouts[n + i] = splineObj.descriptorLayout;
-    }
-
-    
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool     = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size() * 2);
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
     allocInfo.pSetLayouts        = layouts.data();
 
-    descriptorSets.resize(swapChainImages.size() * 2);
+    descriptorSets.resize(layouts.size());
     if(VK_SUCCESS != vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()))
     {
         VK_ERR("Error while allocating descriptor sets");
     }
 
-    for(size_t i = 0, n = swapChainImages.size(); i < n; ++i)
+    VkDescriptorBufferInfo uniformDescriptor{};
+    uniformDescriptor.buffer = uniformRing.buffer();
+    uniformDescriptor.offset = 0;
+    uniformDescriptor.range  = sizeof(ViewUniform);
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = textureImageView;
+    imageInfo.sampler = textureSampler;
+
+    std::array<VkWriteDescriptorSet, 2> writers{};
+
+    writers[0].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writers[0].dstSet           = descriptorSets[0];
+    writers[0].dstBinding       = 0;
+    writers[0].dstArrayElement  = 0;
+    writers[0].descriptorType   = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    writers[0].descriptorCount  = 1;
+    writers[0].pBufferInfo      = &uniformDescriptor;
+    writers[0].pImageInfo       = nullptr;
+    writers[0].pTexelBufferView = nullptr;
+
+    writers[1].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writers[1].dstSet           = descriptorSets[1];
+    writers[1].dstBinding       = 0;
+    writers[1].dstArrayElement  = 0;
+    writers[1].descriptorType   = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writers[1].descriptorCount  = 1;
+    writers[1].pBufferInfo      = nullptr;
+    writers[1].pImageInfo       = &imageInfo;
+    writers[1].pTexelBufferView = nullptr;
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writers.size()), writers.data(), 0, nullptr);
+}
+
+glm::mat4 App::viewMatrix() const noexcept
+{
+    return glm::lookAt(glm::vec3(-3.f, -3.f, -30.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
+}
+
+glm::mat4 App::projMatrix() const noexcept
+{
+    glm::mat4 proj = glm::perspective(glm::radians(45.f), swapChainExtent.width / (float) swapChainExtent.height, 0.1f, 100.f);
+
+    // GLM je za OpenGL gdi je Y-koordinata clip kordinate invertirana -> promjeni predznak scale factora za Y
+    proj[1][1] *= -1;
+
+    return proj;
+}
+
+void App::cursorRay(double cursorX, double cursorY, glm::vec3& origin, glm::vec3& dir) const noexcept
+{
+    // Cursor positions are in screen coordinates, which differ from framebuffer pixels on high DPI displays
+    int width;
+    int height;
+    glfwGetWindowSize(window, &width, &height);
+
+    // Y already points down in Vulkan clip space, so window y maps straight to NDC
+    const float x = static_cast<float>(2.0 * cursorX / std::max(width, 1) - 1.0);
+    const float y = static_cast<float>(2.0 * cursorY / std::max(height, 1) - 1.0);
+
+    const glm::mat4 inverseViewProj = glm::inverse(projMatrix() * viewMatrix());
+
+    glm::vec4 nearPoint = inverseViewProj * glm::vec4(x, y, 0.f, 1.f);
+    glm::vec4 farPoint = inverseViewProj * glm::vec4(x, y, 1.f, 1.f);
+    nearPoint /= nearPoint.w;
+    farPoint /= farPoint.w;
+
+    origin = glm::vec3(nearPoint);
+    dir = glm::vec3(farPoint - nearPoint);
+}
+
+bool App::cursorOnPlane(double cursorX, double cursorY, const glm::vec3& planePoint, glm::vec3& pos) const noexcept
+{
+    glm::vec3 origin;
+    glm::vec3 dir;
+    cursorRay(cursorX, cursorY, origin, dir);
+
+    // Third row of the view rotation is the negated viewing direction
+    const glm::mat4 view = viewMatrix();
+    const glm::vec3 normal(view[0][2], view[1][2], view[2][2]);
+
+    const float denom = glm::dot(dir, normal);
+    if(std::abs(denom) < 1e-12f)
     {
-        VkDescriptorBufferInfo modelUniformDescriptor{};
-        modelUniformDescriptor.buffer = uniformBuffers[i];
-        modelUniformDescriptor.offset = 0;
-        modelUniformDescriptor.range  = sizeof(UniformBuffObject);
+        return false;
+    }
 
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = textureImageView;
-        imageInfo.sampler = textureSampler;
-        
-        VkDescriptorBufferInfo splineUniformDescriptor{};
-        splineUniformDescriptor.buffer = uniformBuffers[n + i];
-        splineUniformDescriptor.offset = 0;
-        splineUniformDescriptor.range = sizeof(UniformBuffObject);
-
-
-        std::array<VkWriteDescriptorSet, 3> writers{};
-
-        writers[0].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writers[0].dstSet           = descriptorSets[i];
-        writers[0].dstBinding       = 0;
-        writers[0].dstArrayElement  = 0;
-        writers[0].descriptorType   = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        writers[0].descriptorCount  = 1;
-        writers[0].pBufferInfo      = &modelUniformDescriptor;
-        writers[0].pImageInfo       = nullptr;
-        writers[0].pTexelBufferView = nullptr;
-
-        writers[1].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writers[1].dstSet           = descriptorSets[i];
-        writers[1].dstBinding       = 1;
-        writers[1].dstArrayElement  = 0;
-        writers[1].descriptorType   = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        writers[1].descriptorCount  = 1;
-        writers[1].pBufferInfo      = nullptr;
-        writers[1].pImageInfo       = &imageInfo;
-        writers[1].pTexelBufferView = nullptr;
-
-        writers[2].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writers[2].dstSet           = descriptorSets[n + i];
-        writers[2].dstBinding       = 0;
-        writers[2].dstArrayElement  = 0;
-        writers[2].descriptorType   = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        writers[2].descriptorCount  = 1;
-        writers[2].pBufferInfo      = &splineUniformDescriptor;
-        writers[2].pImageInfo       = nullptr;
-        writers[2].pTexelBufferView = nullptr;
-
-        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writers.size()), writers.data(), 0, nullptr);
+    const float s = glm::dot(planePoint - origin, normal) / denom;
+    if(s < 0.f)
+    {
+        return false;
     }
+
+    pos = origin + s * dir;
+    return true;
 }
 
-void App::updateUniformBuffer(uint32_t currentImage) noexcept
+bool App::pickSpline(double cursorX, double cursorY, float radius, SplineHit& hit) const noexcept
 {
-    // static auto startTime = std::chrono::high_resolution_clock::now();
+    glm::vec3 origin;
+    glm::vec3 dir;
+    cursorRay(cursorX, cursorY, origin, dir);
 
-    // auto currentTime = std::chrono::high_resolution_clock::now();
+    return splineIndex.pick(origin, dir, radius, hit);
+}
 
-    // float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
-    
-    // const auto& [pos, tang, bitang] = animation.update();
-    // glm::vec3 w = glm::normalize(tang);
-    // glm::vec3 u = glm::normalize(glm::cross(w, glm::normalize(bitang)));
-    // glm::vec3 v = glm::normalize(glm::cross(w, u));
-    // glm::mat4 DRM = glm::inverse(glm::transpose(glm::mat3(w, u, v)));
-    
-    UniformBuffObject ubo{};
-    // ubo.model = glm::rotate(glm::mat4(1.f), time * glm::radians(90.f), glm::vec3(0.f, 0.f, 1.f));
-    
-    ubo.model = glm::scale(glm::mat4(1.f), glm::vec3(0.3f, 0.3f, 0.3f));
-    // ubo.model = glm::translate(ubo.model, pos);
-    // ubo.model = glm::rotate(ubo.model, glm::radians(-90.f), glm::vec3(0.f, 0.f, 1.f));
-    // ubo.model = ubo.model * DRM;
-    // ubo.model = glm::scale(ubo.model, glm::vec3(1.f, 5.f, 5.f));
-
-    ubo.view  = glm::lookAt(glm::vec3(-3.f, -3.f, -30.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
-    ubo.proj  = glm::perspective(glm::radians(45.f), swapChainExtent.width / (float) swapChainExtent.height, 0.1f, 100.f);
-    
-    // GLM je za OpenGL gdi je Y-koordinata clip kordinate invertirana -> promjeni predznak scale factora za Y
-    ubo.proj[1][1] *= -1;
+void App::mouseButton(int button, int action) noexcept
+{
+    double cursorX;
+    double cursorY;
+    glfwGetCursorPos(window, &cursorX, &cursorY);
+
+    if(GLFW_MOUSE_BUTTON_LEFT == button && GLFW_PRESS == action)
+    {
+        SplineHit hit;
+        if(!pickSpline(cursorX, cursorY, PICK_RADIUS, hit))
+        {
+            return;
+        }
 
+        // Segment i uses control points i - 1 .. i + 2, the one closest to the hit is grabbed
+        const size_t first = static_cast<size_t>(hit.segment) - 1;
+        dragPoint = first;
+        for(size_t k = first + 1; k <= first + 3; ++k)
+        {
+            if(glm::distance(spline.points[k].pos, hit.position) < glm::distance(spline.points[dragPoint].pos, hit.position))
+            {
+                dragPoint = k;
+            }
+        }
+
+        dragPlanePoint = spline.points[dragPoint].pos;
+        dragging = true;
+    }
+    else if(GLFW_MOUSE_BUTTON_LEFT == button && GLFW_RELEASE == action)
+    {
+        // The last position still lands, updateDrag runs before the next frame
+        dragging = false;
+    }
+}
+
+void App::cursorMoved(double cursorX, double cursorY) noexcept
+{
+    if(dragging && cursorOnPlane(cursorX, cursorY, dragPlanePoint, dragTarget))
+    {
+        dragMoved = true;
+    }
+}
+
+void App::updateDrag() noexcept
+{
+    if(dragMoved)
+    {
+        dragMoved = false;
+        moveControlPoint(dragPoint, dragTarget);
+    }
+}
+
+void App::updateUniformBuffer(uint32_t currentImage) noexcept
+{
+    // Simulation runs at a fixed rate independent of present mode and GPU load,
+    // the rendered state is interpolated between the last two ticks
+    {
+        PROFILE_SCOPE(profiler, "animation tick");
+        // Headless frames step a fixed frame time, so every run renders the same animation states
+        const uint32_t ticks = headless_ ? frameClock.advance(HEADLESS_FRAME_TIME) : frameClock.beginFrame();
+        animationSystem.tick(ticks, frameClock.tickDt());
+    }
+
+    // Orientation comes from the precomputed rotation minimizing frames, no per frame basis or inverse.
+    // Transforms go straight into this image's region of the mapped instance buffer.
+    {
+        PROFILE_SCOPE(profiler, "write instances");
+        animationSystem.write((frameClock.alpha() - 1.f) * frameClock.tickDt(),
+                              instanceData + static_cast<size_t>(animatedInstances_) * currentImage);
+    }
     
-    void* data;
-    vkMapMemory(device, uniformBuffersMemory, uniformBufferSize * currentImage, sizeof(ubo), 0, &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(device, uniformBuffersMemory);
-
-    ubo.model = glm::mat4(1.f);
-    // ubo.model = glm::scale(ubo.model, glm::vec3(5.f, 5.f, 5.f));
-    // for(size_t i = 0; i < spline.path.size(); ++i)
-    // {
-    //     auto point = glm::vec4(spline.path[i], 1.0);
-    //     auto projecirano = ubo.model * ubo.view * ubo.proj * point;
-    //     printf("%f %f %f %f\n", projecirano.x, projecirano.y, projecirano.z, projecirano.w);
-    // }
-    vkMapMemory(device, uniformBuffersMemory, uniformBufferSize * (currentImage + swapChainImages.size()), sizeof(ubo), 0, &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(device, uniformBuffersMemory);
+    // Model transforms are pushed when the draws are recorded, only the camera is per frame memory
+    ViewUniform ubo{};
+    ubo.view  = viewMatrix();
+    ubo.proj  = projMatrix();
+
+    // Straight into the image's block of the mapped uniform ring
+    memcpy(frameUniforms[currentImage].view, &ubo, sizeof(ubo));
 
 }
 
 void App::drawFrame() noexcept {
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    profiler.beginFrame(static_cast<uint32_t>(currentFrame));
+
+    {
+        PROFILE_SCOPE(profiler, "wait frame fence");
+        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    }
+
+    // The fence covers the last submit of this slot, its timestamps are ready
+    profiler.resolve();
 
     uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    VkResult result = VK_SUCCESS;
 
-    if (VK_ERROR_OUT_OF_DATE_KHR == result)
+    if (headless_)
     {
-        recreateSwapchain();
-        return;
-    } else if (VK_SUCCESS != result && VK_SUBOPTIMAL_KHR != result)
+        // One offscreen image per frame in flight, the fence above already covers it
+        imageIndex = static_cast<uint32_t>(currentFrame);
+    }
+    else
     {
-        VK_ERR("Failed to acquire swap chain image!\n");
+        PROFILE_SCOPE(profiler, "acquire");
+        result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+        if (VK_ERROR_OUT_OF_DATE_KHR == result)
+        {
+            recreateSwapchain();
+            profiler.endFrame();
+            return;
+        } else if (VK_SUCCESS != result && VK_SUBOPTIMAL_KHR != result)
+        {
+            VK_ERR("Failed to acquire swap chain image!\n");
+        }
     }
 
     if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+        PROFILE_SCOPE(profiler, "wait image fence");
         vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
     }
     imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
-    updateUniformBuffer(imageIndex);
+    {
+        PROFILE_SCOPE(profiler, "update uniforms");
+        updateUniformBuffer(imageIndex);
+    }
+
+    {
+        PROFILE_SCOPE(profiler, "record commands");
+        recordCommandBuffer(imageIndex);
+    }
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
+    // Headless frames are neither acquired nor presented
     VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
     VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.waitSemaphoreCount = headless_ ? 0 : 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
 
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+    // The profiler puts its timestamp writes around the frame's command buffer
+    VkCommandBuffer cmds[3];
+    submitInfo.commandBufferCount = profiler.wrap(commandBuffers[imageIndex], cmds);
+    submitInfo.pCommandBuffers = cmds;
 
     VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.signalSemaphoreCount = headless_ ? 0 : 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
     vkResetFences(device, 1, &inFlightFences[currentFrame]);
 
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-        VK_ERR("failed to submit draw command buffer!");
+    {
+        PROFILE_SCOPE(profiler, "submit");
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+            VK_ERR("failed to submit draw command buffer!");
+        }
+    }
+
+    if(headless_)
+    {
+        lastImage_ = imageIndex;
+    }
+    else
+    {
+        VkPresentInfoKHR presentInfo{};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = signalSemaphores;
+
+        VkSwapchainKHR swapChains[] = {swapChain};
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = swapChains;
+
+        presentInfo.pImageIndices = &imageIndex;
+
+        {
+            PROFILE_SCOPE(profiler, "present");
+            result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        }
+
+        if(VK_ERROR_OUT_OF_DATE_KHR == result || VK_SUBOPTIMAL_KHR == result || framebufferResized_)
+        {
+            framebufferResized_ = false;
+            recreateSwapchain();
+        } else if (VK_SUCCESS != result)
+        {
+            VK_ERR("Failed to present to the swapchain image!\n");
+        }
     }
 
-    VkPresentInfoKHR presentInfo{};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+
+    if(benchmarkCurves_)
+    {
+        advanceCurveBenchmark();
+    }
 
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    profiler.endFrame();
+}
 
-    VkSwapchainKHR swapChains[] = {swapChain};
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
+bool App::curveModeSupported(CurveMode mode) const noexcept
+{
+    return CurveMode::TESSELLATION != mode || tessellationSupported_;
+}
 
-    presentInfo.pImageIndices = &imageIndex;
+void App::advanceCurveBenchmark() noexcept
+{
+    // GPU zones have to be recorded in the frame they are submitted with, so the spline's
+    // secondaries are recorded again every frame while benchmarking
+    markDirty(SCENE_SPLINE);
 
-    result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    if(++curveBenchFrame < CURVE_BENCH_WARMUP + CURVE_BENCH_FRAMES)
+    {
+        return;
+    }
 
-    if(VK_ERROR_OUT_OF_DATE_KHR == result || VK_SUBOPTIMAL_KHR == result || framebufferResized_)
+    uint32_t next = static_cast<uint32_t>(curveMode_) + 1;
+    while(next < static_cast<uint32_t>(CurveMode::COUNT) && !curveModeSupported(static_cast<CurveMode>(next)))
     {
-        framebufferResized_ = false;
-        recreateSwapchain();
-    } else if (VK_SUCCESS != result)
+        ++next;
+    }
+
+    if(static_cast<uint32_t>(CurveMode::COUNT) == next)
     {
-        VK_ERR("Failed to present to the swapchain image!\n");
+        // Every zone is named after its mode, only the frames still in flight are missing
+        vkDeviceWaitIdle(device);
+        profiler.flush();
+
+        printCurveBenchmark();
+        quit_ = true;
+        return;
     }
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    curveMode_ = static_cast<CurveMode>(next);
+    curveBenchFrame = 0;
+}
+
+void App::printCurveBenchmark() const noexcept
+{
+    printf("Spline draw GPU time, %u frames per mode after %u warm up frames\n", CURVE_BENCH_FRAMES, CURVE_BENCH_WARMUP);
+
+    for(size_t i = 0; i < CURVE_ZONE_NAMES.size(); ++i)
+    {
+        const std::vector<double> times = profiler.gpuTimes(CURVE_ZONE_NAMES[i]);
+        if(times.empty())
+        {
+            printf("  %-13s not measured\n", curveModeName(static_cast<CurveMode>(i)));
+            continue;
+        }
+
+        double sum = 0.0;
+        for(double t : times)
+        {
+            sum += t;
+        }
+
+        printf("  %-13s %8.4f ms\n", curveModeName(static_cast<CurveMode>(i)), sum / times.size());
+    }
+}
+
+void App::createOffscreenImages() noexcept
+{
+    swapChainImageFormat = OFFSCREEN_FORMAT;
+    swapChainExtent = {static_cast<uint32_t>(width_), static_cast<uint32_t>(height_)};
+
+    swapChainImages.resize(OFFSCREEN_IMAGES);
+    offscreenMemory.resize(OFFSCREEN_IMAGES);
+
+    for(uint32_t i = 0; i < OFFSCREEN_IMAGES; ++i)
+    {
+        createImage(swapChainExtent.width,
+                    swapChainExtent.height,
+                    OFFSCREEN_FORMAT,
+                    VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    swapChainImages[i],
+                    offscreenMemory[i]);
+    }
+}
+
+// Average, median, 99th percentile and max of times, which gets sorted
+static void printTimes(const char* name, std::vector<double>& times) noexcept
+{
+    if(times.empty())
+    {
+        printf("  %-4s not measured\n", name);
+        return;
+    }
+
+    std::sort(times.begin(), times.end());
+
+    double sum = 0.0;
+    for(double t : times)
+    {
+        sum += t;
+    }
+
+    printf("  %-4s avg %8.3f  p50 %8.3f  p99 %8.3f  max %8.3f ms\n",
+           name,
+           sum / times.size(),
+           times[times.size() / 2],
+           times[std::min(times.size() - 1, times.size() * 99 / 100)],
+           times.back());
+}
+
+void App::printFrameTimings(std::vector<double>& frameTimes) const noexcept
+{
+    printf("Headless %ux%u, %zu frames\n", swapChainExtent.width, swapChainExtent.height, frameTimes.size());
+
+#if BSPLINE_PROFILER
+    // CPU time of a frame without its waits for the GPU
+    std::vector<double> cpu = profiler.cpuTimes({"wait frame fence", "wait image fence"});
+    std::vector<double> gpu = profiler.gpuTimes();
+
+    printTimes("cpu", cpu);
+    printTimes("gpu", gpu);
+#else
+    // Waits for the GPU are included, CPU and GPU time need the profiler to be told apart
+    printTimes("wall", frameTimes);
+#endif
+}
+
+void App::saveImage(uint32_t image, const char* path) noexcept
+{
+    const uint32_t width = swapChainExtent.width;
+    const uint32_t height = swapChainExtent.height;
+    const VkDeviceSize size = 4 * static_cast<VkDeviceSize>(width) * height;
+
+    VkBuffer readback;
+    VkDeviceMemory readbackMemory;
+
+    createBuffer(size,
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 readback,
+                 readbackMemory);
+
+    // The image belongs to the graphics family, so it is copied there
+    VkCommandBuffer commandBuffer = beginTempCommandBuffer(drawCmdPool);
+
+        // The render pass left it in TRANSFER_SRC_OPTIMAL, only the writes need to be visible
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = swapChainImages[image];
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {width, height, 1};
+
+        vkCmdCopyImageToBuffer(commandBuffer,
+                               swapChainImages[image],
+                               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               readback,
+                               1,
+                               &region);
+
+        VkBufferMemoryBarrier hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.buffer = readback;
+        hostBarrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_HOST_BIT,
+                             0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+    endTempCommandBuffer(commandBuffer, graphicsQueue, drawCmdPool);
+
+    void* data;
+    vkMapMemory(device, readbackMemory, 0, size, 0, &data);
+
+    // OFFSCREEN_FORMAT is BGRA, PNG wants RGBA
+    std::vector<uint8_t> pixels(static_cast<size_t>(size));
+    const uint8_t* bgra = static_cast<const uint8_t*>(data);
+    for(size_t i = 0; i < pixels.size(); i += 4)
+    {
+        pixels[i + 0] = bgra[i + 2];
+        pixels[i + 1] = bgra[i + 1];
+        pixels[i + 2] = bgra[i + 0];
+        pixels[i + 3] = bgra[i + 3];
+    }
+
+    vkUnmapMemory(device, readbackMemory);
+
+    vkDestroyBuffer(device, readback, nullptr);
+    vkFreeMemory(device, readbackMemory, nullptr);
+
+    if(!writePng(path, width, height, pixels.data()))
+    {
+        fprintf(stderr, "Error while trying to write %s\n", path);
+        return;
+    }
+
+    printf("Saved the last frame to %s\n", path);
 }
 
 VkShaderModule App::createShaderModule(const std::vector<uint8_t>& code) noexcept {
@@ -1923,10 +3071,11 @@ SwapChainSupportDetails App::querySwapChainSupport(VkPhysicalDevice device) cons
 bool App::isDeviceSuitable(VkPhysicalDevice device) const noexcept {
     QueueFamilyIndices indices = findQueueFamilies(device, surface);
 
-    bool extensionsSupported = checkDeviceExtensionSupport(device);
+    // Headless needs no surface, so neither the extensions nor a swapchain are checked
+    bool extensionsSupported = headless_ || checkDeviceExtensionSupport(device);
 
-    bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    bool swapChainAdequate = headless_;
+    if (!headless_ && extensionsSupported) {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
@@ -1988,7 +3137,10 @@ bool App::checkValidationLayerSupport() const noexcept {
 
 void App::run() noexcept
 {
-    initWindow(width_, height_);
+    if(!headless_)
+    {
+        initWindow(width_, height_);
+    }
     initVulkan();
     mainLoop();
     cleanup();
@@ -9,11 +9,23 @@
 
 #include <vector>
 #include <array>
+#include <string>
+#include <initializer_list>
 
 
 #include "queue_families.h"
 #include "vertex.h"
 #include "bspline.h"
+#include "spline_cache.h"
+#include "spline_compute.h"
+#include "animation_system.h"
+#include "frame_clock.h"
+#include "spline_bvh.h"
+#include "spline_slots.h"
+#include "staging_ring.h"
+#include "uniform_ring.h"
+#include "uniform.h"
+#include "profiler.h"
 
 
 #define VK_ERR(_msg)            \
@@ -34,22 +46,96 @@ struct BSplineObj
 {
     VkPipelineLayout pipelayout{ VK_NULL_HANDLE };
     VkPipeline pipeline{ VK_NULL_HANDLE };
-    VkDescriptorSetLayout descriptorLayout{ VK_NULL_HANDLE };
     VkBuffer vertBuffer{ VK_NULL_HANDLE };
     VkDeviceMemory vertexBuffMem{ VK_NULL_HANDLE };
+
+    // Curve pipelines that expand the segments on the GPU from the control points,
+    // drawn with one 4 index patch per segment
+    VkPipeline geomPipeline{ VK_NULL_HANDLE };
+    VkPipeline tessPipeline{ VK_NULL_HANDLE };
+    VkBuffer pointBuffer{ VK_NULL_HANDLE };
+    VkDeviceMemory pointBuffMem{ VK_NULL_HANDLE };
+    VkBuffer patchBuffer{ VK_NULL_HANDLE };
+    VkDeviceMemory patchBuffMem{ VK_NULL_HANDLE };
+    uint32_t patchIndexCount{ 0 };
+
+    // Pushed with the draw
+    glm::mat4 model{ 1.f };
+};
+
+// How the spline is drawn
+enum class CurveMode : uint32_t
+{
+    // Tessellated path (CPU or bspline_tessellate.comp) as a point list
+    PATH_POINTS,
+    // bspline.geom, a fixed 64 vertex strip per segment
+    GEOMETRY,
+    // Isolines with a level per segment from its projected length
+    TESSELLATION,
+    COUNT
+};
+
+const char* curveModeName(CurveMode mode) noexcept;
+
+// Accepts the names returned by curveModeName
+bool parseCurveMode(const char* name, CurveMode& mode) noexcept;
+
+// Compiled SPIR-V and the models and textures, CMake points them at the build and source tree
+#ifndef BSPLINE_SHADER_DIR
+#define BSPLINE_SHADER_DIR "shaders"
+#endif
+
+#ifndef BSPLINE_ASSET_DIR
+#define BSPLINE_ASSET_DIR "assets"
+#endif
+
+struct AppOptions
+{
+    CurveMode curveMode{CurveMode::PATH_POINTS};
+
+    // Tessellates the spline with bspline_tessellate.comp straight into the path buffer,
+    // false tessellates on the CPU and uploads the path
+    bool gpuTessellation{true};
+
+    // Models moving along the spline, drawn with one instanced draw. Stress runs raise it
+    // with --instances.
+    uint32_t animatedInstances{1};
+
+    // Ignores curveMode and draws with every supported curve mode in turn,
+    // prints the GPU time of the spline draw for each and quits
+    bool benchmarkCurves{false};
+
+    // Renders headlessFrames frames into offscreen images with no window or surface and
+    // prints the CPU and GPU time per frame. The last frame is saved to pngPath if set.
+    bool headless{false};
+    uint32_t headlessFrames{300};
+    const char* pngPath{nullptr};
+
+    // Where exportProfile writes the recorded frames, CSV when it ends with .csv and
+    // Chrome trace JSON otherwise. Also written when the app exits if set.
+    const char* profilePath{nullptr};
+
+    const char* shaderDir{BSPLINE_SHADER_DIR};
+    const char* assetDir{BSPLINE_ASSET_DIR};
 };
 
 struct PlaneObj
 {
     VkPipelineLayout pipeLayout{ VK_NULL_HANDLE };
     VkPipeline pipeline{ VK_NULL_HANDLE };
+    // Set 1, the texture
     VkDescriptorSetLayout descriptorLayout{ VK_NULL_HANDLE };
     VkBuffer vertBuffer{ VK_NULL_HANDLE };
     VkDeviceMemory vertexBuffMem{ VK_NULL_HANDLE };
     VkBuffer indBuffer{ VK_NULL_HANDLE };
     VkDeviceMemory indexBufferMemory{ VK_NULL_HANDLE };
-    std::vector<Vertex> vertices{};
+    std::vector<GpuVertex> vertices{};
     std::vector<uint32_t> indices{};
+    // Of vertices, applied with the draw
+    VertexDequantization dequantization{};
+
+    // Local transform of the model, pushed with the draw. Placement on the path is per instance.
+    glm::mat4 model{ 1.f };
 };
 
 struct App
@@ -57,6 +143,19 @@ struct App
 
     App(int width, int height) : width_(width), height_(height) {}
 
+    App(int width, int height, const AppOptions& options)
+        : width_(width), height_(height),
+          curveMode_(options.benchmarkCurves ? CurveMode::PATH_POINTS : options.curveMode),
+          gpuTessellation_(options.gpuTessellation),
+          animatedInstances_(options.animatedInstances),
+          benchmarkCurves_(options.benchmarkCurves),
+          headless_(options.headless),
+          headlessFrames_(options.headlessFrames),
+          pngPath_(options.pngPath),
+          profilePath_(options.profilePath),
+          shaderDir_(options.shaderDir),
+          assetDir_(options.assetDir) {}
+
     ~App();
 
     void run() noexcept;
@@ -64,11 +163,45 @@ struct App
 
     void framebufferResized(bool) noexcept;
 
+    // Moves a spline control point, on the GPU path this is one dispatch over the affected segments
+    void moveControlPoint(size_t index, const glm::vec3& pos) noexcept;
+
+    // Point of the spline under the cursor (window coordinates) within radius world units
+    bool pickSpline(double cursorX, double cursorY, float radius, SplineHit& hit) const noexcept;
+
+    // Writes the frames kept by the profiler to profilePath (frame_profile.json when unset)
+    void exportProfile() const noexcept;
+
 
 private:
 
     static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
+    // Simulation ticks per second and the most ticks simulated in one frame
+    static constexpr double ANIMATION_TICK_RATE = 120.0;
+    static constexpr uint32_t MAX_CATCH_UP_TICKS = 8;
+
+    // Simulated time of one headless frame, independent of how long it took to render
+    static constexpr double HEADLESS_FRAME_TIME = 1.0 / 60.0;
+
+    // Curve tessellation: target screen length of one line piece and the most pieces per segment
+    static constexpr float PIXELS_PER_CURVE_SEGMENT = 4.f;
+    static constexpr float MAX_CURVE_TESS_LEVEL = 64.f;
+
+    // Frames skipped and frames measured per curve mode when benchmarking
+    static constexpr uint32_t CURVE_BENCH_WARMUP = 60;
+    static constexpr uint32_t CURVE_BENCH_FRAMES = 600;
+
+    // Headless rendering: same format chooseSwapSurfaceFormat prefers, one image per frame in flight
+    static constexpr VkFormat OFFSCREEN_FORMAT = VK_FORMAT_B8G8R8A8_SRGB;
+    static constexpr uint32_t OFFSCREEN_IMAGES = MAX_FRAMES_IN_FLIGHT;
+
+    // Host visible memory kept mapped for small uploads such as spline edits
+    static constexpr VkDeviceSize STAGING_RING_SIZE = 4 << 20;
+
+    // How close to the spline a click has to be, in world units
+    static constexpr float PICK_RADIUS = 0.5f;
+
     void initWindow(int width, int height);
 
     void initVulkan() noexcept;
@@ -89,6 +222,16 @@ private:
 
     void createSwapChain() noexcept;
 
+    // Stands in for the swapchain when headless, the images end up in swapChainImages
+    void createOffscreenImages() noexcept;
+
+    // CPU and GPU frame times of the headless run from the profiler, or the wall times of
+    // its frames in a build without it
+    void printFrameTimings(std::vector<double>& frameTimes) const noexcept;
+
+    // Copies a finished offscreen image into host memory and writes it as PNG
+    void saveImage(uint32_t image, const char* path) noexcept;
+
     void createImageViews() noexcept;
 
     void createRenderPass() noexcept;
@@ -103,6 +246,8 @@ private:
 
     void createUniformBuffers() noexcept;
 
+    void createInstanceBuffer() noexcept;
+
     void createDescriptorPool() noexcept;
 
     void createDescriptorSets() noexcept;
@@ -137,17 +282,14 @@ private:
                      VkDeviceMemory& imageMemory) noexcept;
 
     template<typename QFamilyIndexGetter>
-    void createCommandPool(VkCommandPool& cmdPool, bool transient, QFamilyIndexGetter getter) noexcept 
+    void createCommandPool(VkCommandPool& cmdPool, VkCommandPoolCreateFlags flags, QFamilyIndexGetter getter) noexcept 
     {
         QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice, surface);
 
         VkCommandPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
         poolInfo.queueFamilyIndex = getter(queueFamilyIndices);
-        if(transient)
-        {
-            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
-        }
+        poolInfo.flags = flags;
 
         if (vkCreateCommandPool(device, &poolInfo, nullptr, &cmdPool) != VK_SUCCESS) {
             VK_ERR("failed to create command pool!");
@@ -156,6 +298,33 @@ private:
 
     void createCommandBuffers() noexcept;
 
+    // Objects of the scene, every one draws from its own secondary command buffers
+    enum SceneObject : uint32_t
+    {
+        SCENE_MODEL,
+        SCENE_SPLINE,
+        SCENE_OBJECT_COUNT
+    };
+
+    // Records commandBuffers[image] once per frame right before the submit, it re-records the
+    // image's dirty secondaries and executes the secondaries of every object
+    void recordCommandBuffer(uint32_t image) noexcept;
+
+    // Has the object's secondaries re-recorded before each image is next submitted, for when
+    // the pipeline, buffers or draw parameters of the object change
+    void markDirty(SceneObject object) noexcept;
+
+    void recordObject(SceneObject object, uint32_t image) noexcept;
+
+    void recordModel(VkCommandBuffer cmd, uint32_t image) noexcept;
+
+    void recordSpline(VkCommandBuffer cmd, uint32_t image) noexcept;
+
+    // Pipeline layout with setLayouts after the shared view set and the shared push constant
+    // ranges. Every layout being compatible for set 0 and the push constants lets the view
+    // set stay bound across pipeline switches.
+    VkPipelineLayout createPipelineLayout(std::initializer_list<VkDescriptorSetLayout> setLayouts) noexcept;
+
     VkCommandBuffer beginTempCommandBuffer(VkCommandPool& pool) noexcept;
 
     void endTempCommandBuffer(VkCommandBuffer& buffer, VkQueue& queue, VkCommandPool& pool) noexcept;
@@ -170,6 +339,34 @@ private:
 
     void createIndexBuffer() noexcept;
 
+    // Packs the slots of splineSlots again and rewrites the whole path, the buffer is only
+    // recreated when the packed path does not fit it
+    void uploadSplinePath() noexcept;
+
+    // Stages the slots of segments firstSegment..lastSegment after retessellate, regions copy
+    // them into splineObj.vertBuffer. False when they do not fit, uploadSplinePath has to follow.
+    bool stageSplineSegments(size_t firstSegment, size_t lastSegment, std::vector<VkBufferCopy>& regions) noexcept;
+
+    // Blocking upload of every control point, for when an edit does not fit stagingRing
+    void uploadSplinePoints() noexcept;
+
+    // Reserves bytes in stagingRing for a copy to dstOffset, which is appended to regions.
+    // Returns where to write them, nullptr when they do not fit.
+    void* stageCopy(VkDeviceSize bytes, VkDeviceSize dstOffset, std::vector<VkBufferCopy>& regions) noexcept;
+
+    // One vkCmdCopyBuffer of regions from stagingRing to dst, between barriers against the draws reading it
+    void recordCopies(VkCommandBuffer commandBuffer, VkBuffer dst, const std::vector<VkBufferCopy>& regions) noexcept;
+
+    // Control point and patch index buffers for the geometry and tessellation curve modes
+    void createCurveBuffers() noexcept;
+
+    bool curveModeSupported(CurveMode mode) const noexcept;
+
+    // Moves the benchmark to the next curve mode once enough frames were measured
+    void advanceCurveBenchmark() noexcept;
+
+    void printCurveBenchmark() const noexcept;
+
     uint32_t findMemoryType(uint32_t, VkMemoryPropertyFlags) noexcept;
 
     bool isDeviceSuitable(VkPhysicalDevice device) const noexcept;
@@ -182,6 +379,25 @@ private:
 
     void updateUniformBuffer(uint32_t index) noexcept;
 
+    glm::mat4 viewMatrix() const noexcept;
+
+    // Already flipped for Vulkan clip space
+    glm::mat4 projMatrix() const noexcept;
+
+    // World space ray through the cursor (window coordinates)
+    void cursorRay(double cursorX, double cursorY, glm::vec3& origin, glm::vec3& dir) const noexcept;
+
+    // Where the cursor ray crosses the plane through planePoint that faces the camera
+    bool cursorOnPlane(double cursorX, double cursorY, const glm::vec3& planePoint, glm::vec3& pos) const noexcept;
+
+    // Left drag moves the control point nearest to where the spline was grabbed
+    void mouseButton(int button, int action) noexcept;
+
+    void cursorMoved(double cursorX, double cursorY) noexcept;
+
+    // Applies the last cursor position of a drag, once per frame however many events came in
+    void updateDrag() noexcept;
+
     void drawFrame() noexcept;
 
     void recreateSwapchain() noexcept;
@@ -190,13 +406,18 @@ private:
 
     VkShaderModule createShaderModule(const std::vector<uint8_t>& code) noexcept;
 
+    // name inside shaderDir_ or assetDir_
+    std::string shaderPath(const char* name) const;
+
+    std::string assetPath(const char* name) const;
+
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) const noexcept;
 
     GLFWwindow* window;
 
     VkInstance instance;
     VkDebugUtilsMessengerEXT debugMessenger;
-    VkSurfaceKHR surface;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
 
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice device;
@@ -205,7 +426,9 @@ private:
     VkQueue presentQueue;
     VkQueue transferQueue;
 
-    VkSwapchainKHR swapChain;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    // Memory of the offscreen images when headless
+    std::vector<VkDeviceMemory> offscreenMemory;
     std::vector<VkImage> swapChainImages;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
@@ -220,17 +443,58 @@ private:
     VkCommandPool drawCmdPool;
     std::vector<VkCommandBuffer> commandBuffers;
 
+    // Secondary command buffers [object][image] and which of them have to be re-recorded
+    std::array<std::vector<VkCommandBuffer>, SCENE_OBJECT_COUNT> objectCommands;
+    std::array<std::vector<bool>, SCENE_OBJECT_COUNT> objectDirty;
+
     VkCommandPool transferCmdPool;
     
     BSpline spline;
-    BSpline::Animation animation;
+    SplineCache splineCache;
+    SplineCompute splineCompute;
+    uint32_t splineVertexCount = 0;
+    // Where every segment of the CPU tessellated path lives in splineObj.vertBuffer
+    SplineSlots splineSlots;
+
+    // Spatial index over the segments of spline, refit whenever a control point moves
+    SplineBVH splineIndex;
+
+    // Control point dragged with the mouse, it moves in the plane through where it was grabbed
+    bool dragging = false;
+    bool dragMoved = false;
+    size_t dragPoint = 0;
+    glm::vec3 dragPlanePoint{0.f};
+    glm::vec3 dragTarget{0.f};
+
+    StagingRing stagingRing;
+
+    AnimationSystem animationSystem;
+    // Id of spline in animationSystem, rebuilt after every edit
+    uint32_t animatedSpline = 0;
+    FrameClock frameClock{ANIMATION_TICK_RATE, MAX_CATCH_UP_TICKS};
+    // One region of animatedInstances_ transforms per swapchain image, mapped for the whole run
+    VkBuffer instanceBuffer;
+    VkDeviceMemory instanceMemory;
+    InstanceTransform* instanceData{nullptr};
+
+
+    // Camera of every swapchain image, one region per image
+    UniformRing uniformRing;
+
+    // Where a swapchain image finds its camera, offset is the dynamic offset of set 0
+    struct FrameUniforms
+    {
+        ViewUniform* view;
+        uint32_t viewOffset;
+    };
 
+    std::vector<FrameUniforms> frameUniforms;
 
-    std::vector<VkBuffer> uniformBuffers;
-    VkDeviceMemory uniformBuffersMemory;
-    VkDeviceSize uniformBufferSize;
+    // Set 0 of every pipeline layout, the camera
+    VkDescriptorSetLayout viewDescriptorLayout;
 
     VkDescriptorPool descriptorPool;
+    // [0] camera (set 0 of every pipeline), [1] model texture (set 1 of the model pipeline)
     std::vector<VkDescriptorSet> descriptorSets;
 
     VkImage textureImage;
@@ -255,6 +519,29 @@ private:
 
     bool framebufferResized_ = false;
 
+    CurveMode curveMode_ = CurveMode::PATH_POINTS;
+    bool gpuTessellation_ = true;
+    uint32_t animatedInstances_ = 1;
+    bool benchmarkCurves_ = false;
+    bool tessellationSupported_ = false;
+
+    uint32_t curveBenchFrame = 0;
+
+    // Ends mainLoop after the current frame
+    bool quit_ = false;
+
+    bool headless_ = false;
+    uint32_t headlessFrames_ = 0;
+    const char* pngPath_ = nullptr;
+    uint32_t lastImage_ = 0;
+
+    // CPU phases of drawFrame, the GPU time of every submit and of the benchmarked spline draw
+    FrameProfiler profiler;
+    const char* profilePath_ = nullptr;
+
+    const char* shaderDir_ = BSPLINE_SHADER_DIR;
+    const char* assetDir_ = BSPLINE_ASSET_DIR;
+
 };
 
 
@@ -2,14 +2,19 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 
-layout(binding = 0) uniform UniformBufferObject
+layout(set = 0, binding = 0) uniform ViewUniform
 {
-    mat4 model;
     mat4 view;
     mat4 proj;
 
 } ubo;
 
+layout(push_constant) uniform DrawParams
+{
+    mat4 model;
+
+} draw;
+
 layout(location = 0) in vec3 inPos;
 
 layout(location = 0) out vec3 outColor;
@@ -17,7 +22,7 @@ layout(location = 0) out vec3 outColor;
 void main()
 {
     gl_PointSize = 1.0;
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPos, 1.0);
+    gl_Position = ubo.proj * ubo.view * draw.model * vec4(inPos, 1.0);
     outColor = vec3(1.0, 1.0, 1.0); // bijela
 
 }
\ No newline at end of file
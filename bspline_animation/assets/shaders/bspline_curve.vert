@@ -0,0 +1,21 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Control points for the geometry and tessellation curve pipelines,
+// they stay in world space until the curve has been evaluated
+
+layout(push_constant) uniform DrawParams
+{
+    mat4 model;
+
+} draw;
+
+layout(location = 0) in vec3 inPos;
+
+layout(location = 0) out vec3 outColor;
+
+void main()
+{
+    gl_Position = draw.model * vec4(inPos, 1.0);
+    outColor = vec3(1.0, 1.0, 1.0);
+}
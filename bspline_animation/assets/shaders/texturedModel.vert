@@ -1,25 +1,40 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 0) uniform UniformBufferObject
+layout(set = 0, binding = 0) uniform ViewUniform
 {
-    mat4 model;
     mat4 view;
     mat4 proj;
 
 } ubo;
 
+layout(push_constant) uniform DrawParams
+{
+    // Includes the position dequantization of the mesh
+    mat4 model;
+    // Texture coordinate dequantization, xy + zw * inTexCoord
+    vec4 texCoordTransform;
+
+} draw;
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
+// Rows of the instance's placement on the path, see InstanceTransform
+layout(location = 3) in vec4 instanceRow0;
+layout(location = 4) in vec4 instanceRow1;
+layout(location = 5) in vec4 instanceRow2;
+
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
 void main() 
 {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    mat4 instance = transpose(mat4(instanceRow0, instanceRow1, instanceRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+
+    gl_Position = ubo.proj * ubo.view * instance * draw.model * vec4(inPosition, 1.0);
 
     fragColor = inColor;
-    fragTexCoord = inTexCoord;
+    fragTexCoord = draw.texCoordTransform.xy + draw.texCoordTransform.zw * inTexCoord;
 }
\ No newline at end of file
@@ -1,6 +1,13 @@
 #include "bspline.h"
+#include "parallel.h"
+#include "mapped_file.h"
+#include "path_parser.h"
 
 #include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/gtc/constants.hpp>
 
 BSpline BSpline::load(const char* pathFile, float tStep)
 {
@@ -9,45 +16,308 @@ BSpline BSpline::load(const char* pathFile, float tStep)
     return result;
 }
 
-glm::vec3 evalPoint(float t, int i, const std::vector<BSplineVertex>& points) noexcept
+size_t BSpline::samplesPerSegment() const noexcept
+{
+    return static_cast<size_t>(std::lround(1.0f / tStep_));
+}
+
+// 5 point Gauss-Legendre quadrature of |P'| over [t0, t1]
+static float speedIntegral(const SegmentCoeffs& c, float t0, float t1) noexcept
+{
+    static constexpr float nodes[5]   = {-0.9061798459f, -0.5384693101f, 0.f, 0.5384693101f, 0.9061798459f};
+    static constexpr float weights[5] = { 0.2369268851f,  0.4786286705f, 0.5688888889f, 0.4786286705f, 0.2369268851f};
+
+    const float half = 0.5f * (t1 - t0);
+    const float mid = 0.5f * (t1 + t0);
+
+    float sum = 0.f;
+    for(int k = 0; k < 5; ++k)
+    {
+        sum += weights[k] * glm::length(evalTangent(c, mid + half * nodes[k]));
+    }
+
+    return half * sum;
+}
+
+// Recomputes the arc length table of segments first..last
+static void refreshArcLength(BSpline& obj, size_t first, size_t last) noexcept
+{
+    constexpr int N = BSpline::ARC_SUBDIVISIONS;
+    constexpr float step = 1.f / N;
+
+    for(size_t i = first; i <= last; ++i)
+    {
+        const size_t base = (i - 1) * N;
+        for(int k = 0; k < N; ++k)
+        {
+            obj.arcLength[base + k + 1] = obj.arcLength[base + k] + speedIntegral(obj.coeffs[i - 1], k * step, (k + 1) * step);
+        }
+    }
+}
+
+size_t BSpline::segmentCount() const noexcept
+{
+    return points.size() > 3 ? points.size() - 3 : 0;
+}
+
+void BSpline::evaluate(int i, const float* t, size_t count, const SegmentSamples& out) const noexcept
+{
+    evalSegment(coeffs[i - 1], t, count, out);
+}
+
+void BSpline::updateCoefficients(size_t firstSegment) noexcept
+{
+    coeffs.resize(segmentCount());
+
+    for(size_t i = firstSegment; i <= coeffs.size(); ++i)
+    {
+        coeffs[i - 1] = segmentCoeffs(points[i - 1].pos, points[i].pos, points[i + 1].pos, points[i + 2].pos);
+    }
+}
+
+void BSpline::setControlPoint(size_t index, const glm::vec3& pos) noexcept
 {
-    glm::mat4x3 R{points[i - 1].pos, points[i].pos, points[i + 1].pos, points[i + 2].pos};
-    float t_2 = t*t;
-    glm::vec4 T{ t_2 * t, t_2, t, 1};
+    points[index].pos = pos;
 
-    return R * BSpline::B * T;
+    size_t first;
+    size_t last;
+    affectedSegments(index, first, last);
+
+    for(size_t i = first; i <= last; ++i)
+    {
+        coeffs[i - 1] = segmentCoeffs(points[i - 1].pos, points[i].pos, points[i + 1].pos, points[i + 2].pos);
+    }
+
+    if(!arcLength.empty() && first <= last)
+    {
+        // Segments after last keep their lengths, only the distance to where they start moves
+        const size_t end = last * ARC_SUBDIVISIONS;
+        const float oldEnd = arcLength[end];
+
+        refreshArcLength(*this, first, last);
+
+        const float delta = arcLength[end] - oldEnd;
+        for(size_t k = end + 1; k < arcLength.size(); ++k)
+        {
+            arcLength[k] += delta;
+        }
+    }
 }
  
-void BSpline::load(BSpline& obj, const char* pathFile)
+void BSpline::affectedSegments(size_t index, size_t& firstSegment, size_t& lastSegment) const noexcept
+{
+    // Segment i uses points i - 1 .. i + 2
+    firstSegment = index > 2 ? index - 2 : 1;
+    lastSegment = std::min(index + 1, segmentCount());
+}
+
+float TessellationSettings::tolerance() const noexcept
 {
-    FILE* f = fopen(pathFile, "r");
+    float tol = chordTolerance;
 
-    if(!f)
+    if(screenTolerance > 0.f && pixelsPerUnit > 0.f)
     {
-        fprintf(stderr, "Error while trying to open path file!");
-        abort();
+        const float screenTol = screenTolerance / pixelsPerUnit;
+        tol = tol > 0.f ? std::min(tol, screenTol) : screenTol;
     }
 
-    int read = 0;
-    do
+    return tol;
+}
+
+bool BSpline::isAdaptive() const noexcept
+{
+    return !segmentStart.empty();
+}
+
+// Appends parameters in [0, 1) that split the segment into spans whose chord deviates from
+// the curve by at most tol. For a cubic over a span of length h the deviation is bounded by
+// h^2 / 8 * max|P''|, and P'' is linear so its max is at one of the span ends.
+static void subdivideSegment(const SegmentCoeffs& c, float tol, int maxDepth, std::vector<float>& t)
+{
+    struct Span
     {
-        auto& point = obj.points.emplace_back();
-        read = fscanf(f, "%f %f %f\n", &point.pos.x, &point.pos.y, &point.pos.z);
-        
-    } while(read == 3 && !feof(f));
+        float t0;
+        float t1;
+        int depth;
+    };
 
+    Span stack[64];
+    int top = 0;
+    stack[top++] = {0.f, 1.f, 0};
 
-    for(size_t i = 1; i < obj.points.size() - 2; ++i)
+    while(top > 0)
     {
-        for(float t = 0.f; t <= 1.0f; t+=obj.tStep_)
+        const Span span = stack[--top];
+        const float h = span.t1 - span.t0;
+        const float maxDD = std::max(glm::length(evalBitangent(c, span.t0)), glm::length(evalBitangent(c, span.t1)));
+
+        if(span.depth >= maxDepth || h * h * maxDD <= 8.f * tol)
         {
-            auto& pathPoint = obj.path.emplace_back();
-            pathPoint = evalPoint(t, i, obj.points);
-            // printf("%f %f %f\n", pathPoint.x, pathPoint.y, pathPoint.z);
+            t.push_back(span.t0);
+            continue;
         }
+
+        const float mid = 0.5f * (span.t0 + span.t1);
+        stack[top++] = {mid, span.t1, span.depth + 1};
+        stack[top++] = {span.t0, mid, span.depth + 1};
+    }
+}
+
+// Segments handed to one worker task, fixed so the output never depends on the thread count
+static constexpr size_t SEGMENTS_PER_TASK = 16;
+
+// Evaluates count samples of segment i into dst, samples is per-task SoA scratch
+static void evaluateInto(const BSpline& obj, size_t i, const float* t, size_t count, glm::vec3* dst, std::vector<float>& samples)
+{
+    samples.resize(3 * count);
+
+    SegmentSamples out;
+    out.pos[0] = samples.data();
+    out.pos[1] = samples.data() + count;
+    out.pos[2] = samples.data() + 2 * count;
+
+    obj.evaluate(static_cast<int>(i), t, count, out);
+
+    for(size_t j = 0; j < count; ++j)
+    {
+        dst[j] = {out.pos[0][j], out.pos[1][j], out.pos[2][j]};
     }
+}
 
+static void tessellateUniform(BSpline& obj, size_t first)
+{
+    const size_t perSegment = obj.samplesPerSegment();
+    const size_t segments = obj.segmentCount();
 
+    std::vector<float> t(perSegment);
+    for(size_t j = 0; j < perSegment; ++j)
+    {
+        t[j] = j * obj.tStep_;
+    }
+
+    obj.segmentStart.clear();
+    obj.sampleT.clear();
+    obj.path.resize(segments * perSegment);
+
+    WorkerPool::shared().parallelFor(segments - first + 1, SEGMENTS_PER_TASK, [&](size_t begin, size_t end)
+    {
+        std::vector<float> samples;
+
+        for(size_t i = first + begin; i < first + end; ++i)
+        {
+            evaluateInto(obj, i, t.data(), perSegment, obj.path.data() + (i - 1) * perSegment, samples);
+        }
+    });
+}
+
+static void tessellateAdaptive(BSpline& obj, float tol, size_t first)
+{
+    WorkerPool& pool = WorkerPool::shared();
+
+    const size_t segments = obj.segmentCount();
+    const size_t count = segments - first + 1;
+    const int maxDepth = std::min(obj.tessellation.maxDepth, 60);
+
+    // Samples before segment first are kept, except the t = 1 endpoint that closed the old path
+    const uint32_t kept = first > 1 ? obj.segmentStart[first - 1] - 1 : 0;
+
+    // First pass subdivides every task's segments into its own list and
+    // leaves the sample count of each segment in segmentStart
+    std::vector<std::vector<float>> taskT((count + SEGMENTS_PER_TASK - 1) / SEGMENTS_PER_TASK);
+    obj.segmentStart.resize(segments + 1);
+    obj.segmentStart[segments] = 0;
+
+    pool.parallelFor(count, SEGMENTS_PER_TASK, [&](size_t begin, size_t end)
+    {
+        std::vector<float>& t = taskT[begin / SEGMENTS_PER_TASK];
+
+        for(size_t i = first + begin; i < first + end; ++i)
+        {
+            const size_t before = t.size();
+
+            subdivideSegment(obj.coeffs[i - 1], tol, maxDepth, t);
+            if(i == segments)
+            {
+                t.push_back(1.f);
+            }
+
+            obj.segmentStart[i - 1] = static_cast<uint32_t>(t.size() - before);
+        }
+    });
+
+    uint32_t offset = kept;
+    for(size_t i = first - 1; i <= segments; ++i)
+    {
+        const uint32_t samples = obj.segmentStart[i];
+        obj.segmentStart[i] = offset;
+        offset += samples;
+    }
+
+    obj.sampleT.resize(offset);
+    obj.path.resize(offset);
+
+    // Second pass places every task's samples at its final offset
+    pool.parallelFor(count, SEGMENTS_PER_TASK, [&](size_t begin, size_t end)
+    {
+        const std::vector<float>& t = taskT[begin / SEGMENTS_PER_TASK];
+        std::copy(t.begin(), t.end(), obj.sampleT.begin() + obj.segmentStart[first - 1 + begin]);
+
+        std::vector<float> samples;
+
+        for(size_t i = first + begin; i < first + end; ++i)
+        {
+            const size_t start = obj.segmentStart[i - 1];
+
+            evaluateInto(obj, i, obj.sampleT.data() + start, obj.segmentStart[i] - start, obj.path.data() + start, samples);
+        }
+    });
+}
+
+void BSpline::tessellate(size_t firstSegment) noexcept
+{
+    if(firstSegment > segmentCount())
+    {
+        return;
+    }
+
+    const float tol = tessellation.tolerance();
+
+    if(tol > 0.f)
+    {
+        tessellateAdaptive(*this, tol, firstSegment);
+    }
+    else
+    {
+        tessellateUniform(*this, firstSegment);
+    }
+}
+
+static void openPathFile(MappedFile& file, const char* pathFile)
+{
+    if(!file.open(pathFile))
+    {
+        fprintf(stderr, "Error while trying to open path file %s!\n", pathFile);
+        abort();
+    }
+}
+
+void BSpline::load(BSpline& obj, const char* pathFile)
+{
+    MappedFile file;
+    openPathFile(file, pathFile);
+
+    parse(obj, file.data(), file.end());
+}
+
+void BSpline::parse(BSpline& obj, const char* begin, const char* end)
+{
+    PathParser parser(begin, end);
+    parser.parse(obj.points);
+
+    obj.updateCoefficients();
+    obj.tessellate();
+    obj.buildArcLength();
+    obj.buildFrames();
 }
 
 // void BSpline::load(BSpline& obj, const char* pathFile)
@@ -70,34 +340,455 @@ void BSpline::load(BSpline& obj, const char* pathFile)
 
 // }
 
-size_t pointsInSegment(float tStep)
-{
-    return static_cast<size_t>(1.0f / tStep);
-}
-
 glm::vec3 BSpline::point(float t, int i) const noexcept
 {
+    if(isAdaptive())
+    {
+        const size_t begin = segmentStart[i - 1];
+        const size_t end = segmentStart[i];
+
+        // sampleT[begin] is always 0, so k never leaves the segment
+        const size_t k = std::upper_bound(sampleT.begin() + begin, sampleT.begin() + end, t) - sampleT.begin() - 1;
+        if(k + 1 >= path.size())
+        {
+            return path[k];
+        }
+
+        const float t0 = sampleT[k];
+        const float t1 = k + 1 < end ? sampleT[k + 1] : 1.f;
+
+        return glm::mix(path[k], path[k + 1], (t - t0) / (t1 - t0));
+    }
+
     // glm::mat4x3 R{points[i - 1], points[i], points[i + 1], points[i + 2]};
     // float t_2 = t*t;
     // glm::vec4 T{ t_2 * t, t_2, t, 1};
 
     // return R * B * T;
 
-    return path[(i - 1) * pointsInSegment(tStep_) + (t / tStep_)];
+    const size_t perSegment = samplesPerSegment();
+    const size_t sample = std::min(static_cast<size_t>(t / tStep_), perSegment - 1);
+    return path[(i - 1) * perSegment + sample];
+}
+
+glm::vec3 BSpline::position(float t, int i) const noexcept
+{
+    return evalPosition(coeffs[i - 1], t);
 }
 
 glm::vec3 BSpline::tangent(float t, int i) const noexcept
 {
-    glm::mat4x3 R{points[i - 1].pos, points[i].pos, points[i + 1].pos, points[i + 2].pos};
-    glm::vec3 d_T{t*t, t, 1};
-    return R * d_B * d_T;
+    return evalTangent(coeffs[i - 1], t);
 }
 
 glm::vec3 BSpline::bitangent(float t, int i) const noexcept
 {
-    glm::mat4x3 R{points[i - 1].pos, points[i].pos, points[i + 1].pos, points[i + 2].pos};
-    glm::vec2 dd_T{t, 1};
-    return R * dd_B * dd_T;
+    return evalBitangent(coeffs[i - 1], t);
+}
+
+float BSpline::curvature(float t, int i) const noexcept
+{
+    const glm::vec3 d1 = evalTangent(coeffs[i - 1], t);
+    const glm::vec3 d2 = evalBitangent(coeffs[i - 1], t);
+    const float speed = glm::length(d1);
+
+    return speed > 0.f ? glm::length(glm::cross(d1, d2)) / (speed * speed * speed) : 0.f;
+}
+
+// Index of the first path sample of segment i
+static size_t firstSample(const BSpline& obj, size_t i) noexcept
+{
+    return obj.isAdaptive() ? obj.segmentStart[i - 1] : (i - 1) * obj.samplesPerSegment();
+}
+
+// Parameter of path sample n, which belongs to segment i
+static float sampleParam(const BSpline& obj, size_t i, size_t n) noexcept
+{
+    return obj.isAdaptive() ? obj.sampleT[n] : (n - (i - 1) * obj.samplesPerSegment()) * obj.tStep_;
+}
+
+// Index of the path sample at or before t on segment i and the fraction of the way to the next one
+static size_t findSample(const BSpline& obj, float t, int i, float& frac) noexcept
+{
+    size_t k;
+    float t0;
+    float t1;
+
+    if(obj.isAdaptive())
+    {
+        const size_t begin = obj.segmentStart[i - 1];
+        const size_t end = obj.segmentStart[i];
+
+        k = std::upper_bound(obj.sampleT.begin() + begin, obj.sampleT.begin() + end, t) - obj.sampleT.begin() - 1;
+        t0 = obj.sampleT[k];
+        t1 = k + 1 < end ? obj.sampleT[k + 1] : 1.f;
+    }
+    else
+    {
+        const size_t perSegment = obj.samplesPerSegment();
+        const size_t j = std::min(static_cast<size_t>(t / obj.tStep_), perSegment - 1);
+
+        k = (i - 1) * perSegment + j;
+        t0 = j * obj.tStep_;
+        t1 = t0 + obj.tStep_;
+    }
+
+    frac = t1 > t0 ? glm::clamp((t - t0) / (t1 - t0), 0.f, 1.f) : 0.f;
+    return k;
+}
+
+// Rotation by angle about the tangent, which is the local x axis of a frame
+static glm::quat twistRotation(float angle) noexcept
+{
+    return glm::angleAxis(angle, glm::vec3(1.f, 0.f, 0.f));
+}
+
+// Angle of a rotation about the local x axis
+static float twistAngle(const glm::quat& q) noexcept
+{
+    return 2.f * std::atan2(q.x, q.w);
+}
+
+// Twist retessellate left on segment i, none before the first edit or for i = 0
+static float segmentTwist(const BSpline& obj, size_t i) noexcept
+{
+    return i - 1 < obj.frameTwist.size() ? obj.frameTwist[i - 1] : 0.f;
+}
+
+glm::quat BSpline::frame(float t, int i) const noexcept
+{
+    float frac;
+    const size_t k = findSample(*this, t, i, frac);
+
+    const float twist = segmentTwist(*this, i);
+    const glm::quat current = twist != 0.f ? frames[k] * twistRotation(twist) : frames[k];
+
+    if(k + 1 >= frames.size())
+    {
+        return current;
+    }
+
+    // The last sample of a segment blends into the first one of the next, which has its own twist
+    const size_t segment = static_cast<size_t>(i);
+    const float nextTwist = segment < segmentCount() && k + 1 == firstSample(*this, segment + 1) ? segmentTwist(*this, segment + 1) : twist;
+    const glm::quat next = nextTwist != 0.f ? frames[k + 1] * twistRotation(nextTwist) : frames[k + 1];
+
+    return glm::slerp(current, next, frac);
+}
+
+// Any unit vector perpendicular to tangent, the principal normal when the curve bends
+static glm::vec3 initialNormal(const glm::vec3& tangent, const glm::vec3& d2) noexcept
+{
+    glm::vec3 r = glm::cross(tangent, d2);
+    if(glm::dot(r, r) < 1e-12f)
+    {
+        const glm::vec3 axis = std::abs(tangent.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+        r = glm::cross(tangent, axis);
+    }
+
+    return glm::normalize(glm::cross(r, tangent));
+}
+
+static glm::quat frameQuat(const glm::vec3& tangent, const glm::vec3& normal) noexcept
+{
+    return glm::normalize(glm::quat_cast(glm::mat3(tangent, normal, glm::cross(tangent, normal))));
+}
+
+// Tangent direction at t, falls back to the previous one where the curve stops
+static glm::vec3 unitTangent(const SegmentCoeffs& c, float t, const glm::vec3& previous) noexcept
+{
+    const glm::vec3 d1 = evalTangent(c, t);
+    const float len = glm::length(d1);
+    return len > 0.f ? d1 / len : previous;
+}
+
+// Propagates frames over path samples [begin, end), starting from frames[begin - 1] or from a
+// new frame at the start of the path. Sample begin has to lie on segment firstSegment.
+static void propagateFrames(BSpline& obj, size_t firstSegment, size_t begin, size_t end) noexcept
+{
+    const size_t segments = obj.segmentCount();
+    const std::vector<glm::vec3>& path = obj.path;
+    std::vector<glm::quat>& frames = obj.frames;
+
+    size_t n = begin;
+
+    glm::vec3 x;
+    glm::vec3 tangent;
+    glm::vec3 normal;
+
+    if(0 == n)
+    {
+        x = path[0];
+        tangent = unitTangent(obj.coeffs[0], 0.f, glm::vec3(1.f, 0.f, 0.f));
+        normal = initialNormal(tangent, evalBitangent(obj.coeffs[0], 0.f));
+        frames[0] = frameQuat(tangent, normal);
+        ++n;
+    }
+    else
+    {
+        x = path[n - 1];
+        const glm::mat3 previous = glm::mat3_cast(frames[n - 1]);
+        tangent = previous[0];
+        normal = previous[1];
+    }
+
+    // Double reflection (Wang et al.): reflect the frame across the bisecting plane of the chord,
+    // then across the plane that takes the reflected tangent onto the next tangent
+    for(size_t i = firstSegment; i <= segments && n < end; ++i)
+    {
+        const size_t segmentEnd = std::min(i < segments ? firstSample(obj, i + 1) : path.size(), end);
+
+        for(; n < segmentEnd; ++n)
+        {
+            const glm::vec3 nextX = path[n];
+            const glm::vec3 nextTangent = unitTangent(obj.coeffs[i - 1], sampleParam(obj, i, n), tangent);
+
+            const glm::vec3 v1 = nextX - x;
+            const float c1 = glm::dot(v1, v1);
+
+            glm::vec3 rL = normal;
+            glm::vec3 tL = tangent;
+            if(c1 > 0.f)
+            {
+                rL -= (2.f / c1) * glm::dot(v1, normal) * v1;
+                tL -= (2.f / c1) * glm::dot(v1, tangent) * v1;
+            }
+
+            const glm::vec3 v2 = nextTangent - tL;
+            const float c2 = glm::dot(v2, v2);
+
+            glm::vec3 r = c2 > 0.f ? rL - (2.f / c2) * glm::dot(v2, rL) * v2 : rL;
+
+            // Keeps rounding from slowly tilting the frame off the tangent
+            r = glm::normalize(r - glm::dot(r, nextTangent) * nextTangent);
+
+            frames[n] = frameQuat(nextTangent, r);
+
+            x = nextX;
+            tangent = nextTangent;
+            normal = r;
+        }
+    }
+}
+
+void BSpline::buildFrames(size_t firstSegment) noexcept
+{
+    frames.resize(path.size());
+
+    if(firstSegment > segmentCount() || path.empty())
+    {
+        return;
+    }
+
+    propagateFrames(*this, firstSegment, firstSample(*this, firstSegment), path.size());
+
+    // The new frames continue the stored ones before firstSegment, so they share their twist
+    if(!frameTwist.empty())
+    {
+        frameTwist.resize(segmentCount(), 0.f);
+        std::fill(frameTwist.begin() + (firstSegment - 1), frameTwist.end(), segmentTwist(*this, firstSegment - 1));
+    }
+}
+
+// Sample parameters of segments first..last in adaptive layout, starts[k] is the index in t
+// where segment first + k begins
+static void subdivideRange(const BSpline& obj, size_t first, size_t last, std::vector<float>& t, std::vector<uint32_t>& starts)
+{
+    const float tol = obj.tessellation.tolerance();
+    const int maxDepth = std::min(obj.tessellation.maxDepth, 60);
+
+    for(size_t i = first; i <= last; ++i)
+    {
+        starts.push_back(static_cast<uint32_t>(t.size()));
+        subdivideSegment(obj.coeffs[i - 1], tol, maxDepth, t);
+    }
+
+    if(last == obj.segmentCount())
+    {
+        t.push_back(1.f);
+    }
+}
+
+BSpline::PathRange BSpline::retessellate(size_t firstSegment, size_t lastSegment) noexcept
+{
+    lastSegment = std::min(lastSegment, segmentCount());
+    if(firstSegment > lastSegment || path.empty())
+    {
+        return {0, 0, false};
+    }
+
+    PathRange range{firstSample(*this, firstSegment),
+                     lastSegment < segmentCount() ? firstSample(*this, lastSegment + 1) : path.size(),
+                     false};
+
+    std::vector<float> samples;
+
+    if(isAdaptive())
+    {
+        std::vector<float> t;
+        std::vector<uint32_t> starts;
+        subdivideRange(*this, firstSegment, lastSegment, t, starts);
+
+        const size_t oldCount = range.end - range.begin;
+
+        // A different sample count shifts everything after the range
+        if(t.size() != oldCount)
+        {
+            const ptrdiff_t delta = static_cast<ptrdiff_t>(t.size()) - static_cast<ptrdiff_t>(oldCount);
+
+            path.erase(path.begin() + range.begin, path.begin() + range.end);
+            path.insert(path.begin() + range.begin, t.size(), glm::vec3(0.f));
+            sampleT.erase(sampleT.begin() + range.begin, sampleT.begin() + range.end);
+            sampleT.insert(sampleT.begin() + range.begin, t.size(), 0.f);
+            frames.erase(frames.begin() + range.begin, frames.begin() + range.end);
+            frames.insert(frames.begin() + range.begin, t.size(), glm::quat(1.f, 0.f, 0.f, 0.f));
+
+            for(size_t i = lastSegment; i < segmentStart.size(); ++i)
+            {
+                segmentStart[i] = static_cast<uint32_t>(segmentStart[i] + delta);
+            }
+
+            range.resized = true;
+        }
+
+        for(size_t i = firstSegment; i <= lastSegment; ++i)
+        {
+            segmentStart[i - 1] = static_cast<uint32_t>(range.begin + starts[i - firstSegment]);
+        }
+
+        std::copy(t.begin(), t.end(), sampleT.begin() + range.begin);
+
+        for(size_t i = firstSegment; i <= lastSegment; ++i)
+        {
+            const size_t start = segmentStart[i - 1];
+            const size_t end = i < segmentCount() ? segmentStart[i] : path.size();
+
+            evaluateInto(*this, i, sampleT.data() + start, end - start, path.data() + start, samples);
+        }
+    }
+    else
+    {
+        const size_t perSegment = samplesPerSegment();
+
+        std::vector<float> t(perSegment);
+        for(size_t j = 0; j < perSegment; ++j)
+        {
+            t[j] = j * tStep_;
+        }
+
+        for(size_t i = firstSegment; i <= lastSegment; ++i)
+        {
+            evaluateInto(*this, i, t.data(), perSegment, path.data() + (i - 1) * perSegment, samples);
+        }
+    }
+
+    const size_t rangeEnd = lastSegment < segmentCount() ? firstSample(*this, lastSegment + 1) : path.size();
+
+    if(frames.size() == path.size())
+    {
+        frameTwist.resize(segmentCount(), 0.f);
+
+        // Frames of the range continue the stored frame before it, so they get its twist
+        const float base = segmentTwist(*this, firstSegment - 1);
+        std::fill(frameTwist.begin() + (firstSegment - 1), frameTwist.begin() + lastSegment, base);
+
+        if(rangeEnd < path.size())
+        {
+            // Downstream the curve is unchanged, so its frames only differ from the old ones by
+            // the rotation about the tangent that the first frame after the range gets. That goes
+            // into the twist of the later segments, their stored frames are left alone.
+            const glm::quat old = frames[rangeEnd];
+            propagateFrames(*this, firstSegment, range.begin, rangeEnd + 1);
+
+            const float delta = twistAngle(glm::normalize(glm::inverse(old) * frames[rangeEnd])) + base - frameTwist[lastSegment];
+            frames[rangeEnd] = old;
+
+            for(size_t j = lastSegment; j < frameTwist.size(); ++j)
+            {
+                frameTwist[j] = std::remainder(frameTwist[j] + delta, glm::two_pi<float>());
+            }
+        }
+        else
+        {
+            propagateFrames(*this, firstSegment, range.begin, rangeEnd);
+        }
+    }
+
+    range.end = range.resized ? path.size() : rangeEnd;
+    return range;
+}
+
+void BSpline::segmentSamples(size_t i, size_t& begin, size_t& end) const noexcept
+{
+    // Neither depends on path, which is still empty while it is mapped from the cache
+    if(isAdaptive())
+    {
+        begin = segmentStart[i - 1];
+        end = segmentStart[i];
+    }
+    else
+    {
+        begin = (i - 1) * samplesPerSegment();
+        end = i * samplesPerSegment();
+    }
+}
+
+void BSpline::buildArcLength(size_t firstSegment) noexcept
+{
+    arcLength.resize(segmentCount() * ARC_SUBDIVISIONS + 1, 0.f);
+    arcLength[0] = 0.f;
+    refreshArcLength(*this, firstSegment, segmentCount());
+}
+
+float BSpline::length() const noexcept
+{
+    return arcLength.empty() ? 0.f : arcLength.back();
+}
+
+size_t BSpline::locate(float s, int& segment, float& t, size_t hint) const noexcept
+{
+    // No segments (fewer than 4 control points or a failed load), the start of the first one
+    if(arcLength.size() < 2)
+    {
+        segment = 1;
+        t = 0.f;
+        return 0;
+    }
+
+    const size_t intervals = arcLength.size() - 1;
+    s = glm::clamp(s, 0.f, length());
+
+    size_t k = hint < intervals ? hint : 0;
+    if(s < arcLength[k] || s > arcLength[k + 1])
+    {
+        if(k + 1 < intervals && s >= arcLength[k + 1] && s <= arcLength[k + 2])
+        {
+            ++k;
+        }
+        else
+        {
+            k = std::upper_bound(arcLength.begin(), arcLength.end(), s) - arcLength.begin();
+            k = std::min(k > 0 ? k - 1 : 0, intervals - 1);
+        }
+    }
+
+    constexpr float step = 1.f / ARC_SUBDIVISIONS;
+    const SegmentCoeffs& c = coeffs[k / ARC_SUBDIVISIONS];
+    const float t0 = (k % ARC_SUBDIVISIONS) * step;
+    const float interval = arcLength[k + 1] - arcLength[k];
+
+    t = interval > 0.f ? t0 + step * (s - arcLength[k]) / interval : t0;
+
+    // Speed is close to constant inside an interval, one Newton step fixes what linear interpolation misses
+    const float speed = glm::length(evalTangent(c, t));
+    if(speed > 0.f)
+    {
+        t -= (arcLength[k] + speedIntegral(c, t0, t) - s) / speed;
+        t = glm::clamp(t, t0, t0 + step);
+    }
+
+    segment = static_cast<int>(k / ARC_SUBDIVISIONS) + 1;
+    return k;
 }
 
 BSpline::Animation BSpline::animate() const noexcept
@@ -129,6 +820,48 @@ BSpline::Animation::AnimationTuple BSpline::Animation::update() noexcept
     pos    = spline_->point(t, segment);
     tang   = spline_->tangent(t, segment);
     bitang = spline_->bitangent(t, segment); 
+    orient = spline_->frame(t, segment);
 
     return {pos, tang, bitang};
+}
+
+BSpline::Animation::AnimationTuple BSpline::Animation::advance(float distance) noexcept
+{
+    const float total = spline_->length();
+    float next = s + distance;
+
+    if(total > 0.f)
+    {
+        next = std::fmod(next, total);
+        if(next < 0.f)
+        {
+            next += total;
+        }
+    }
+
+    return seek(next);
+}
+
+BSpline::Animation::AnimationTuple BSpline::Animation::seek(float distance) noexcept
+{
+    s = distance;
+    arcIndex_ = spline_->locate(s, segment, t, arcIndex_);
+
+    // Nothing to evaluate without segments, the last pose stays
+    if(spline_->coeffs.empty())
+    {
+        return {pos, tang, bitang};
+    }
+
+    pos    = spline_->position(t, segment);
+    tang   = spline_->tangent(t, segment);
+    bitang = spline_->bitangent(t, segment);
+    orient = spline_->frame(t, segment);
+
+    return {pos, tang, bitang};
+}
+
+const glm::quat& BSpline::Animation::orientation() const noexcept
+{
+    return orient;
 }
\ No newline at end of file
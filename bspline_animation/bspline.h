@@ -4,10 +4,14 @@
 #include <vector>
 #include <array>
 #include <tuple>
+#include <cstdint>
 
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <vulkan/vulkan.h>
 
+#include "bspline_eval.h"
+
 
 struct BSplineVertex
 {
@@ -34,6 +38,22 @@ struct BSplineVertex
     }
 };
 
+struct TessellationSettings
+{
+    // Max distance between the curve and the chords of the tessellated path,
+    // 0 samples every segment uniformly with tStep_
+    float chordTolerance{0.f};
+
+    // Optional tolerance in pixels, converted to world units with pixelsPerUnit
+    // (projected size of one world unit at the distance the path is viewed from)
+    float screenTolerance{0.f};
+    float pixelsPerUnit{0.f};
+
+    int maxDepth{16};
+
+    float tolerance() const noexcept;
+};
+
 struct BSpline
 {
     BSpline(float tStep = 0.0005f) noexcept : tStep_(tStep) {}
@@ -65,10 +85,74 @@ struct BSpline
 
     glm::vec3 bitangent(float t, int i) const noexcept;
 
+    // Exact position on segment i, unlike point() which reads the tessellated path
+    glm::vec3 position(float t, int i) const noexcept;
+
+    float curvature(float t, int i) const noexcept;
+
+    // Rotation minimizing frame on segment i, slerped between the two nearest path samples.
+    // Rotates x onto the tangent, y and z onto the normal and binormal.
+    glm::quat frame(float t, int i) const noexcept;
+
+    // Batch evaluation of segment i for count values of t, results are written as SoA
+    void evaluate(int i, const float* t, size_t count, const SegmentSamples& out) const noexcept;
+
+    // Moves a control point and refreshes the coefficients of the (at most 4) segments it affects
+    void setControlPoint(size_t index, const glm::vec3& pos) noexcept;
+
+    // Segments that use control point index, empty (first > last) when there are none
+    void affectedSegments(size_t index, size_t& firstSegment, size_t& lastSegment) const noexcept;
+
+    // Samples [begin, end) of path rewritten by retessellate. When resized is set the samples
+    // after the range moved as well and end is path.size().
+    struct PathRange
+    {
+        size_t begin;
+        size_t end;
+        bool resized;
+    };
+
+    // Rebuilds path, sampleT and frames of segments firstSegment..lastSegment only, for
+    // edits after setControlPoint. Frames after the range keep their values apart from a
+    // constant twist about the tangent, which goes into frameTwist instead of the frames.
+    PathRange retessellate(size_t firstSegment, size_t lastSegment) noexcept;
+
+    // Path samples [begin, end) of segment i, an adaptive last segment includes its t = 1 endpoint
+    void segmentSamples(size_t i, size_t& begin, size_t& end) const noexcept;
+
+    // Recomputes coeffs of segments firstSegment..segmentCount()
+    void updateCoefficients(size_t firstSegment = 1) noexcept;
+
+    // Rebuilds path from coeffs, uniformly or adaptively depending on tessellation.
+    // Segments before firstSegment keep their samples, so appended points only add new ones.
+    void tessellate(size_t firstSegment = 1) noexcept;
+
+    bool isAdaptive() const noexcept;
+
+    // Integrates |P'| over segments firstSegment..segmentCount() into arcLength
+    void buildArcLength(size_t firstSegment = 1) noexcept;
+
+    float length() const noexcept;
+
+    // Propagates rotation minimizing frames along path from the first sample of firstSegment,
+    // earlier frames are kept so this has to follow tessellate(firstSegment)
+    void buildFrames(size_t firstSegment = 1) noexcept;
+
+    // Finds segment and t at distance s along the path. Search starts at table index hint,
+    // returns the index it ended on so consecutive lookups stay O(1).
+    size_t locate(float s, int& segment, float& t, size_t hint = 0) const noexcept;
+
+    size_t samplesPerSegment() const noexcept;
+
+    size_t segmentCount() const noexcept;
+
     static BSpline load(const char* pathFile, float tStep);
 
     static void load(BSpline& obj, const char* pathFile);
 
+    // Same as load for a path file that is already in memory
+    static void parse(BSpline& obj, const char* begin, const char* end);
+
     struct Animation
     {
         constexpr Animation(const BSpline* spline = nullptr) noexcept : spline_(spline) {}
@@ -77,22 +161,56 @@ struct BSpline
 
         AnimationTuple update() noexcept;
 
+        // Moves by distance along the path at constant speed, wraps around at the end
+        AnimationTuple advance(float distance) noexcept;
+
+        AnimationTuple seek(float distance) noexcept;
+
+        // Frame at the current position, refreshed by update, advance and seek
+        const glm::quat& orientation() const noexcept;
+
         void setSpline(const BSpline* spline) noexcept;
 
         float t = 0.f;
         int segment = 1;
+        float s = 0.f;
         const BSpline* spline_;
 
     private:
+        size_t arcIndex_ = 0;
+
         glm::vec3 pos{0.f, 0.f, 0.f};
         glm::vec3 tang{0.f, 0.f, 0.f};
         glm::vec3 bitang{0.f, 0.f, 0.f};
+        glm::quat orient{1.f, 0.f, 0.f, 0.f};
     };
 
     Animation animate() const noexcept;
 
     std::vector<glm::vec3> path;
     std::vector<BSplineVertex> points;
+    // Power basis coefficients, coeffs[i - 1] belongs to segment i
+    std::vector<SegmentCoeffs> coeffs;
+
+    // Adaptive path index, empty for uniform tessellation. Samples of segment i are
+    // path[segmentStart[i - 1]] .. path[segmentStart[i] - 1], sampleT holds their parameter.
+    // The last segment also gets its t = 1 endpoint.
+    std::vector<uint32_t> segmentStart;
+    std::vector<float> sampleT;
+
+    // Distance from the start of the path to t = k / ARC_SUBDIVISIONS on segment i
+    // is arcLength[(i - 1) * ARC_SUBDIVISIONS + k]
+    static constexpr int ARC_SUBDIVISIONS = 16;
+    std::vector<float> arcLength;
+
+    // Rotation minimizing frame of every path sample, built by double reflection
+    std::vector<glm::quat> frames;
+
+    // Rotation about the tangent that frame() applies to the frames of segment i, frameTwist[i - 1].
+    // Empty until retessellate needs it, so freshly built or cached frames are used as they are.
+    std::vector<float> frameTwist;
+
+    TessellationSettings tessellation;
     float tStep_;
 };
 
@@ -0,0 +1,341 @@
+// Headless CPU benchmarks of the spline and model loading hot paths.
+// Prints one JSON document with ns/op and throughput of every case.
+//
+// bspline_bench [--out file.json] [--max-points N] [--assets dir]
+
+#include "bspline.h"
+#include "vertex.h"
+#include "models.h"
+#include "mesh_optimizer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifndef BSPLINE_BENCH_ASSETS
+#define BSPLINE_BENCH_ASSETS "assets/models"
+#endif
+
+#ifndef BSPLINE_BENCH_VERSION
+#define BSPLINE_BENCH_VERSION "unknown"
+#endif
+
+// Every case runs batches until both limits are reached and reports its fastest batch
+static constexpr double MIN_SECONDS = 0.25;
+static constexpr int MIN_BATCHES = 3;
+
+// Synthetic paths are tessellated uniformly with this many samples per segment, the
+// app default (2000) would need tens of GB for a million control points
+static constexpr float LOAD_T_STEP = 1.f / 16.f;
+
+// Spline and queries used by the evaluation cases
+static constexpr size_t EVAL_POINTS = 1000;
+static constexpr size_t EVAL_QUERIES = 4096;
+static constexpr size_t EVAL_CALLS = 1 << 20;
+static constexpr size_t ANIMATION_UPDATES = 1 << 20;
+
+struct Param
+{
+    const char* name;
+    double value;
+};
+
+struct Result
+{
+    std::string name;
+    std::vector<Param> params;
+    // What one op is, e.g. "point" for BSpline::load
+    const char* unit;
+    uint64_t opsPerBatch;
+    int batches;
+    double bestSeconds;
+    double totalSeconds;
+};
+
+// Results are written somewhere the optimizer cannot see through
+static volatile float sink;
+
+static void consume(const glm::vec3& v) noexcept
+{
+    sink = sink + v.x + v.y + v.z;
+}
+
+// fn runs one batch of opsPerBatch ops
+template<typename Fn>
+static Result measure(std::string name, std::vector<Param> params, const char* unit, uint64_t opsPerBatch, Fn&& fn)
+{
+    using Clock = std::chrono::steady_clock;
+
+    Result result{std::move(name), std::move(params), unit, opsPerBatch, 0, 0.0, 0.0};
+
+    while(result.batches < MIN_BATCHES || result.totalSeconds < MIN_SECONDS)
+    {
+        const auto start = Clock::now();
+        fn();
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        result.bestSeconds = 0 == result.batches ? seconds : std::min(result.bestSeconds, seconds);
+        result.totalSeconds += seconds;
+        ++result.batches;
+    }
+
+    fprintf(stderr, "%-24s %12.2f ns/%s\n",
+            result.name.c_str(), result.bestSeconds * 1e9 / result.opsPerBatch, result.unit);
+
+    return result;
+}
+
+// Smooth random walk, every step turns a little from the previous direction
+static void writeSyntheticPath(const char* file, size_t count)
+{
+    FILE* f = fopen(file, "w");
+    if(!f)
+    {
+        fprintf(stderr, "Error while trying to write the synthetic path %s\n", file);
+        abort();
+    }
+
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> turn(-0.5f, 0.5f);
+
+    glm::vec3 pos(0.f);
+    glm::vec3 dir(1.f, 0.f, 0.f);
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        fprintf(f, "%g %g %g\n", pos.x, pos.y, pos.z);
+
+        dir = glm::normalize(dir + glm::vec3(turn(rng), turn(rng), turn(rng)));
+        pos += 10.f * dir;
+    }
+
+    fclose(f);
+}
+
+static void benchLoad(size_t maxPoints, std::vector<Result>& results)
+{
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "bspline_bench_path.txt";
+
+    for(size_t count = 100; count <= maxPoints; count *= 10)
+    {
+        writeSyntheticPath(file.string().c_str(), count);
+
+        results.push_back(measure("BSpline::load",
+                                  {{"points", double(count)}, {"samples_per_segment", 1.0 / LOAD_T_STEP}},
+                                  "point",
+                                  count,
+                                  [&]
+        {
+            BSpline spline(LOAD_T_STEP);
+            BSpline::load(spline, file.string().c_str());
+            consume(spline.path.back());
+        }));
+    }
+
+    std::filesystem::remove(file);
+}
+
+static void benchEvaluation(std::vector<Result>& results)
+{
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "bspline_bench_eval.txt";
+    writeSyntheticPath(file.string().c_str(), EVAL_POINTS);
+
+    BSpline spline;
+    BSpline::load(spline, file.string().c_str());
+    std::filesystem::remove(file);
+
+    struct Query
+    {
+        float t;
+        int segment;
+    };
+
+    // Random order so the uniform path lookups of point() are not all cache hits
+    std::mt19937 rng(54321);
+    std::uniform_real_distribution<float> tDist(0.f, 1.f);
+    std::uniform_int_distribution<int> segmentDist(1, static_cast<int>(spline.segmentCount()));
+
+    std::vector<Query> queries(EVAL_QUERIES);
+    for(Query& q : queries)
+    {
+        q = {tDist(rng), segmentDist(rng)};
+    }
+
+    const std::vector<Param> params = {{"points", double(EVAL_POINTS)}};
+
+    auto evalCase = [&](const char* name, glm::vec3 (BSpline::*fn)(float, int) const noexcept)
+    {
+        results.push_back(measure(name, params, "call", EVAL_CALLS, [&]
+        {
+            glm::vec3 sum(0.f);
+            for(size_t k = 0; k < EVAL_CALLS; ++k)
+            {
+                const Query& q = queries[k % EVAL_QUERIES];
+                sum += (spline.*fn)(q.t, q.segment);
+            }
+            consume(sum);
+        }));
+    };
+
+    evalCase("BSpline::point", &BSpline::point);
+    evalCase("BSpline::tangent", &BSpline::tangent);
+    evalCase("BSpline::bitangent", &BSpline::bitangent);
+
+    BSpline::Animation animation = spline.animate();
+
+    results.push_back(measure("Animation::update", params, "update", ANIMATION_UPDATES, [&]
+    {
+        glm::vec3 sum(0.f);
+        for(size_t k = 0; k < ANIMATION_UPDATES; ++k)
+        {
+            sum += std::get<0>(animation.update());
+        }
+        consume(sum);
+    }));
+}
+
+static void benchMesh(const std::string& assets, std::vector<Result>& results)
+{
+    static constexpr const char* MODELS[] = {"f16.obj", "aircraft747.obj"};
+
+    for(const char* name : MODELS)
+    {
+        const std::string path = assets + "/" + name;
+
+        Model model;
+        loadModel(path.c_str(), model);
+
+        uint64_t corners = 0;
+        for(const auto& shape : model.shapes)
+        {
+            corners += shape.mesh.indices.size();
+        }
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+
+        // Starts from empty buffers every batch like App::loadModels
+        Result result = measure(std::string("buildMesh/") + name, {}, "index", corners, [&]
+        {
+            std::vector<Vertex>().swap(vertices);
+            std::vector<uint32_t>().swap(indices);
+            buildMesh(model, vertices, indices);
+        });
+
+        result.params = {{"indices", double(indices.size())}, {"vertices", double(vertices.size())}};
+        results.push_back(std::move(result));
+
+        // Every batch starts from the welded mesh in OBJ order
+        const std::vector<Vertex> weldedVertices = vertices;
+        const std::vector<uint32_t> weldedIndices = indices;
+        MeshOptimizationStats stats{};
+
+        result = measure(std::string("optimizeMesh/") + name, {}, "index", corners, [&]
+        {
+            vertices = weldedVertices;
+            indices = weldedIndices;
+            stats = optimizeMesh(vertices, indices);
+        });
+
+        result.params = {{"acmr_before", stats.before.acmr}, {"acmr_after", stats.after.acmr},
+                         {"atvr_before", stats.before.atvr}, {"atvr_after", stats.after.atvr}};
+        results.push_back(std::move(result));
+
+        // Bounds and upload layout of the optimized mesh like App::loadModels
+        std::vector<GpuVertex> packed;
+
+        result = measure(std::string("packVertices/") + name, {}, "vertex", vertices.size(), [&]
+        {
+            packVertices(vertices, vertexBounds(vertices), packed);
+        });
+
+        result.params = {{"bytes_before", double(sizeof(Vertex) * vertices.size())},
+                         {"bytes_after", double(sizeof(GpuVertex) * packed.size())}};
+        results.push_back(std::move(result));
+    }
+}
+
+static void writeJson(FILE* f, const std::vector<Result>& results)
+{
+    fprintf(f, "{\n");
+    fprintf(f, "  \"benchmark\": \"bspline_bench\",\n");
+    fprintf(f, "  \"version\": \"%s\",\n", BSPLINE_BENCH_VERSION);
+    fprintf(f, "  \"results\": [\n");
+
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        const double nsPerOp = r.bestSeconds * 1e9 / r.opsPerBatch;
+
+        fprintf(f, "    {\"name\": \"%s\", \"params\": {", r.name.c_str());
+        for(size_t p = 0; p < r.params.size(); ++p)
+        {
+            fprintf(f, "%s\"%s\": %.17g", p ? ", " : "", r.params[p].name, r.params[p].value);
+        }
+        fprintf(f, "}, \"unit\": \"%s\", \"ops_per_batch\": %llu, \"batches\": %d, ",
+                r.unit, static_cast<unsigned long long>(r.opsPerBatch), r.batches);
+        fprintf(f, "\"ns_per_op\": %.3f, \"mean_ns_per_op\": %.3f, \"ops_per_second\": %.1f}%s\n",
+                nsPerOp,
+                r.totalSeconds * 1e9 / (double(r.opsPerBatch) * r.batches),
+                r.opsPerBatch / r.bestSeconds,
+                i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* out = nullptr;
+    size_t maxPoints = 1000000;
+    std::string assets = BSPLINE_BENCH_ASSETS;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(0 == strcmp(argv[i], "--out") && i + 1 < argc)
+        {
+            out = argv[++i];
+        }
+        else if(0 == strcmp(argv[i], "--max-points") && i + 1 < argc)
+        {
+            maxPoints = strtoull(argv[++i], nullptr, 10);
+        }
+        else if(0 == strcmp(argv[i], "--assets") && i + 1 < argc)
+        {
+            assets = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--out file.json] [--max-points N] [--assets dir]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+
+    benchLoad(maxPoints, results);
+    benchEvaluation(results);
+    benchMesh(assets, results);
+
+    FILE* f = out ? fopen(out, "w") : stdout;
+    if(!f)
+    {
+        fprintf(stderr, "Error while trying to open %s\n", out);
+        return 1;
+    }
+
+    writeJson(f, results);
+
+    if(out)
+    {
+        fclose(f);
+    }
+
+    return 0;
+}
@@ -0,0 +1,240 @@
+#include "bspline_eval.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #include <immintrin.h>
+    #define EVAL_SSE 1
+    #define EVAL_AVX2 1
+    #define EVAL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#elif defined(_M_X64)
+    #include <immintrin.h>
+    #define EVAL_SSE 1
+    #if defined(__AVX2__)
+        #define EVAL_AVX2 1
+    #endif
+    #define EVAL_TARGET_AVX2
+#endif
+
+
+SegmentCoeffs segmentCoeffs(const glm::vec3& p0,
+                            const glm::vec3& p1,
+                            const glm::vec3& p2,
+                            const glm::vec3& p3) noexcept
+{
+    SegmentCoeffs coeffs;
+    coeffs.a = (-p0 + 3.f * p1 - 3.f * p2 + p3) / 6.f;
+    coeffs.b = (p0 - 2.f * p1 + p2) / 2.f;
+    coeffs.c = (p2 - p0) / 2.f;
+    coeffs.d = (p0 + 4.f * p1 + p2) / 6.f;
+    return coeffs;
+}
+
+namespace
+{
+
+// Per axis coefficients of P, P' and P''
+struct AxisCoeffs
+{
+    float a, b, c, d;
+    float a3, b2;
+    float a6;
+};
+
+void axisCoeffs(const SegmentCoeffs& coeffs, AxisCoeffs (&axes)[3]) noexcept
+{
+    for(int k = 0; k < 3; ++k)
+    {
+        axes[k].a  = coeffs.a[k];
+        axes[k].b  = coeffs.b[k];
+        axes[k].c  = coeffs.c[k];
+        axes[k].d  = coeffs.d[k];
+        axes[k].a3 = 3.f * coeffs.a[k];
+        axes[k].b2 = 2.f * coeffs.b[k];
+        axes[k].a6 = 6.f * coeffs.a[k];
+    }
+}
+
+void evalScalar(const AxisCoeffs (&axes)[3], const float* t, size_t begin, size_t end, const SegmentSamples& out) noexcept
+{
+    for(int k = 0; k < 3; ++k)
+    {
+        const AxisCoeffs& c = axes[k];
+
+        if(out.pos[k])
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                out.pos[k][i] = ((c.a * t[i] + c.b) * t[i] + c.c) * t[i] + c.d;
+            }
+        }
+
+        if(out.tang[k])
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                out.tang[k][i] = (c.a3 * t[i] + c.b2) * t[i] + c.c;
+            }
+        }
+
+        if(out.bitang[k])
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                out.bitang[k][i] = c.a6 * t[i] + c.b2;
+            }
+        }
+    }
+}
+
+#if EVAL_SSE
+
+size_t evalSSE(const AxisCoeffs (&axes)[3], const float* t, size_t count, const SegmentSamples& out) noexcept
+{
+    const size_t n = count & ~size_t(3);
+
+    for(int k = 0; k < 3; ++k)
+    {
+        const AxisCoeffs& c = axes[k];
+        const __m128 a  = _mm_set1_ps(c.a);
+        const __m128 b  = _mm_set1_ps(c.b);
+        const __m128 cc = _mm_set1_ps(c.c);
+        const __m128 d  = _mm_set1_ps(c.d);
+        const __m128 a3 = _mm_set1_ps(c.a3);
+        const __m128 b2 = _mm_set1_ps(c.b2);
+        const __m128 a6 = _mm_set1_ps(c.a6);
+
+        for(size_t i = 0; i < n; i += 4)
+        {
+            const __m128 T = _mm_loadu_ps(t + i);
+
+            if(out.pos[k])
+            {
+                __m128 p = _mm_add_ps(_mm_mul_ps(a, T), b);
+                p = _mm_add_ps(_mm_mul_ps(p, T), cc);
+                p = _mm_add_ps(_mm_mul_ps(p, T), d);
+                _mm_storeu_ps(out.pos[k] + i, p);
+            }
+
+            if(out.tang[k])
+            {
+                __m128 v = _mm_add_ps(_mm_mul_ps(a3, T), b2);
+                v = _mm_add_ps(_mm_mul_ps(v, T), cc);
+                _mm_storeu_ps(out.tang[k] + i, v);
+            }
+
+            if(out.bitang[k])
+            {
+                _mm_storeu_ps(out.bitang[k] + i, _mm_add_ps(_mm_mul_ps(a6, T), b2));
+            }
+        }
+    }
+
+    return n;
+}
+
+#endif
+
+#if EVAL_AVX2
+
+EVAL_TARGET_AVX2
+size_t evalAVX2(const AxisCoeffs (&axes)[3], const float* t, size_t count, const SegmentSamples& out) noexcept
+{
+    const size_t n = count & ~size_t(7);
+
+    for(int k = 0; k < 3; ++k)
+    {
+        const AxisCoeffs& c = axes[k];
+        const __m256 a  = _mm256_set1_ps(c.a);
+        const __m256 b  = _mm256_set1_ps(c.b);
+        const __m256 cc = _mm256_set1_ps(c.c);
+        const __m256 d  = _mm256_set1_ps(c.d);
+        const __m256 a3 = _mm256_set1_ps(c.a3);
+        const __m256 b2 = _mm256_set1_ps(c.b2);
+        const __m256 a6 = _mm256_set1_ps(c.a6);
+
+        for(size_t i = 0; i < n; i += 8)
+        {
+            const __m256 T = _mm256_loadu_ps(t + i);
+
+            if(out.pos[k])
+            {
+                __m256 p = _mm256_fmadd_ps(a, T, b);
+                p = _mm256_fmadd_ps(p, T, cc);
+                p = _mm256_fmadd_ps(p, T, d);
+                _mm256_storeu_ps(out.pos[k] + i, p);
+            }
+
+            if(out.tang[k])
+            {
+                __m256 v = _mm256_fmadd_ps(a3, T, b2);
+                v = _mm256_fmadd_ps(v, T, cc);
+                _mm256_storeu_ps(out.tang[k] + i, v);
+            }
+
+            if(out.bitang[k])
+            {
+                _mm256_storeu_ps(out.bitang[k] + i, _mm256_fmadd_ps(a6, T, b2));
+            }
+        }
+    }
+
+    return n;
+}
+
+#endif
+
+} // namespace
+
+
+bool hasAVX2() noexcept
+{
+#if EVAL_AVX2 && defined(__GNUC__)
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supported;
+#elif EVAL_AVX2
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void evalSegment(const SegmentCoeffs& coeffs,
+                 const float* t,
+                 size_t count,
+                 const SegmentSamples& out) noexcept
+{
+    AxisCoeffs axes[3];
+    axisCoeffs(coeffs, axes);
+
+    size_t done = 0;
+
+#if EVAL_AVX2
+    if(hasAVX2())
+    {
+        done = evalAVX2(axes, t, count, out);
+    }
+    else
+#endif
+    {
+#if EVAL_SSE
+        done = evalSSE(axes, t, count, out);
+#endif
+    }
+
+    evalScalar(axes, t, done, count, out);
+}
+
+const char* evalSegmentIsa() noexcept
+{
+#if EVAL_AVX2
+    if(hasAVX2())
+    {
+        return "avx2";
+    }
+#endif
+#if EVAL_SSE
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
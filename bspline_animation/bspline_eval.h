@@ -0,0 +1,61 @@
+#ifndef BSPLINE_EVAL_H
+#define BSPLINE_EVAL_H
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+// Cubic segment in power basis: P(t) = a*t^3 + b*t^2 + c*t + d
+struct SegmentCoeffs
+{
+    glm::vec3 a;
+    glm::vec3 b;
+    glm::vec3 c;
+    glm::vec3 d;
+};
+
+// SoA output of a batch evaluation, pos[0..2] are the x, y and z arrays.
+// Groups left as nullptr are skipped.
+struct SegmentSamples
+{
+    float* pos[3]{nullptr, nullptr, nullptr};
+    float* tang[3]{nullptr, nullptr, nullptr};
+    float* bitang[3]{nullptr, nullptr, nullptr};
+};
+
+// Same as R * BSpline::B for the four control points of a segment
+SegmentCoeffs segmentCoeffs(const glm::vec3& p0,
+                            const glm::vec3& p1,
+                            const glm::vec3& p2,
+                            const glm::vec3& p3) noexcept;
+
+// Evaluates position, first and second derivative of a segment for count values of t.
+// Picks AVX2/FMA or SSE at runtime when the CPU has them, scalar loop otherwise.
+void evalSegment(const SegmentCoeffs& coeffs,
+                 const float* t,
+                 size_t count,
+                 const SegmentSamples& out) noexcept;
+
+const char* evalSegmentIsa() noexcept;
+
+// True when the CPU can run the AVX2/FMA kernels and they were compiled in
+bool hasAVX2() noexcept;
+
+// Single-sample evaluation by Horner's rule
+
+inline glm::vec3 evalPosition(const SegmentCoeffs& s, float t) noexcept
+{
+    return ((s.a * t + s.b) * t + s.c) * t + s.d;
+}
+
+inline glm::vec3 evalTangent(const SegmentCoeffs& s, float t) noexcept
+{
+    return (3.f * s.a * t + 2.f * s.b) * t + s.c;
+}
+
+inline glm::vec3 evalBitangent(const SegmentCoeffs& s, float t) noexcept
+{
+    return 6.f * s.a * t + 2.f * s.b;
+}
+
+#endif
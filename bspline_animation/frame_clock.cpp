@@ -0,0 +1,86 @@
+#include "frame_clock.h"
+
+#include <cmath>
+
+
+FrameClock::FrameClock(double tickRate, uint32_t maxTicksPerFrame) noexcept
+    : tickDt_(1.0 / tickRate)
+    , maxTicks_(maxTicksPerFrame > 0 ? maxTicksPerFrame : 1)
+    , last_(Clock::now())
+{
+}
+
+void FrameClock::setTickRate(double tickRate) noexcept
+{
+    // Keep the same fraction of a tick so the rendered state does not jump
+    const double fraction = accumulator_ / tickDt_;
+    tickDt_ = 1.0 / tickRate;
+    accumulator_ = fraction * tickDt_;
+}
+
+void FrameClock::setMaxTicksPerFrame(uint32_t maxTicks) noexcept
+{
+    maxTicks_ = maxTicks > 0 ? maxTicks : 1;
+}
+
+void FrameClock::reset() noexcept
+{
+    accumulator_ = 0.0;
+    last_ = Clock::now();
+}
+
+uint32_t FrameClock::beginFrame() noexcept
+{
+    const Clock::time_point now = Clock::now();
+    const double frameTime = std::chrono::duration<double>(now - last_).count();
+    last_ = now;
+
+    return advance(frameTime);
+}
+
+uint32_t FrameClock::advance(double frameTime) noexcept
+{
+    accumulator_ += frameTime > 0.0 ? frameTime : 0.0;
+
+    const double whole = std::floor(accumulator_ / tickDt_);
+    accumulator_ -= whole * tickDt_;
+
+    // Rounding can leave the accumulator a hair outside [0, tickDt)
+    if(accumulator_ < 0.0 || accumulator_ >= tickDt_)
+    {
+        accumulator_ = 0.0;
+    }
+
+    uint32_t ticks = maxTicks_;
+    if(whole < maxTicks_)
+    {
+        ticks = static_cast<uint32_t>(whole);
+    }
+    else
+    {
+        dropped_ += static_cast<uint64_t>(whole) - maxTicks_;
+    }
+
+    ticks_ += ticks;
+    return ticks;
+}
+
+float FrameClock::tickDt() const noexcept
+{
+    return static_cast<float>(tickDt_);
+}
+
+float FrameClock::alpha() const noexcept
+{
+    return static_cast<float>(accumulator_ / tickDt_);
+}
+
+uint64_t FrameClock::tickCount() const noexcept
+{
+    return ticks_;
+}
+
+uint64_t FrameClock::droppedTicks() const noexcept
+{
+    return dropped_;
+}
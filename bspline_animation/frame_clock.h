@@ -0,0 +1,50 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+// Fixed timestep clock. Real frame time is collected in an accumulator and paid out in
+// whole ticks of tickDt(), the remainder is the interpolation factor for rendering between
+// the last two ticks. Ticks per frame are capped so a long stall costs a bounded amount of
+// simulation instead of catching up forever, the time over the cap is dropped.
+struct FrameClock
+{
+    explicit FrameClock(double tickRate = 60.0, uint32_t maxTicksPerFrame = 8) noexcept;
+
+    void setTickRate(double tickRate) noexcept;
+
+    void setMaxTicksPerFrame(uint32_t maxTicks) noexcept;
+
+    // Restarts real time measurement and empties the accumulator, the tick count is kept
+    void reset() noexcept;
+
+    // Measures the real time since the previous call and returns the ticks to simulate
+    uint32_t beginFrame() noexcept;
+
+    // Same as beginFrame with the frame time given by the caller, for replays and benchmarks
+    uint32_t advance(double frameTime) noexcept;
+
+    float tickDt() const noexcept;
+
+    // Fraction of a tick in [0, 1) between the last tick and now
+    float alpha() const noexcept;
+
+    // Ticks simulated so far, the simulation state depends only on this
+    uint64_t tickCount() const noexcept;
+
+    // Ticks thrown away by the catch up cap so far
+    uint64_t droppedTicks() const noexcept;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double tickDt_;
+    double accumulator_{0.0};
+    uint32_t maxTicks_;
+    uint64_t ticks_{0};
+    uint64_t dropped_{0};
+    Clock::time_point last_;
+};
+
+#endif
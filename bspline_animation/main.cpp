@@ -1,6 +1,8 @@
 #include "app.h"
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <vulkan/vulkan.hpp>
 
 // const int MAX_FRAMES_IN_FLIGHT = 2;
@@ -21,10 +23,79 @@
 
 
 
-int main() {
-    
+int main(int argc, char** argv) {
+    AppOptions options;
 
-    App app(800, 600);
+    for(int i = 1; i < argc; ++i)
+    {
+        if(0 == strncmp(argv[i], "--curve=", 8))
+        {
+            if(!parseCurveMode(argv[i] + 8, options.curveMode))
+            {
+                fprintf(stderr, "Unknown curve mode %s, expected points, geometry or tessellation\n", argv[i] + 8);
+                return 1;
+            }
+        }
+        else if(0 == strcmp(argv[i], "--cpu-tessellation"))
+        {
+            options.gpuTessellation = false;
+        }
+        else if(0 == strcmp(argv[i], "--instances") && i + 1 < argc)
+        {
+            options.animatedInstances = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            if(0 == options.animatedInstances)
+            {
+                fprintf(stderr, "--instances needs at least one instance\n");
+                return 1;
+            }
+        }
+#if !BSPLINE_PROFILER
+        else if(0 == strcmp(argv[i], "--curve-bench") || 0 == strcmp(argv[i], "--profile"))
+        {
+            // Both are read back from the profiler
+            fprintf(stderr, "%s is not available, built without BSPLINE_PROFILER\n", argv[i]);
+            return 1;
+        }
+#endif
+        else if(0 == strcmp(argv[i], "--curve-bench"))
+        {
+            options.benchmarkCurves = true;
+        }
+        else if(0 == strcmp(argv[i], "--headless"))
+        {
+            options.headless = true;
+        }
+        else if(0 == strcmp(argv[i], "--frames") && i + 1 < argc)
+        {
+            options.headlessFrames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if(0 == strcmp(argv[i], "--png") && i + 1 < argc)
+        {
+            options.pngPath = argv[++i];
+        }
+        else if(0 == strcmp(argv[i], "--profile") && i + 1 < argc)
+        {
+            options.profilePath = argv[++i];
+        }
+        else if(0 == strcmp(argv[i], "--shaders") && i + 1 < argc)
+        {
+            options.shaderDir = argv[++i];
+        }
+        else if(0 == strcmp(argv[i], "--assets") && i + 1 < argc)
+        {
+            options.assetDir = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr,
+                    "Usage: %s [--curve=points|geometry|tessellation] [--cpu-tessellation] [--instances N] [--curve-bench] "
+                    "[--headless [--frames N] [--png file]] [--profile file.json|file.csv] [--shaders dir] [--assets dir]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    App app(800, 600, options);
 
     app.run();
 
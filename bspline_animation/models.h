@@ -2,45 +2,85 @@
 #define MODELS_H
 
 #include "vertex.h"
+#include "obj_loader.h"
+#include "weld.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
-
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <vector>
 #include <string>
 
-using Attributes = tinyobj::attrib_t;
-using Shape      = tinyobj::shape_t;
-using Material   = tinyobj::material_t;
+using Attributes = ObjAttributes;
+using Shape      = ObjShape;
 
 struct Model
 {
 
     Attributes attributes;
     std::vector<Shape> shapes;
-    std::vector<Material> materials;
 };
 
 
 
 void loadModel(const char* modelPath, Model& model) noexcept
 {
+    size_t errors = 0;
 
-    std::string err;
-    std::string warn;
+    if(!loadObj(modelPath, model.attributes, model.shapes, errors))
+    {
+        fprintf(stderr, "Object loading - ERROR - cannot read %s\n", modelPath);
+        abort();
+    }
 
+    if(errors > 0)
+    {
+        fprintf(stderr, "Object loading - WARN  - %s: %zu malformed lines skipped\n", modelPath, errors);
+    }
+}
 
-    if(!tinyobj::LoadObj(&model.attributes,
-                         &model.shapes,
-                         &model.materials,
-                         &warn,
-                         &err,
-                         modelPath))
+// Flattens the corners of every shape into vertices without duplicates, indices point into them
+void buildMesh(const Model& model, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) noexcept
+{
+    size_t cornerCount = 0;
+    for(const auto& shape : model.shapes)
     {
-        fprintf(stderr, "Object loading - WARN  - %s", warn.c_str());
-        fprintf(stderr, "Object loading - ERROR - %s", err.c_str());
-        abort();
+        cornerCount += shape.mesh.indices.size();
     }
+
+    std::vector<Vertex> corners;
+    corners.reserve(cornerCount);
+
+    for(const auto& shape : model.shapes)
+    {
+        for(const auto& index : shape.mesh.indices)
+        {
+            Vertex vertex{};
+
+            vertex.pos = 
+            {
+                model.attributes.vertices[3 * index.vertex_index + 0],
+                model.attributes.vertices[3 * index.vertex_index + 1],
+                model.attributes.vertices[3 * index.vertex_index + 2]
+            };
+            if(!model.attributes.texcoords.empty())
+            {
+                vertex.texCoord = 
+                {
+                    model.attributes.texcoords[2 * index.texcoord_index + 0],
+                    // vulkan je top to bottom, a tinyobjloader je u koord sustavu gdje je 0 donja
+                    1.0f - model.attributes.texcoords[2 * index.texcoord_index + 1]
+                };
+
+            }
+
+            vertex.color = {1.0f, 1.0f, 1.0f};
+
+            corners.push_back(vertex);
+        }
+    }
+
+    weldVertices(corners, vertices, indices);
 }
 
 
@@ -0,0 +1,98 @@
+#include "path_parser.h"
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+static inline bool isBlank(char c) noexcept
+{
+    return ' ' == c || '\t' == c || '\r' == c;
+}
+
+static const char* skipBlanks(const char* cur, const char* end) noexcept
+{
+    while(cur < end && isBlank(*cur))
+    {
+        ++cur;
+    }
+    return cur;
+}
+
+static const char* parseFloat(const char* cur, const char* end, float& value) noexcept
+{
+    cur = skipBlanks(cur, end);
+
+    // from_chars does not accept a leading plus
+    if(cur < end && '+' == *cur)
+    {
+        ++cur;
+    }
+
+    const auto [ptr, ec] = std::from_chars(cur, end, value);
+    return ec == std::errc() ? ptr : nullptr;
+}
+
+size_t PathParser::parse(std::vector<BSplineVertex>& points, size_t maxPoints) noexcept
+{
+    size_t parsed = 0;
+
+    while(cur_ < end_ && parsed < maxPoints)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(cur_, '\n', end_ - cur_));
+        if(!lineEnd)
+        {
+            lineEnd = end_;
+        }
+
+        const char* cur = skipBlanks(cur_, lineEnd);
+        ++line_;
+        cur_ = lineEnd < end_ ? lineEnd + 1 : end_;
+
+        if(cur == lineEnd || '#' == *cur)
+        {
+            continue;
+        }
+
+        if('v' == *cur)
+        {
+            // Only plain vertices, vn/vt/vp are skipped like the other OBJ records
+            if(cur + 1 == lineEnd || !isBlank(cur[1]))
+            {
+                continue;
+            }
+            ++cur;
+        }
+        else if(!(('0' <= *cur && *cur <= '9') || '-' == *cur || '+' == *cur || '.' == *cur))
+        {
+            continue;
+        }
+
+        glm::vec3 pos;
+        for(int k = 0; k < 3 && cur; ++k)
+        {
+            cur = parseFloat(cur, lineEnd, pos[k]);
+        }
+
+        if(!cur)
+        {
+            fprintf(stderr, "Path file line %zu: expected three coordinates, line skipped\n", line_);
+            ++errors_;
+            continue;
+        }
+
+        points.push_back(BSplineVertex{pos});
+        ++parsed;
+    }
+
+    return parsed;
+}
+
+bool PathParser::done() const noexcept
+{
+    return cur_ >= end_;
+}
+
+size_t PathParser::errors() const noexcept
+{
+    return errors_;
+}
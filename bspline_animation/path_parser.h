@@ -0,0 +1,32 @@
+#ifndef PATH_PARSER_H
+#define PATH_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bspline.h"
+
+// Reads control points from "x y z" lines or OBJ "v x y z" lines. Blank lines, '#' comments
+// and other OBJ records are skipped. Numbers go through std::from_chars so the result does
+// not depend on the C locale.
+struct PathParser
+{
+    PathParser(const char* begin, const char* end) noexcept : cur_(begin), end_(end) {}
+
+    // Appends at most maxPoints points, returns how many were appended
+    size_t parse(std::vector<BSplineVertex>& points, size_t maxPoints = SIZE_MAX) noexcept;
+
+    bool done() const noexcept;
+
+    // Lines that looked like points but could not be parsed
+    size_t errors() const noexcept;
+
+private:
+    const char* cur_;
+    const char* end_;
+    size_t line_{0};
+    size_t errors_{0};
+};
+
+#endif
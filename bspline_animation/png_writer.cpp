@@ -0,0 +1,134 @@
+#include "png_writer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <vector>
+
+static const std::array<uint32_t, 256>& crcTable() noexcept
+{
+    static const std::array<uint32_t, 256> table = []
+    {
+        std::array<uint32_t, 256> t{};
+        for(uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for(int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    return table;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) noexcept
+{
+    const auto& table = crcTable();
+
+    crc = ~crc;
+    for(size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+static void putU32(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(static_cast<uint8_t>(v >> 24));
+    out.push_back(static_cast<uint8_t>(v >> 16));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+static void putChunk(std::vector<uint8_t>& out, const char type[4], const std::vector<uint8_t>& data)
+{
+    putU32(out, static_cast<uint32_t>(data.size()));
+
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+
+    putU32(out, crc32(0, out.data() + start, out.size() - start));
+}
+
+bool writePng(const char* path, uint32_t width, uint32_t height, const uint8_t* rgba) noexcept
+{
+    // Deflate stored blocks hold at most 65535 bytes
+    static constexpr size_t MAX_STORED_BLOCK = 65535;
+
+    const size_t rowSize = 4 * static_cast<size_t>(width);
+
+    // Every row starts with filter type 0 (none)
+    std::vector<uint8_t> raw;
+    raw.reserve((rowSize + 1) * height);
+    for(uint32_t y = 0; y < height; ++y)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba + y * rowSize, rgba + (y + 1) * rowSize);
+    }
+
+    std::vector<uint8_t> header;
+    putU32(header, width);
+    putU32(header, height);
+    header.push_back(8);    // bits per channel
+    header.push_back(6);    // RGBA
+    header.push_back(0);    // deflate
+    header.push_back(0);    // adaptive filtering
+    header.push_back(0);    // no interlace
+
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + raw.size() / MAX_STORED_BLOCK * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+
+    for(size_t offset = 0; offset < raw.size() || offset == 0; offset += MAX_STORED_BLOCK)
+    {
+        const size_t size = std::min(MAX_STORED_BLOCK, raw.size() - offset);
+        const bool last = offset + size >= raw.size();
+
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(size));
+        zlib.push_back(static_cast<uint8_t>(size >> 8));
+        zlib.push_back(static_cast<uint8_t>(~size));
+        zlib.push_back(static_cast<uint8_t>(~size >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+
+        for(size_t i = offset; i < offset + size; ++i)
+        {
+            adlerA = (adlerA + raw[i]) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+
+        if(last)
+        {
+            break;
+        }
+    }
+
+    putU32(zlib, (adlerB << 16) | adlerA);
+
+    static constexpr uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    std::vector<uint8_t> file(SIGNATURE, SIGNATURE + 8);
+    putChunk(file, "IHDR", header);
+    putChunk(file, "IDAT", zlib);
+    putChunk(file, "IEND", {});
+
+    FILE* f = fopen(path, "wb");
+    if(!f)
+    {
+        return false;
+    }
+
+    const bool written = file.size() == fwrite(file.data(), 1, file.size(), f);
+    return 0 == fclose(f) && written;
+}
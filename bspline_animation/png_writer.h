@@ -0,0 +1,10 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <cstdint>
+
+// Writes width x height 8 bit RGBA pixels, rows top to bottom, as an uncompressed PNG.
+// Only meant for frame dumps, the file is about as large as the pixels.
+bool writePng(const char* path, uint32_t width, uint32_t height, const uint8_t* rgba) noexcept;
+
+#endif
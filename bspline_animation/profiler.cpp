@@ -0,0 +1,466 @@
+#include "profiler.h"
+
+#if BSPLINE_PROFILER
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void fail(const char* msg) noexcept
+{
+    fprintf(stderr, "%s\n", msg);
+    abort();
+}
+
+// Queries of a slot: begin and end of the submit, then begin and end of every GPU zone
+static constexpr uint32_t QUERY_COUNT = 2 + 2 * FrameProfiler::MAX_GPU_ZONES;
+
+void FrameProfiler::create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t framesInFlight,
+                           uint32_t history) noexcept
+{
+    device_ = device;
+    history_ = history > 0 ? history : HISTORY;
+    frames_.assign(history_, Frame{});
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+    const uint32_t validBits = queueFamily < familyCount ? families[queueFamily].timestampValidBits : 0;
+
+    // Without timestamps only the CPU zones are recorded
+    if(VK_TRUE != properties.limits.timestampComputeAndGraphics || 0 == validBits)
+    {
+        return;
+    }
+
+    nsPerTick_ = properties.limits.timestampPeriod;
+    tickMask_ = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    if(VK_SUCCESS != vkCreateCommandPool(device_, &poolInfo, nullptr, &cmdPool_))
+    {
+        fail("Error while trying to create the profiler command pool");
+    }
+
+    std::vector<VkCommandBuffer> cmdBuffers(2 * framesInFlight);
+
+    VkCommandBufferAllocateInfo cmdInfo{};
+    cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmdInfo.commandPool = cmdPool_;
+    cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmdInfo.commandBufferCount = static_cast<uint32_t>(cmdBuffers.size());
+
+    if(VK_SUCCESS != vkAllocateCommandBuffers(device_, &cmdInfo, cmdBuffers.data()))
+    {
+        fail("Error while trying to allocate profiler command buffers");
+    }
+
+    VkQueryPoolCreateInfo queryInfo{};
+    queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryInfo.queryCount = QUERY_COUNT;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    slots_.resize(framesInFlight);
+    for(uint32_t i = 0; i < framesInFlight; ++i)
+    {
+        Slot& slot = slots_[i];
+
+        if(VK_SUCCESS != vkCreateQueryPool(device_, &queryInfo, nullptr, &slot.queries))
+        {
+            fail("Error while trying to create a profiler query pool");
+        }
+
+        // Always the same two commands for a slot, so they are recorded once and resubmitted
+        slot.begin = cmdBuffers[2 * i];
+        vkBeginCommandBuffer(slot.begin, &beginInfo);
+            vkCmdResetQueryPool(slot.begin, slot.queries, 0, QUERY_COUNT);
+            vkCmdWriteTimestamp(slot.begin, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.queries, 0);
+        vkEndCommandBuffer(slot.begin);
+
+        slot.end = cmdBuffers[2 * i + 1];
+        vkBeginCommandBuffer(slot.end, &beginInfo);
+            vkCmdWriteTimestamp(slot.end, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slot.queries, 1);
+        vkEndCommandBuffer(slot.end);
+    }
+}
+
+void FrameProfiler::destroy() noexcept
+{
+    if(VK_NULL_HANDLE == device_)
+    {
+        return;
+    }
+
+    for(Slot& slot : slots_)
+    {
+        vkDestroyQueryPool(device_, slot.queries, nullptr);
+    }
+
+    vkDestroyCommandPool(device_, cmdPool_, nullptr);
+
+    *this = FrameProfiler{};
+}
+
+bool FrameProfiler::gpuTimestamps() const noexcept
+{
+    return !slots_.empty();
+}
+
+int64_t FrameProfiler::now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameProfiler::Frame& FrameProfiler::current() noexcept
+{
+    return frames_[frameCount_ % history_];
+}
+
+void FrameProfiler::beginFrame(uint32_t slot) noexcept
+{
+    slot_ = slot;
+    depth_ = 0;
+
+    Frame& frame = current();
+    frame.index = frameCount_;
+    frame.begin = now();
+    frame.end = frame.begin;
+    frame.submit = frame.begin;
+    frame.gpuBegin = -1;
+    frame.gpuDuration = -1;
+    frame.zoneCount = 0;
+    frame.gpuZoneCount = 0;
+}
+
+void FrameProfiler::resolve() noexcept
+{
+    if(!slots_.empty())
+    {
+        resolve(slots_[slot_]);
+    }
+}
+
+void FrameProfiler::flush() noexcept
+{
+    for(Slot& slot : slots_)
+    {
+        resolve(slot);
+    }
+}
+
+void FrameProfiler::resolve(Slot& slot) noexcept
+{
+    if(!slot.pending)
+    {
+        return;
+    }
+
+    slot.pending = false;
+
+    // Frame already dropped from the history
+    if(frameCount_ - slot.frame > history_)
+    {
+        return;
+    }
+
+    Frame& frame = frames_[slot.frame % history_];
+
+    // No wait flag, the fence of the slot has signalled so the results are there
+    uint64_t ticks[QUERY_COUNT]{};
+    if(VK_SUCCESS != vkGetQueryPoolResults(device_,
+                                           slot.queries,
+                                           0,
+                                           2 + 2 * frame.gpuZoneCount,
+                                           sizeof(ticks),
+                                           ticks,
+                                           sizeof(ticks[0]),
+                                           VK_QUERY_RESULT_64_BIT))
+    {
+        return;
+    }
+
+    // Bits above timestampValidBits are undefined
+    for(uint64_t& t : ticks)
+    {
+        t &= tickMask_;
+    }
+
+    // The GPU cannot start before the submit, so the first one is pinned to its submit time
+    if(!anchored_)
+    {
+        anchored_ = true;
+        anchorTicks_ = ticks[0];
+        anchorTime_ = frame.submit;
+    }
+
+    frame.gpuBegin = cpuTime(ticks[0]);
+    frame.gpuDuration = static_cast<int64_t>(ticksBetween(ticks[0], ticks[1]));
+
+    for(uint32_t z = 0; z < frame.gpuZoneCount; ++z)
+    {
+        GpuZone& zone = frame.gpuZones[z];
+        zone.begin = cpuTime(ticks[2 + 2 * z]);
+        zone.duration = static_cast<int64_t>(ticksBetween(ticks[2 + 2 * z], ticks[3 + 2 * z]));
+    }
+}
+
+double FrameProfiler::ticksBetween(uint64_t begin, uint64_t end) const noexcept
+{
+    return static_cast<double>((end - begin) & tickMask_) * nsPerTick_;
+}
+
+int64_t FrameProfiler::cpuTime(uint64_t ticks) const noexcept
+{
+    return anchorTime_ + static_cast<int64_t>(ticksBetween(anchorTicks_, ticks));
+}
+
+uint32_t FrameProfiler::wrap(VkCommandBuffer main, VkCommandBuffer (&cmds)[3]) noexcept
+{
+    current().submit = now();
+
+    if(slots_.empty())
+    {
+        cmds[0] = main;
+        return 1;
+    }
+
+    Slot& slot = slots_[slot_];
+    slot.frame = frameCount_;
+    slot.pending = true;
+
+    cmds[0] = slot.begin;
+    cmds[1] = main;
+    cmds[2] = slot.end;
+    return 3;
+}
+
+void FrameProfiler::endFrame() noexcept
+{
+    current().end = now();
+    ++frameCount_;
+}
+
+uint32_t FrameProfiler::beginZone(const char* name) noexcept
+{
+    const uint32_t depth = depth_++;
+
+    Frame& frame = current();
+    if(MAX_ZONES == frame.zoneCount)
+    {
+        return MAX_ZONES;
+    }
+
+    const int64_t t = now();
+    frame.zones[frame.zoneCount] = Zone{name, t, t, depth};
+    return frame.zoneCount++;
+}
+
+void FrameProfiler::endZone(uint32_t zone) noexcept
+{
+    --depth_;
+
+    if(zone < MAX_ZONES)
+    {
+        current().zones[zone].end = now();
+    }
+}
+
+uint32_t FrameProfiler::beginGpuZone(VkCommandBuffer cmd, const char* name) noexcept
+{
+    Frame& frame = current();
+    if(slots_.empty() || MAX_GPU_ZONES == frame.gpuZoneCount)
+    {
+        return MAX_GPU_ZONES;
+    }
+
+    const uint32_t zone = frame.gpuZoneCount++;
+    frame.gpuZones[zone] = GpuZone{name, -1, -1};
+
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slots_[slot_].queries, 2 + 2 * zone);
+    return zone;
+}
+
+void FrameProfiler::endGpuZone(VkCommandBuffer cmd, uint32_t zone) noexcept
+{
+    if(zone < MAX_GPU_ZONES)
+    {
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slots_[slot_].queries, 3 + 2 * zone);
+    }
+}
+
+template<typename Fn>
+void FrameProfiler::forEachFrame(Fn&& fn) const
+{
+    const uint64_t first = frameCount_ > history_ ? frameCount_ - history_ : 0;
+
+    for(uint64_t i = first; i < frameCount_; ++i)
+    {
+        fn(frames_[i % history_]);
+    }
+}
+
+std::vector<double> FrameProfiler::gpuTimes(const char* zone) const
+{
+    std::vector<double> times;
+
+    forEachFrame([&](const Frame& frame)
+    {
+        if(!zone)
+        {
+            if(frame.gpuDuration >= 0)
+            {
+                times.push_back(frame.gpuDuration * 1e-6);
+            }
+            return;
+        }
+
+        for(uint32_t z = 0; z < frame.gpuZoneCount; ++z)
+        {
+            const GpuZone& gpuZone = frame.gpuZones[z];
+            if(gpuZone.duration >= 0 && 0 == strcmp(gpuZone.name, zone))
+            {
+                times.push_back(gpuZone.duration * 1e-6);
+            }
+        }
+    });
+
+    return times;
+}
+
+std::vector<double> FrameProfiler::cpuTimes(std::initializer_list<const char*> exclude) const
+{
+    std::vector<double> times;
+
+    forEachFrame([&](const Frame& frame)
+    {
+        int64_t duration = frame.end - frame.begin;
+
+        for(uint32_t z = 0; z < frame.zoneCount; ++z)
+        {
+            const Zone& zone = frame.zones[z];
+            for(const char* name : exclude)
+            {
+                if(0 == strcmp(zone.name, name))
+                {
+                    duration -= zone.end - zone.begin;
+                }
+            }
+        }
+
+        times.push_back(duration * 1e-6);
+    });
+
+    return times;
+}
+
+bool FrameProfiler::writeChromeTrace(const char* path) const noexcept
+{
+    FILE* f = fopen(path, "w");
+    if(!f)
+    {
+        return false;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(f, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 0, \"args\": {\"name\": \"CPU\"}},\n");
+    fprintf(f, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 1, \"args\": {\"name\": \"GPU\"}}");
+
+    // Trace timestamps are microseconds
+    auto event = [f](const char* name, uint32_t tid, int64_t begin, int64_t duration, uint64_t frame)
+    {
+        fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"frame\": %llu}}",
+                name, tid, begin * 1e-3, duration * 1e-3, static_cast<unsigned long long>(frame));
+    };
+
+    forEachFrame([&](const Frame& frame)
+    {
+        event("frame", 0, frame.begin, frame.end - frame.begin, frame.index);
+
+        for(uint32_t z = 0; z < frame.zoneCount; ++z)
+        {
+            const Zone& zone = frame.zones[z];
+            event(zone.name, 0, zone.begin, zone.end - zone.begin, frame.index);
+        }
+
+        if(frame.gpuDuration >= 0)
+        {
+            event("gpu", 1, frame.gpuBegin, frame.gpuDuration, frame.index);
+        }
+
+        for(uint32_t z = 0; z < frame.gpuZoneCount; ++z)
+        {
+            const GpuZone& zone = frame.gpuZones[z];
+            if(zone.duration >= 0)
+            {
+                event(zone.name, 1, zone.begin, zone.duration, frame.index);
+            }
+        }
+    });
+
+    fprintf(f, "\n]}\n");
+
+    return 0 == fclose(f);
+}
+
+bool FrameProfiler::writeCsv(const char* path) const noexcept
+{
+    FILE* f = fopen(path, "w");
+    if(!f)
+    {
+        return false;
+    }
+
+    fprintf(f, "frame,zone,depth,start_ms,duration_ms\n");
+
+    // Times are relative to the start of the oldest recorded frame
+    int64_t origin = -1;
+
+    forEachFrame([&](const Frame& frame)
+    {
+        if(origin < 0)
+        {
+            origin = frame.begin;
+        }
+
+        const unsigned long long index = frame.index;
+
+        fprintf(f, "%llu,frame,0,%.6f,%.6f\n", index, (frame.begin - origin) * 1e-6, (frame.end - frame.begin) * 1e-6);
+
+        for(uint32_t z = 0; z < frame.zoneCount; ++z)
+        {
+            const Zone& zone = frame.zones[z];
+            fprintf(f, "%llu,%s,%u,%.6f,%.6f\n",
+                    index, zone.name, zone.depth + 1, (zone.begin - origin) * 1e-6, (zone.end - zone.begin) * 1e-6);
+        }
+
+        if(frame.gpuDuration >= 0)
+        {
+            fprintf(f, "%llu,gpu,0,%.6f,%.6f\n", index, (frame.gpuBegin - origin) * 1e-6, frame.gpuDuration * 1e-6);
+        }
+
+        for(uint32_t z = 0; z < frame.gpuZoneCount; ++z)
+        {
+            const GpuZone& zone = frame.gpuZones[z];
+            if(zone.duration >= 0)
+            {
+                fprintf(f, "%llu,%s,1,%.6f,%.6f\n", index, zone.name, (zone.begin - origin) * 1e-6, zone.duration * 1e-6);
+            }
+        }
+    });
+
+    return 0 == fclose(f);
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// 0 compiles the profiler out, FrameProfiler becomes empty and PROFILE_SCOPE expands to nothing
+#ifndef BSPLINE_PROFILER
+#define BSPLINE_PROFILER 1
+#endif
+
+#if BSPLINE_PROFILER
+
+// Records CPU zones of every frame, the GPU time of its submit and GPU zones inside it, keeping
+// the last history frames. Every frame in flight has its own timestamp query pool which is only
+// read once the fence of that frame has signalled, so resolving never waits on the GPU.
+struct FrameProfiler
+{
+    static constexpr uint32_t HISTORY = 256;
+    static constexpr uint32_t MAX_ZONES = 32;
+    static constexpr uint32_t MAX_GPU_ZONES = 4;
+
+    void create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t framesInFlight,
+                uint32_t history = HISTORY) noexcept;
+
+    void destroy() noexcept;
+
+    // False when the queue cannot write timestamps, only CPU zones are recorded then
+    bool gpuTimestamps() const noexcept;
+
+    // Opens the record of the next frame, which will run on frame in flight slot
+    void beginFrame(uint32_t slot) noexcept;
+
+    // Reads the GPU time of the previous submit of the current slot, call after its fence was waited
+    void resolve() noexcept;
+
+    // Reads the GPU times of every slot, call once the device is idle
+    void flush() noexcept;
+
+    // Command buffers of the frame's submit, main between the ones that write the timestamps.
+    // Returns how many were written to cmds.
+    uint32_t wrap(VkCommandBuffer main, VkCommandBuffer (&cmds)[3]) noexcept;
+
+    void endFrame() noexcept;
+
+    // Zones nest, name has to be a string literal or outlive the profiler
+    uint32_t beginZone(const char* name) noexcept;
+
+    void endZone(uint32_t zone) noexcept;
+
+    // Timestamps around the commands recorded into cmd between the two calls. cmd has to be
+    // submitted with the current frame, a command buffer recorded once and submitted again
+    // would write into the queries of the frame it was recorded for.
+    uint32_t beginGpuZone(VkCommandBuffer cmd, const char* name) noexcept;
+
+    void endGpuZone(VkCommandBuffer cmd, uint32_t zone) noexcept;
+
+    // Milliseconds of every recorded frame that has the time: of its submit on the GPU for a
+    // nullptr zone, of the GPU zone called zone otherwise
+    std::vector<double> gpuTimes(const char* zone = nullptr) const;
+
+    // Milliseconds every recorded frame spent on the CPU, without the zones called like one of exclude
+    std::vector<double> cpuTimes(std::initializer_list<const char*> exclude = {}) const;
+
+    // Chrome trace event JSON (chrome://tracing, Perfetto) of the recorded frames
+    bool writeChromeTrace(const char* path) const noexcept;
+
+    // One line per zone: frame, zone, depth, start_ms, duration_ms. The GPU time is zone "gpu",
+    // GPU zones follow it with depth 1.
+    bool writeCsv(const char* path) const noexcept;
+
+private:
+    struct Zone
+    {
+        const char* name;
+        int64_t begin;
+        int64_t end;
+        uint32_t depth;
+    };
+
+    struct GpuZone
+    {
+        const char* name;
+        // On the CPU clock like Frame::gpuBegin, -1 while unknown
+        int64_t begin;
+        int64_t duration;
+    };
+
+    struct Frame
+    {
+        uint64_t index{0};
+        int64_t begin{0};
+        int64_t end{0};
+        int64_t submit{0};
+        // Start and duration of the submit on the GPU, on the CPU clock, -1 while unknown
+        int64_t gpuBegin{-1};
+        int64_t gpuDuration{-1};
+        uint32_t zoneCount{0};
+        Zone zones[MAX_ZONES];
+        uint32_t gpuZoneCount{0};
+        GpuZone gpuZones[MAX_GPU_ZONES];
+    };
+
+    struct Slot
+    {
+        VkQueryPool queries{VK_NULL_HANDLE};
+        VkCommandBuffer begin{VK_NULL_HANDLE};
+        VkCommandBuffer end{VK_NULL_HANDLE};
+        // Frame whose timestamps are in queries, valid while pending
+        uint64_t frame{0};
+        bool pending{false};
+    };
+
+    static int64_t now() noexcept;
+
+    void resolve(Slot& slot) noexcept;
+
+    // GPU ticks from begin to end in ns, the counters wrap at timestampValidBits
+    double ticksBetween(uint64_t begin, uint64_t end) const noexcept;
+
+    // Start of a timestamp on the CPU clock
+    int64_t cpuTime(uint64_t ticks) const noexcept;
+
+    // Frames still in the history, oldest first
+    template<typename Fn>
+    void forEachFrame(Fn&& fn) const;
+
+    Frame& current() noexcept;
+
+    VkDevice device_{VK_NULL_HANDLE};
+    VkCommandPool cmdPool_{VK_NULL_HANDLE};
+    std::vector<Slot> slots_;
+    uint32_t slot_{0};
+    double nsPerTick_{1.0};
+    uint64_t tickMask_{~0ull};
+    uint32_t history_{HISTORY};
+
+    // Maps GPU ticks onto the CPU clock, anchored at the first submit that was resolved
+    bool anchored_{false};
+    uint64_t anchorTicks_{0};
+    int64_t anchorTime_{0};
+
+    std::vector<Frame> frames_;
+    uint64_t frameCount_{0};
+    uint32_t depth_{0};
+};
+
+struct ProfileScope
+{
+    ProfileScope(FrameProfiler& profiler, const char* name) noexcept
+        : profiler_(profiler), zone_(profiler.beginZone(name)) {}
+
+    ~ProfileScope()
+    {
+        profiler_.endZone(zone_);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    FrameProfiler& profiler_;
+    uint32_t zone_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(profiler, name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(profiler, name)
+
+#else
+
+struct FrameProfiler
+{
+    static constexpr uint32_t HISTORY = 256;
+
+    void create(VkDevice, VkPhysicalDevice, uint32_t, uint32_t, uint32_t = HISTORY) noexcept {}
+
+    void destroy() noexcept {}
+
+    bool gpuTimestamps() const noexcept { return false; }
+
+    void beginFrame(uint32_t) noexcept {}
+
+    void resolve() noexcept {}
+
+    void flush() noexcept {}
+
+    uint32_t wrap(VkCommandBuffer main, VkCommandBuffer (&cmds)[3]) noexcept
+    {
+        cmds[0] = main;
+        return 1;
+    }
+
+    void endFrame() noexcept {}
+
+    uint32_t beginGpuZone(VkCommandBuffer, const char*) noexcept { return 0; }
+
+    void endGpuZone(VkCommandBuffer, uint32_t) noexcept {}
+
+    std::vector<double> gpuTimes(const char* = nullptr) const { return {}; }
+
+    std::vector<double> cpuTimes(std::initializer_list<const char*> = {}) const { return {}; }
+
+    bool writeChromeTrace(const char*) const noexcept { return false; }
+
+    bool writeCsv(const char*) const noexcept { return false; }
+};
+
+#define PROFILE_SCOPE(profiler, name) ((void)0)
+
+#endif
+
+#endif
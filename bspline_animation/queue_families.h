@@ -34,6 +34,7 @@ private:
     std::optional<uint32_t> transferFamily_;
 };
 
+// With a null surface the graphics family is also reported as the present family
 QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface) noexcept;
 
 
@@ -0,0 +1,563 @@
+#include "spline_bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+// Parameter samples tried on a span before refining the best one
+static constexpr int SPAN_SAMPLES = 4;
+static constexpr int REFINE_STEPS = 4;
+
+// Nodes on the traversal stack, the tree depth stays far below this for any
+// practical number of segments because build splits at the median
+static constexpr int STACK_SIZE = 64;
+
+static float boxDistance2(const glm::vec3& p, const glm::vec3& min, const glm::vec3& max) noexcept
+{
+    const glm::vec3 d = glm::max(glm::max(min - p, p - max), glm::vec3(0.f));
+    return glm::dot(d, d);
+}
+
+// Entry distance of the ray into the box grown by radius, negative when it misses
+// or enters after maxT
+static float rayBox(const glm::vec3& origin, const glm::vec3& invDir,
+                    glm::vec3 min, glm::vec3 max, float radius, float maxT) noexcept
+{
+    min -= glm::vec3(radius);
+    max += glm::vec3(radius);
+
+    const glm::vec3 t0 = (min - origin) * invDir;
+    const glm::vec3 t1 = (max - origin) * invDir;
+    const glm::vec3 tMin = glm::min(t0, t1);
+    const glm::vec3 tMax = glm::max(t0, t1);
+
+    const float enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.f));
+    const float exit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxT));
+
+    return enter <= exit ? enter : -1.f;
+}
+
+// Closest point to p on the curve between t0 and t1: best of a few samples,
+// then Newton steps on (P(t) - p) . P'(t) = 0
+static float closestOnSpan(const SegmentCoeffs& c, float t0, float t1, const glm::vec3& p, float& dist2) noexcept
+{
+    float bestT = t0;
+    float best = std::numeric_limits<float>::max();
+
+    for(int k = 0; k <= SPAN_SAMPLES; ++k)
+    {
+        const float t = t0 + (t1 - t0) * k / SPAN_SAMPLES;
+        const glm::vec3 d = evalPosition(c, t) - p;
+        const float d2 = glm::dot(d, d);
+
+        if(d2 < best)
+        {
+            best = d2;
+            bestT = t;
+        }
+    }
+
+    float t = bestT;
+    for(int k = 0; k < REFINE_STEPS; ++k)
+    {
+        const glm::vec3 d = evalPosition(c, t) - p;
+        const glm::vec3 d1 = evalTangent(c, t);
+        const float f = glm::dot(d, d1);
+        const float df = glm::dot(d1, d1) + glm::dot(d, evalBitangent(c, t));
+
+        if(df <= 0.f)
+        {
+            break;
+        }
+
+        t = std::clamp(t - f / df, t0, t1);
+    }
+
+    const glm::vec3 d = evalPosition(c, t) - p;
+    const float d2 = glm::dot(d, d);
+
+    if(d2 < best)
+    {
+        best = d2;
+        bestT = t;
+    }
+
+    dist2 = best;
+    return bestT;
+}
+
+// Squared distance between the point and the ray, s is the ray parameter of the closest ray point
+static float rayPointDistance2(const glm::vec3& origin, const glm::vec3& dir, const glm::vec3& p, float& s) noexcept
+{
+    const glm::vec3 v = p - origin;
+    s = std::max(glm::dot(v, dir), 0.f);
+    const glm::vec3 w = v - s * dir;
+    return glm::dot(w, w);
+}
+
+// Point of the span closest to the ray, refined like closestOnSpan on the component
+// of P(t) - origin perpendicular to the (unit) ray direction
+static float closestToRay(const SegmentCoeffs& c, float t0, float t1,
+                          const glm::vec3& origin, const glm::vec3& dir, float& dist2, float& s) noexcept
+{
+    float bestT = t0;
+    float best = std::numeric_limits<float>::max();
+    float bestS = 0.f;
+
+    for(int k = 0; k <= SPAN_SAMPLES; ++k)
+    {
+        const float t = t0 + (t1 - t0) * k / SPAN_SAMPLES;
+        float rs;
+        const float d2 = rayPointDistance2(origin, dir, evalPosition(c, t), rs);
+
+        if(d2 < best)
+        {
+            best = d2;
+            bestT = t;
+            bestS = rs;
+        }
+    }
+
+    float t = bestT;
+    for(int k = 0; k < REFINE_STEPS; ++k)
+    {
+        const glm::vec3 v = evalPosition(c, t) - origin;
+        const glm::vec3 w = v - glm::dot(v, dir) * dir;
+        const glm::vec3 d1 = evalTangent(c, t);
+        const glm::vec3 d1Perp = d1 - glm::dot(d1, dir) * dir;
+        const float f = glm::dot(w, d1);
+        const float df = glm::dot(d1Perp, d1Perp) + glm::dot(w, evalBitangent(c, t));
+
+        if(df <= 0.f)
+        {
+            break;
+        }
+
+        t = std::clamp(t - f / df, t0, t1);
+    }
+
+    float rs;
+    const float d2 = rayPointDistance2(origin, dir, evalPosition(c, t), rs);
+
+    if(d2 < best)
+    {
+        best = d2;
+        bestT = t;
+        bestS = rs;
+    }
+
+    dist2 = best;
+    s = bestS;
+    return bestT;
+}
+
+
+uint32_t SplineBVH::addSpline(const BSpline& spline) noexcept
+{
+    const uint32_t id = static_cast<uint32_t>(splines_.size());
+
+    splines_.push_back(&spline);
+    firstSpan_.push_back(spans_.size());
+
+    const int segments = static_cast<int>(spline.segmentCount());
+    for(int i = 1; i <= segments; ++i)
+    {
+        for(int k = 0; k < SPANS_PER_SEGMENT; ++k)
+        {
+            spans_.push_back({id, i, k / float(SPANS_PER_SEGMENT), (k + 1) / float(SPANS_PER_SEGMENT)});
+        }
+    }
+
+    return id;
+}
+
+void SplineBVH::clear() noexcept
+{
+    splines_.clear();
+    firstSpan_.clear();
+    spans_.clear();
+    spanMin_.clear();
+    spanMax_.clear();
+    spanLeaf_.clear();
+    order_.clear();
+    nodes_.clear();
+    parent_.clear();
+}
+
+// The Bezier control points of the piece [t0, t1] are its end points moved by a third of the
+// end tangents, their box bounds the piece
+void SplineBVH::spanBounds(size_t span) noexcept
+{
+    const Span& s = spans_[span];
+    const SegmentCoeffs& c = splines_[s.spline]->coeffs[s.segment - 1];
+    const float h = (s.t1 - s.t0) / 3.f;
+
+    const glm::vec3 p0 = evalPosition(c, s.t0);
+    const glm::vec3 p3 = evalPosition(c, s.t1);
+    const glm::vec3 p1 = p0 + h * evalTangent(c, s.t0);
+    const glm::vec3 p2 = p3 - h * evalTangent(c, s.t1);
+
+    spanMin_[span] = glm::min(glm::min(p0, p1), glm::min(p2, p3));
+    spanMax_[span] = glm::max(glm::max(p0, p1), glm::max(p2, p3));
+}
+
+void SplineBVH::leafBounds(Node& node) const noexcept
+{
+    node.min = glm::vec3(std::numeric_limits<float>::max());
+    node.max = glm::vec3(-std::numeric_limits<float>::max());
+
+    for(int32_t k = 0; k < node.count; ++k)
+    {
+        const uint32_t span = order_[node.first + k];
+        node.min = glm::min(node.min, spanMin_[span]);
+        node.max = glm::max(node.max, spanMax_[span]);
+    }
+}
+
+void SplineBVH::build() noexcept
+{
+    spanMin_.resize(spans_.size());
+    spanMax_.resize(spans_.size());
+    spanLeaf_.resize(spans_.size());
+
+    for(size_t k = 0; k < spans_.size(); ++k)
+    {
+        spanBounds(k);
+    }
+
+    order_.resize(spans_.size());
+    for(size_t k = 0; k < order_.size(); ++k)
+    {
+        order_[k] = static_cast<uint32_t>(k);
+    }
+
+    nodes_.clear();
+    parent_.clear();
+
+    if(spans_.empty())
+    {
+        return;
+    }
+
+    nodes_.reserve(2 * spans_.size() / MAX_LEAF_SPANS + 1);
+    parent_.reserve(nodes_.capacity());
+
+    nodes_.push_back({});
+    parent_.push_back(-1);
+    buildNode(0, 0, order_.size());
+}
+
+// Median split on the longest axis of the span centres
+void SplineBVH::buildNode(int32_t index, size_t begin, size_t end) noexcept
+{
+    if(end - begin <= static_cast<size_t>(MAX_LEAF_SPANS))
+    {
+        Node& node = nodes_[index];
+        node.first = static_cast<int32_t>(begin);
+        node.count = static_cast<int32_t>(end - begin);
+        leafBounds(node);
+
+        for(size_t k = begin; k < end; ++k)
+        {
+            spanLeaf_[order_[k]] = index;
+        }
+
+        return;
+    }
+
+    glm::vec3 cMin(std::numeric_limits<float>::max());
+    glm::vec3 cMax(-std::numeric_limits<float>::max());
+    for(size_t k = begin; k < end; ++k)
+    {
+        const glm::vec3 centre = spanMin_[order_[k]] + spanMax_[order_[k]];
+        cMin = glm::min(cMin, centre);
+        cMax = glm::max(cMax, centre);
+    }
+
+    const glm::vec3 extent = cMax - cMin;
+    const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    const size_t mid = begin + (end - begin) / 2;
+
+    std::nth_element(order_.begin() + begin, order_.begin() + mid, order_.begin() + end,
+                     [&](uint32_t a, uint32_t b)
+                     {
+                         return spanMin_[a][axis] + spanMax_[a][axis] < spanMin_[b][axis] + spanMax_[b][axis];
+                     });
+
+    // Children are allocated next to each other so only the first one is stored
+    const int32_t left = static_cast<int32_t>(nodes_.size());
+    nodes_.resize(nodes_.size() + 2);
+    parent_.push_back(index);
+    parent_.push_back(index);
+
+    buildNode(left, begin, mid);
+    buildNode(left + 1, mid, end);
+
+    Node& node = nodes_[index];
+    node.first = left;
+    node.count = 0;
+    node.min = glm::min(nodes_[left].min, nodes_[left + 1].min);
+    node.max = glm::max(nodes_[left].max, nodes_[left + 1].max);
+}
+
+void SplineBVH::refit(uint32_t spline, size_t firstSegment, size_t lastSegment) noexcept
+{
+    if(nodes_.empty())
+    {
+        return;
+    }
+
+    std::vector<int32_t> dirty;
+
+    const size_t begin = firstSpan_[spline] + (firstSegment - 1) * SPANS_PER_SEGMENT;
+    const size_t end = firstSpan_[spline] + lastSegment * SPANS_PER_SEGMENT;
+
+    for(size_t k = begin; k < end; ++k)
+    {
+        spanBounds(k);
+
+        for(int32_t node = spanLeaf_[k]; node >= 0; node = parent_[node])
+        {
+            dirty.push_back(node);
+        }
+    }
+
+    // Children always have larger indices than their parent, so going from the largest
+    // index down refreshes every child before the parent reads it
+    std::sort(dirty.begin(), dirty.end(), std::greater<int32_t>());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+    for(const int32_t index : dirty)
+    {
+        Node& node = nodes_[index];
+
+        if(node.count > 0)
+        {
+            leafBounds(node);
+        }
+        else
+        {
+            node.min = glm::min(nodes_[node.first].min, nodes_[node.first + 1].min);
+            node.max = glm::max(nodes_[node.first].max, nodes_[node.first + 1].max);
+        }
+    }
+}
+
+void SplineBVH::refitControlPoint(uint32_t spline, size_t index) noexcept
+{
+    size_t first;
+    size_t last;
+    splines_[spline]->affectedSegments(index, first, last);
+
+    if(first <= last)
+    {
+        refit(spline, first, last);
+    }
+}
+
+bool SplineBVH::nearest(const glm::vec3& p, SplineHit& hit, float maxDistance) const noexcept
+{
+    if(nodes_.empty())
+    {
+        return false;
+    }
+
+    float best = maxDistance < std::numeric_limits<float>::max() ? maxDistance * maxDistance : maxDistance;
+    bool found = false;
+
+    int32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while(top > 0)
+    {
+        const Node& node = nodes_[stack[--top]];
+
+        if(boxDistance2(p, node.min, node.max) > best)
+        {
+            continue;
+        }
+
+        if(node.count > 0)
+        {
+            for(int32_t k = 0; k < node.count; ++k)
+            {
+                const uint32_t spanIndex = order_[node.first + k];
+
+                if(boxDistance2(p, spanMin_[spanIndex], spanMax_[spanIndex]) > best)
+                {
+                    continue;
+                }
+
+                const Span& span = spans_[spanIndex];
+                const SegmentCoeffs& c = splines_[span.spline]->coeffs[span.segment - 1];
+
+                float d2;
+                const float t = closestOnSpan(c, span.t0, span.t1, p, d2);
+
+                if(d2 <= best)
+                {
+                    best = d2;
+                    found = true;
+                    hit = {span.spline, span.segment, t, evalPosition(c, t), 0.f, 0.f};
+                }
+            }
+            continue;
+        }
+
+        // Nearer child goes on top so it tightens best before the other one is tested
+        const int32_t a = node.first;
+        const int32_t b = node.first + 1;
+        const bool aFirst = boxDistance2(p, nodes_[a].min, nodes_[a].max) <= boxDistance2(p, nodes_[b].min, nodes_[b].max);
+
+        stack[top++] = aFirst ? b : a;
+        stack[top++] = aFirst ? a : b;
+    }
+
+    if(found)
+    {
+        hit.distance = std::sqrt(best);
+    }
+
+    return found;
+}
+
+bool SplineBVH::pick(const glm::vec3& origin, const glm::vec3& direction, float radius, SplineHit& hit) const noexcept
+{
+    if(nodes_.empty())
+    {
+        return false;
+    }
+
+    const glm::vec3 dir = glm::normalize(direction);
+    const glm::vec3 invDir = 1.f / dir;
+    const float radius2 = radius * radius;
+
+    float bestT = std::numeric_limits<float>::max();
+    bool found = false;
+
+    int32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while(top > 0)
+    {
+        const Node& node = nodes_[stack[--top]];
+
+        if(rayBox(origin, invDir, node.min, node.max, radius, bestT) < 0.f)
+        {
+            continue;
+        }
+
+        if(node.count > 0)
+        {
+            for(int32_t k = 0; k < node.count; ++k)
+            {
+                const uint32_t spanIndex = order_[node.first + k];
+
+                if(rayBox(origin, invDir, spanMin_[spanIndex], spanMax_[spanIndex], radius, bestT) < 0.f)
+                {
+                    continue;
+                }
+
+                const Span& span = spans_[spanIndex];
+                const SegmentCoeffs& c = splines_[span.spline]->coeffs[span.segment - 1];
+
+                float d2;
+                float s;
+                const float t = closestToRay(c, span.t0, span.t1, origin, dir, d2, s);
+
+                if(d2 <= radius2 && s < bestT)
+                {
+                    bestT = s;
+                    found = true;
+                    hit = {span.spline, span.segment, t, evalPosition(c, t), std::sqrt(d2), s};
+                }
+            }
+            continue;
+        }
+
+        const int32_t a = node.first;
+        const int32_t b = node.first + 1;
+        const float ta = rayBox(origin, invDir, nodes_[a].min, nodes_[a].max, radius, bestT);
+        const float tb = rayBox(origin, invDir, nodes_[b].min, nodes_[b].max, radius, bestT);
+        const bool aFirst = tb < 0.f || (ta >= 0.f && ta <= tb);
+
+        stack[top++] = aFirst ? b : a;
+        stack[top++] = aFirst ? a : b;
+    }
+
+    return found;
+}
+
+void SplineBVH::range(const glm::vec3& center, float radius, std::vector<SplineHit>& out) const noexcept
+{
+    if(nodes_.empty())
+    {
+        return;
+    }
+
+    const size_t firstHit = out.size();
+    const float radius2 = radius * radius;
+
+    int32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while(top > 0)
+    {
+        const Node& node = nodes_[stack[--top]];
+
+        if(boxDistance2(center, node.min, node.max) > radius2)
+        {
+            continue;
+        }
+
+        if(node.count > 0)
+        {
+            for(int32_t k = 0; k < node.count; ++k)
+            {
+                const uint32_t spanIndex = order_[node.first + k];
+
+                if(boxDistance2(center, spanMin_[spanIndex], spanMax_[spanIndex]) > radius2)
+                {
+                    continue;
+                }
+
+                const Span& span = spans_[spanIndex];
+                const SegmentCoeffs& c = splines_[span.spline]->coeffs[span.segment - 1];
+
+                float d2;
+                const float t = closestOnSpan(c, span.t0, span.t1, center, d2);
+
+                if(d2 <= radius2)
+                {
+                    out.push_back({span.spline, span.segment, t, evalPosition(c, t), std::sqrt(d2), 0.f});
+                }
+            }
+            continue;
+        }
+
+        stack[top++] = node.first;
+        stack[top++] = node.first + 1;
+    }
+
+    // Several spans of a segment can be in range, keep the closest one
+    std::sort(out.begin() + firstHit, out.end(), [](const SplineHit& a, const SplineHit& b)
+              {
+                  if(a.spline != b.spline)   return a.spline < b.spline;
+                  if(a.segment != b.segment) return a.segment < b.segment;
+                  return a.distance < b.distance;
+              });
+
+    out.erase(std::unique(out.begin() + firstHit, out.end(), [](const SplineHit& a, const SplineHit& b)
+                          {
+                              return a.spline == b.spline && a.segment == b.segment;
+                          }),
+              out.end());
+}
+
+size_t SplineBVH::nodeCount() const noexcept
+{
+    return nodes_.size();
+}
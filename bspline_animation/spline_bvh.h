@@ -0,0 +1,102 @@
+#ifndef SPLINE_BVH_H
+#define SPLINE_BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bspline.h"
+
+// Point on one of the indexed splines
+struct SplineHit
+{
+    uint32_t spline;
+    int segment;
+    float t;
+    glm::vec3 position;
+    // Distance from the query point, or from the ray for pick
+    float distance;
+    // Distance along the ray, only set by pick
+    float rayT;
+};
+
+// Bounding volume hierarchy over the segments of any number of splines. Every segment is cut
+// into SPANS_PER_SEGMENT spans and each span is bounded by the box of its Bezier control
+// polygon, which contains the curve (convex hull property) and is much tighter than the
+// B-spline control points of the whole segment. Queries descend the tree and only evaluate
+// the curve on spans whose box can still beat the best result.
+struct SplineBVH
+{
+    static constexpr int SPANS_PER_SEGMENT = 4;
+    static constexpr int MAX_LEAF_SPANS = 4;
+
+    // The spline has to outlive the index, its coeffs are read by every query.
+    // Returns the spline id used in SplineHit, the tree is built by build().
+    uint32_t addSpline(const BSpline& spline) noexcept;
+
+    void clear() noexcept;
+
+    void build() noexcept;
+
+    // Recomputes the boxes of segments firstSegment..lastSegment after their coeffs changed.
+    // Only those leaves and their ancestors are touched, the tree shape is kept.
+    void refit(uint32_t spline, size_t firstSegment, size_t lastSegment) noexcept;
+
+    // Refit for BSpline::setControlPoint(index)
+    void refitControlPoint(uint32_t spline, size_t index) noexcept;
+
+    // Closest point on any spline to p that is not further than maxDistance
+    bool nearest(const glm::vec3& p, SplineHit& hit,
+                 float maxDistance = std::numeric_limits<float>::max()) const noexcept;
+
+    // First point along the ray origin + s * dir (s >= 0) that passes within radius of a spline
+    bool pick(const glm::vec3& origin, const glm::vec3& dir, float radius, SplineHit& hit) const noexcept;
+
+    // Closest point of every segment that comes within radius of center, appended to out
+    void range(const glm::vec3& center, float radius, std::vector<SplineHit>& out) const noexcept;
+
+    size_t nodeCount() const noexcept;
+
+private:
+    struct Span
+    {
+        uint32_t spline;
+        int32_t segment;
+        float t0;
+        float t1;
+    };
+
+    // Inner nodes have count == 0 and children first and first + 1,
+    // leaves cover order_[first .. first + count - 1]
+    struct Node
+    {
+        glm::vec3 min;
+        int32_t first;
+        glm::vec3 max;
+        int32_t count;
+    };
+
+    void spanBounds(size_t span) noexcept;
+
+    void buildNode(int32_t index, size_t begin, size_t end) noexcept;
+
+    void leafBounds(Node& node) const noexcept;
+
+    std::vector<const BSpline*> splines_;
+    // Index of the first span of every spline, spans are kept in (spline, segment, t) order
+    std::vector<size_t> firstSpan_;
+    std::vector<Span> spans_;
+    std::vector<glm::vec3> spanMin_;
+    std::vector<glm::vec3> spanMax_;
+    std::vector<int32_t> spanLeaf_;
+
+    // Span indices in tree order
+    std::vector<uint32_t> order_;
+    std::vector<Node> nodes_;
+    std::vector<int32_t> parent_;
+};
+
+#endif
@@ -0,0 +1,279 @@
+#include "spline_cache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static constexpr char MAGIC[4] = {'B', 'S', 'P', 'C'};
+
+// Sections start at multiples of 16 bytes
+static constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+static constexpr size_t ELEMENT_SIZE[SplineCache::SECTION_COUNT] =
+{
+    sizeof(BSplineVertex),
+    sizeof(glm::vec3),
+    sizeof(SegmentCoeffs),
+    sizeof(uint32_t),
+    sizeof(float),
+    sizeof(float),
+    sizeof(glm::quat)
+};
+
+// Tables as large as the tessellated path, read() leaves them in the mapping
+static constexpr bool LAZY[SplineCache::SECTION_COUNT] =
+{
+    false,
+    true,
+    false,
+    false,
+    true,
+    false,
+    true
+};
+
+uint64_t hashBytes(const char* begin, const char* end) noexcept
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    for(const char* c = begin; c < end; ++c)
+    {
+        hash ^= static_cast<unsigned char>(*c);
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static void fillSettings(SplineCache::Header& header, const BSpline& obj) noexcept
+{
+    header.tStep = obj.tStep_;
+    header.tolerance = obj.tessellation.tolerance();
+    header.maxDepth = obj.tessellation.maxDepth;
+    header.arcSubdivisions = BSpline::ARC_SUBDIVISIONS;
+}
+
+template<typename T>
+static void copySection(std::vector<T>& dst, const char* data, const SplineCache::Header& header, SplineCache::Section section)
+{
+    dst.resize(header.count[section]);
+    memcpy(dst.data(), data + header.offset[section], dst.size() * sizeof(T));
+}
+
+static void copySection(BSpline& obj, const char* data, const SplineCache::Header& header, SplineCache::Section section)
+{
+    switch(section)
+    {
+        case SplineCache::POINTS:        copySection(obj.points, data, header, section); break;
+        case SplineCache::PATH:          copySection(obj.path, data, header, section); break;
+        case SplineCache::COEFFS:        copySection(obj.coeffs, data, header, section); break;
+        case SplineCache::SEGMENT_START: copySection(obj.segmentStart, data, header, section); break;
+        case SplineCache::SAMPLE_T:      copySection(obj.sampleT, data, header, section); break;
+        case SplineCache::ARC_LENGTH:    copySection(obj.arcLength, data, header, section); break;
+        case SplineCache::FRAMES:        copySection(obj.frames, data, header, section); break;
+        default: break;
+    }
+}
+
+bool SplineCache::read(BSpline& obj, uint64_t sourceHash)
+{
+    if(file_.size() < sizeof(Header))
+    {
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, file_.data(), sizeof(Header));
+
+    Header expected{};
+    fillSettings(expected, obj);
+
+    if(0 != memcmp(header.magic, MAGIC, sizeof(MAGIC)) ||
+       VERSION != header.version ||
+       sourceHash != header.sourceHash ||
+       expected.tStep != header.tStep ||
+       expected.tolerance != header.tolerance ||
+       expected.maxDepth != header.maxDepth ||
+       expected.arcSubdivisions != header.arcSubdivisions)
+    {
+        return false;
+    }
+
+    for(uint32_t s = 0; s < SECTION_COUNT; ++s)
+    {
+        if(header.offset[s] > file_.size() ||
+           header.count[s] > (file_.size() - header.offset[s]) / ELEMENT_SIZE[s])
+        {
+            fprintf(stderr, "Spline cache is truncated, rebuilding it\n");
+            return false;
+        }
+    }
+
+    header_ = header;
+
+    for(uint32_t s = 0; s < SECTION_COUNT; ++s)
+    {
+        // Lazy tables are emptied with a header that has no samples, so nothing obj held
+        // before outlives the load
+        if(LAZY[s])
+        {
+            copySection(obj, file_.data(), Header{}, static_cast<Section>(s));
+            pending_[s] = true;
+        }
+        else
+        {
+            copySection(obj, file_.data(), header_, static_cast<Section>(s));
+        }
+    }
+
+    // Cached frames are written untwisted
+    obj.frameTwist.clear();
+
+    return true;
+}
+
+bool SplineCache::load(BSpline& obj, const char* pathFile)
+{
+    close();
+
+    MappedFile source;
+    if(!source.open(pathFile))
+    {
+        fprintf(stderr, "Error while trying to open path file %s!\n", pathFile);
+        abort();
+    }
+
+    const uint64_t sourceHash = hashBytes(source.data(), source.end());
+    const std::string cacheFile = std::string(pathFile) + ".cache";
+
+    if(file_.open(cacheFile.c_str()))
+    {
+        if(read(obj, sourceHash))
+        {
+            return true;
+        }
+
+        close();
+    }
+
+    BSpline::parse(obj, source.data(), source.end());
+
+    if(!write(obj, cacheFile.c_str(), sourceHash))
+    {
+        fprintf(stderr, "Could not write spline cache %s\n", cacheFile.c_str());
+    }
+
+    return false;
+}
+
+const void* SplineCache::sectionData(Section s) const noexcept
+{
+    return file_.isOpen() ? file_.data() + header_.offset[s] : nullptr;
+}
+
+size_t SplineCache::count(Section s) const noexcept
+{
+    return file_.isOpen() ? header_.count[s] : 0;
+}
+
+void SplineCache::restore(BSpline& obj, Section s)
+{
+    if(pending_[s])
+    {
+        copySection(obj, file_.data(), header_, s);
+        pending_[s] = false;
+    }
+}
+
+void SplineCache::detach(BSpline& obj)
+{
+    for(uint32_t s = 0; s < SECTION_COUNT; ++s)
+    {
+        restore(obj, static_cast<Section>(s));
+    }
+
+    close();
+}
+
+void SplineCache::close() noexcept
+{
+    file_.close();
+    header_ = {};
+
+    for(bool& pending : pending_)
+    {
+        pending = false;
+    }
+}
+
+bool SplineCache::write(const BSpline& obj, const char* cacheFile, uint64_t sourceHash) noexcept
+{
+    const void* sections[SECTION_COUNT] =
+    {
+        obj.points.data(),
+        obj.path.data(),
+        obj.coeffs.data(),
+        obj.segmentStart.data(),
+        obj.sampleT.data(),
+        obj.arcLength.data(),
+        obj.frames.data()
+    };
+
+    Header header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.sourceHash = sourceHash;
+    fillSettings(header, obj);
+
+    header.count[POINTS] = obj.points.size();
+    header.count[PATH] = obj.path.size();
+    header.count[COEFFS] = obj.coeffs.size();
+    header.count[SEGMENT_START] = obj.segmentStart.size();
+    header.count[SAMPLE_T] = obj.sampleT.size();
+    header.count[ARC_LENGTH] = obj.arcLength.size();
+    header.count[FRAMES] = obj.frames.size();
+
+    uint64_t offset = sizeof(Header);
+    for(uint32_t s = 0; s < SECTION_COUNT; ++s)
+    {
+        offset = (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+        header.offset[s] = offset;
+        offset += header.count[s] * ELEMENT_SIZE[s];
+    }
+
+    // Written under a temporary name so a failed write never leaves a valid looking cache
+    const std::string tmpFile = std::string(cacheFile) + ".tmp";
+
+    FILE* file = fopen(tmpFile.c_str(), "wb");
+    if(!file)
+    {
+        return false;
+    }
+
+    static constexpr char padding[SECTION_ALIGNMENT] = {};
+
+    bool ok = 1 == fwrite(&header, sizeof(Header), 1, file);
+    uint64_t written = sizeof(Header);
+
+    for(uint32_t s = 0; ok && s < SECTION_COUNT; ++s)
+    {
+        const size_t bytes = header.count[s] * ELEMENT_SIZE[s];
+
+        ok = fwrite(padding, 1, header.offset[s] - written, file) == header.offset[s] - written &&
+             (0 == bytes || 1 == fwrite(sections[s], bytes, 1, file));
+        written = header.offset[s] + bytes;
+    }
+
+    ok = 0 == fclose(file) && ok;
+
+    // rename does not replace an existing file on Windows
+    remove(cacheFile);
+    if(!ok || 0 != rename(tmpFile.c_str(), cacheFile))
+    {
+        remove(tmpFile.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef SPLINE_CACHE_H
+#define SPLINE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bspline.h"
+#include "mapped_file.h"
+
+// Binary image of a loaded BSpline, kept next to the path file as <pathFile>.cache.
+// It is rebuilt whenever the hash of the path file or the tessellation settings change.
+struct SplineCache
+{
+    static constexpr uint32_t VERSION = 2;
+
+    enum Section : uint32_t
+    {
+        POINTS,
+        PATH,
+        COEFFS,
+        SEGMENT_START,
+        SAMPLE_T,
+        ARC_LENGTH,
+        FRAMES,
+        SECTION_COUNT
+    };
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        float tStep;
+        float tolerance;
+        int32_t maxDepth;
+        int32_t arcSubdivisions;
+        uint64_t offset[SECTION_COUNT];
+        uint64_t count[SECTION_COUNT];
+    };
+
+    // Loads obj from the cache of pathFile, or from pathFile itself when the cache is
+    // missing or stale, in which case the cache is written again. Returns true on a cache hit.
+    // A hit copies the per-segment tables only, path, sampleT and frames stay mapped until
+    // restore() or detach() brings them into obj.
+    bool load(BSpline& obj, const char* pathFile);
+
+    // Section s straight from the mapped cache, nullptr when nothing is mapped
+    template<typename T>
+    const T* section(Section s) const noexcept
+    {
+        return static_cast<const T*>(sectionData(s));
+    }
+
+    const void* sectionData(Section s) const noexcept;
+
+    size_t count(Section s) const noexcept;
+
+    // Copies section s into its table of obj, unless it is there already
+    void restore(BSpline& obj, Section s);
+
+    // Restores every section that is still only mapped, then unmaps the cache
+    void detach(BSpline& obj);
+
+    void close() noexcept;
+
+    static bool write(const BSpline& obj, const char* cacheFile, uint64_t sourceHash) noexcept;
+
+private:
+    bool read(BSpline& obj, uint64_t sourceHash);
+
+    MappedFile file_;
+    Header header_{};
+    // Sections that are mapped but not copied into the BSpline yet
+    bool pending_[SECTION_COUNT]{};
+};
+
+// 64 bit FNV-1a
+uint64_t hashBytes(const char* begin, const char* end) noexcept;
+
+#endif
@@ -0,0 +1,292 @@
+#include "spline_compute.h"
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+
+static void fail(const char* msg) noexcept
+{
+    fprintf(stderr, "%s\n", msg);
+    abort();
+}
+
+static uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties) noexcept
+{
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    for(uint32_t i = 0; i < memProperties.memoryTypeCount; ++i)
+    {
+        if((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+
+    fail("Error while trying to find the suitable memory type for spline control points");
+    return 0;
+}
+
+VkDeviceSize SplineCompute::pathSize(const BSpline& spline) noexcept
+{
+    return sizeof(BSplineVertex) * spline.segmentCount() * spline.samplesPerSegment();
+}
+
+uint32_t SplineCompute::segmentCount() const noexcept
+{
+    return pointCount_ > 3 ? pointCount_ - 3 : 0;
+}
+
+uint32_t SplineCompute::vertexCount() const noexcept
+{
+    return segmentCount() * samplesPerSegment_;
+}
+
+void SplineCompute::create(VkDevice device,
+                           VkPhysicalDevice physicalDevice,
+                           const std::vector<uint8_t>& shaderCode,
+                           const BSpline& spline,
+                           VkBuffer vertices,
+                           VkBuffer tangents) noexcept
+{
+    device_ = device;
+    pointCount_ = static_cast<uint32_t>(spline.points.size());
+    samplesPerSegment_ = static_cast<uint32_t>(spline.samplesPerSegment());
+    tStep_ = spline.tStep_;
+
+    // Control points, vec4 because std430 arrays of vec3 have a 16 byte stride
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = sizeof(glm::vec4) * pointCount_;
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if(VK_SUCCESS != vkCreateBuffer(device_, &bufferInfo, nullptr, &points_))
+    {
+        fail("Error while trying to create spline control point buffer");
+    }
+
+    VkMemoryRequirements memReqs;
+    vkGetBufferMemoryRequirements(device_, points_, &memReqs);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memReqs.size;
+    allocInfo.memoryTypeIndex = findMemoryType(physicalDevice,
+                                               memReqs.memoryTypeBits,
+                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    if(VK_SUCCESS != vkAllocateMemory(device_, &allocInfo, nullptr, &pointsMemory_))
+    {
+        fail("Failed to allocate memory for spline control points");
+    }
+
+    vkBindBufferMemory(device_, points_, pointsMemory_, 0);
+
+    // Stays mapped, editing a point is a plain store
+    void* data;
+    vkMapMemory(device_, pointsMemory_, 0, bufferInfo.size, 0, &data);
+    mappedPoints_ = static_cast<glm::vec4*>(data);
+
+    for(uint32_t i = 0; i < pointCount_; ++i)
+    {
+        mappedPoints_[i] = glm::vec4(spline.points[i].pos, 1.f);
+    }
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    for(uint32_t i = 0; i < bindings.size(); ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if(VK_SUCCESS != vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &descriptorLayout_))
+    {
+        fail("Failed to create spline compute descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = static_cast<uint32_t>(bindings.size());
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+
+    if(VK_SUCCESS != vkCreateDescriptorPool(device_, &poolInfo, nullptr, &descriptorPool_))
+    {
+        fail("Error while trying to create spline compute descriptor pool");
+    }
+
+    VkDescriptorSetAllocateInfo setInfo{};
+    setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setInfo.descriptorPool = descriptorPool_;
+    setInfo.descriptorSetCount = 1;
+    setInfo.pSetLayouts = &descriptorLayout_;
+
+    if(VK_SUCCESS != vkAllocateDescriptorSets(device_, &setInfo, &descriptorSet_))
+    {
+        fail("Error while allocating spline compute descriptor set");
+    }
+
+    // Without a tangent buffer binding 2 aliases the path, the shader never writes it
+    const bool writeTangents = VK_NULL_HANDLE != tangents;
+
+    std::array<VkDescriptorBufferInfo, 3> bufferInfos{};
+    bufferInfos[0].buffer = points_;
+    bufferInfos[0].range = VK_WHOLE_SIZE;
+    bufferInfos[1].buffer = vertices;
+    bufferInfos[1].range = VK_WHOLE_SIZE;
+    bufferInfos[2].buffer = writeTangents ? tangents : vertices;
+    bufferInfos[2].range = VK_WHOLE_SIZE;
+
+    std::array<VkWriteDescriptorSet, 3> writers{};
+    for(uint32_t i = 0; i < writers.size(); ++i)
+    {
+        writers[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writers[i].dstSet = descriptorSet_;
+        writers[i].dstBinding = i;
+        writers[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writers[i].descriptorCount = 1;
+        writers[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writers.size()), writers.data(), 0, nullptr);
+
+    VkPushConstantRange pushRange{};
+    pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushRange.offset = 0;
+    pushRange.size = sizeof(Params);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorLayout_;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+
+    if(VK_SUCCESS != vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &pipelineLayout_))
+    {
+        fail("failed to create spline compute pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = shaderCode.size();
+    moduleInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+    VkShaderModule shaderModule;
+    if(VK_SUCCESS != vkCreateShaderModule(device_, &moduleInfo, nullptr, &shaderModule))
+    {
+        fail("failed to create spline compute shader module!");
+    }
+
+    const VkBool32 tangentsConstant = writeTangents ? VK_TRUE : VK_FALSE;
+
+    VkSpecializationMapEntry specEntry{};
+    specEntry.constantID = 0;
+    specEntry.offset = 0;
+    specEntry.size = sizeof(VkBool32);
+
+    VkSpecializationInfo specInfo{};
+    specInfo.mapEntryCount = 1;
+    specInfo.pMapEntries = &specEntry;
+    specInfo.dataSize = sizeof(VkBool32);
+    specInfo.pData = &tangentsConstant;
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = &specInfo;
+    pipelineInfo.layout = pipelineLayout_;
+
+    if(VK_SUCCESS != vkCreateComputePipelines(device_, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline_))
+    {
+        fail("failed to create spline compute pipeline!");
+    }
+
+    vkDestroyShaderModule(device_, shaderModule, nullptr);
+}
+
+void SplineCompute::destroy() noexcept
+{
+    if(VK_NULL_HANDLE == device_)
+    {
+        return;
+    }
+
+    vkDestroyPipeline(device_, pipeline_, nullptr);
+    vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
+    vkDestroyDescriptorPool(device_, descriptorPool_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, descriptorLayout_, nullptr);
+
+    vkUnmapMemory(device_, pointsMemory_);
+    vkDestroyBuffer(device_, points_, nullptr);
+    vkFreeMemory(device_, pointsMemory_, nullptr);
+
+    *this = SplineCompute{};
+}
+
+void SplineCompute::record(VkCommandBuffer cmdBuffer, uint32_t firstSegment, uint32_t lastSegment) const noexcept
+{
+    if(firstSegment > lastSegment || lastSegment > segmentCount() || 0 == firstSegment)
+    {
+        return;
+    }
+
+    // Earlier draws may still read the vertices that get overwritten
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &descriptorSet_, 0, nullptr);
+
+    const Params params{firstSegment, samplesPerSegment_, tStep_};
+    vkCmdPushConstants(cmdBuffer, pipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params), &params);
+
+    vkCmdDispatch(cmdBuffer,
+                  (samplesPerSegment_ + LOCAL_SIZE - 1) / LOCAL_SIZE,
+                  lastSegment - firstSegment + 1,
+                  1);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void SplineCompute::recordAll(VkCommandBuffer cmdBuffer) const noexcept
+{
+    record(cmdBuffer, 1, segmentCount());
+}
+
+void SplineCompute::setControlPoint(const BSpline& spline, size_t index, uint32_t& firstSegment, uint32_t& lastSegment) noexcept
+{
+    mappedPoints_[index] = glm::vec4(spline.points[index].pos, 1.f);
+
+    size_t first;
+    size_t last;
+    spline.affectedSegments(index, first, last);
+
+    firstSegment = static_cast<uint32_t>(first);
+    lastSegment = static_cast<uint32_t>(last);
+}
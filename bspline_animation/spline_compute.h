@@ -0,0 +1,71 @@
+#ifndef SPLINE_COMPUTE_H
+#define SPLINE_COMPUTE_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include "bspline.h"
+
+// Tessellates a spline on the GPU with bspline_tessellate.comp. Control points live in a
+// persistently mapped storage buffer, the path is written straight into a vertex buffer.
+// Needs only a compute capable queue, nothing from the window or the swapchain.
+struct SplineCompute
+{
+    static constexpr uint32_t LOCAL_SIZE = 64;
+
+    // vertices (and tangents when given) need VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+    // and at least pathSize(spline) bytes
+    void create(VkDevice device,
+                VkPhysicalDevice physicalDevice,
+                const std::vector<uint8_t>& shaderCode,
+                const BSpline& spline,
+                VkBuffer vertices,
+                VkBuffer tangents = VK_NULL_HANDLE) noexcept;
+
+    void destroy() noexcept;
+
+    // Records the dispatch for segments first..last and makes its writes visible to vertex input
+    void record(VkCommandBuffer cmdBuffer, uint32_t firstSegment, uint32_t lastSegment) const noexcept;
+
+    // Same as record for every segment
+    void recordAll(VkCommandBuffer cmdBuffer) const noexcept;
+
+    // Copies control point index of spline, after BSpline::setControlPoint, into the mapped buffer
+    // and returns the segments that have to be dispatched again
+    void setControlPoint(const BSpline& spline, size_t index, uint32_t& firstSegment, uint32_t& lastSegment) noexcept;
+
+    uint32_t vertexCount() const noexcept;
+
+    uint32_t segmentCount() const noexcept;
+
+    // Size of the uniformly tessellated path in bytes
+    static VkDeviceSize pathSize(const BSpline& spline) noexcept;
+
+private:
+    struct Params
+    {
+        uint32_t firstSegment;
+        uint32_t samplesPerSegment;
+        float tStep;
+    };
+
+    VkDevice device_{VK_NULL_HANDLE};
+    VkBuffer points_{VK_NULL_HANDLE};
+    VkDeviceMemory pointsMemory_{VK_NULL_HANDLE};
+    glm::vec4* mappedPoints_{nullptr};
+
+    VkDescriptorSetLayout descriptorLayout_{VK_NULL_HANDLE};
+    VkDescriptorPool descriptorPool_{VK_NULL_HANDLE};
+    VkDescriptorSet descriptorSet_{VK_NULL_HANDLE};
+    VkPipelineLayout pipelineLayout_{VK_NULL_HANDLE};
+    VkPipeline pipeline_{VK_NULL_HANDLE};
+
+    uint32_t pointCount_{0};
+    uint32_t samplesPerSegment_{0};
+    float tStep_{0.f};
+};
+
+#endif
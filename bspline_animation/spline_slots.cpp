@@ -0,0 +1,113 @@
+#include "spline_slots.h"
+#include "parallel.h"
+
+#include <algorithm>
+
+// Segments written by one worker task in writeAll
+static constexpr size_t SEGMENTS_PER_TASK = 16;
+
+static uint32_t slotCapacity(const BSpline& spline, size_t samples) noexcept
+{
+    // Uniform segments never change their sample count
+    if(!spline.isAdaptive())
+    {
+        return static_cast<uint32_t>(samples);
+    }
+
+    return static_cast<uint32_t>(samples + std::max<size_t>(samples / 2, SplineSlots::MIN_HEADROOM));
+}
+
+void SplineSlots::build(const BSpline& spline, size_t capacity) noexcept
+{
+    const size_t segments = spline.segmentCount();
+
+    slots_.resize(segments);
+    end_ = 0;
+
+    for(size_t i = 1; i <= segments; ++i)
+    {
+        size_t begin;
+        size_t end;
+        spline.segmentSamples(i, begin, end);
+
+        slots_[i - 1] = {static_cast<uint32_t>(end_), slotCapacity(spline, end - begin)};
+        end_ += slots_[i - 1].capacity;
+    }
+
+    // Adaptive paths get as much room again for segments that move to the tail, an old buffer
+    // is kept as long as it still has half of that
+    const size_t wanted = spline.isAdaptive() ? 2 * end_ : end_;
+    capacity_ = capacity >= (end_ + wanted) / 2 ? capacity : wanted;
+}
+
+bool SplineSlots::fit(const BSpline& spline, size_t i, Slot& abandoned) noexcept
+{
+    abandoned = {0, 0};
+
+    size_t begin;
+    size_t end;
+    spline.segmentSamples(i, begin, end);
+
+    Slot& slot = slots_[i - 1];
+    if(end - begin <= slot.capacity)
+    {
+        return true;
+    }
+
+    const uint32_t capacity = slotCapacity(spline, end - begin);
+
+    // The last slot grows in place
+    if(slot.begin + slot.capacity == end_ && slot.begin + capacity <= capacity_)
+    {
+        slot.capacity = capacity;
+        end_ = slot.begin + capacity;
+        return true;
+    }
+
+    if(end_ + capacity > capacity_)
+    {
+        return false;
+    }
+
+    abandoned = slot;
+    slot = {static_cast<uint32_t>(end_), capacity};
+    end_ += capacity;
+
+    return true;
+}
+
+void SplineSlots::write(const BSpline& spline, const glm::vec3* path, size_t i, glm::vec3* dst) const noexcept
+{
+    size_t begin;
+    size_t end;
+    spline.segmentSamples(i, begin, end);
+
+    std::copy(path + begin, path + end, dst);
+    std::fill(dst + (end - begin), dst + slots_[i - 1].capacity, path[end - 1]);
+}
+
+void SplineSlots::writeAll(const BSpline& spline, const glm::vec3* path, glm::vec3* dst) const noexcept
+{
+    WorkerPool::shared().parallelFor(slots_.size(), SEGMENTS_PER_TASK, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin + 1; i <= end; ++i)
+        {
+            write(spline, path, i, dst + slots_[i - 1].begin);
+        }
+    });
+}
+
+const SplineSlots::Slot& SplineSlots::slot(size_t i) const noexcept
+{
+    return slots_[i - 1];
+}
+
+uint32_t SplineSlots::vertexCount() const noexcept
+{
+    return static_cast<uint32_t>(end_);
+}
+
+size_t SplineSlots::capacity() const noexcept
+{
+    return capacity_;
+}
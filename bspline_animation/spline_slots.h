@@ -0,0 +1,58 @@
+#ifndef SPLINE_SLOTS_H
+#define SPLINE_SLOTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bspline.h"
+
+// Layout of a CPU tessellated path in its vertex buffer. Every segment gets its own slot, and
+// adaptive segments get headroom to grow, so an edit only rewrites the slots of the segments it
+// changed. A segment that outgrows its slot moves to the free tail of the buffer. Slot entries
+// past the segment's samples repeat its last one, which is invisible in the point list the
+// path is drawn as.
+struct SplineSlots
+{
+    struct Slot
+    {
+        uint32_t begin;
+        uint32_t capacity;
+    };
+
+    // Adaptive segments get at least this many spare entries, a segment rarely shrinks to one sample
+    static constexpr uint32_t MIN_HEADROOM = 8;
+
+    // Packs every segment from the start of the buffer. The capacity stays when the packed
+    // slots fit it, otherwise it is chosen anew and the buffer has to be recreated.
+    void build(const BSpline& spline, size_t capacity = 0) noexcept;
+
+    // Makes sure segment i fits its slot after retessellate, moving it to the tail when it
+    // grew too large. The slot it left is set in abandoned (capacity 0 when it stayed) and has
+    // to be overwritten. Returns false when the tail has no room for it, build() packs again.
+    bool fit(const BSpline& spline, size_t i, Slot& abandoned) noexcept;
+
+    // Fills dst with the slot.capacity entries of segment i
+    void write(const BSpline& spline, const glm::vec3* path, size_t i, glm::vec3* dst) const noexcept;
+
+    // Fills the whole buffer up to vertexCount(), dst is indexed like the vertex buffer
+    void writeAll(const BSpline& spline, const glm::vec3* path, glm::vec3* dst) const noexcept;
+
+    const Slot& slot(size_t i) const noexcept;
+
+    // End of the last slot in use, this many vertices are drawn
+    uint32_t vertexCount() const noexcept;
+
+    // Vertices the buffer has room for
+    size_t capacity() const noexcept;
+
+private:
+    // slots_[i - 1] belongs to segment i
+    std::vector<Slot> slots_;
+    size_t end_ = 0;
+    size_t capacity_ = 0;
+};
+
+#endif
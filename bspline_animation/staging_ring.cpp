@@ -0,0 +1,239 @@
+#include "staging_ring.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static void fail(const char* msg) noexcept
+{
+    fprintf(stderr, "%s\n", msg);
+    abort();
+}
+
+static uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties) noexcept
+{
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    for(uint32_t i = 0; i < memProperties.memoryTypeCount; ++i)
+    {
+        if((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+
+    fail("Error while trying to find the suitable memory type for the staging ring");
+    return 0;
+}
+
+void StagingRing::create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, VkDeviceSize size) noexcept
+{
+    device_ = device;
+    size_ = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size_;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if(VK_SUCCESS != vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer_))
+    {
+        fail("Error while trying to create the staging ring buffer");
+    }
+
+    VkMemoryRequirements memReqs;
+    vkGetBufferMemoryRequirements(device_, buffer_, &memReqs);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memReqs.size;
+    allocInfo.memoryTypeIndex = findMemoryType(physicalDevice,
+                                               memReqs.memoryTypeBits,
+                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    if(VK_SUCCESS != vkAllocateMemory(device_, &allocInfo, nullptr, &memory_))
+    {
+        fail("Failed to allocate memory for the staging ring");
+    }
+
+    vkBindBufferMemory(device_, buffer_, memory_, 0);
+
+    void* data;
+    vkMapMemory(device_, memory_, 0, size_, 0, &data);
+    mapped_ = static_cast<uint8_t*>(data);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    if(VK_SUCCESS != vkCreateCommandPool(device_, &poolInfo, nullptr, &cmdPool_))
+    {
+        fail("Error while trying to create the staging ring command pool");
+    }
+
+    std::array<VkCommandBuffer, MAX_IN_FLIGHT> cmdBuffers;
+
+    VkCommandBufferAllocateInfo cmdInfo{};
+    cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmdInfo.commandPool = cmdPool_;
+    cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmdInfo.commandBufferCount = MAX_IN_FLIGHT;
+
+    if(VK_SUCCESS != vkAllocateCommandBuffers(device_, &cmdInfo, cmdBuffers.data()))
+    {
+        fail("Error while trying to allocate staging ring command buffers");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    for(uint32_t i = 0; i < MAX_IN_FLIGHT; ++i)
+    {
+        slots_[i].cmdBuffer = cmdBuffers[i];
+
+        if(VK_SUCCESS != vkCreateFence(device_, &fenceInfo, nullptr, &slots_[i].fence))
+        {
+            fail("Error while trying to create staging ring fences");
+        }
+    }
+}
+
+void StagingRing::destroy() noexcept
+{
+    if(VK_NULL_HANDLE == device_)
+    {
+        return;
+    }
+
+    while(retireOldest())
+    {
+    }
+
+    for(Slot& slot : slots_)
+    {
+        vkDestroyFence(device_, slot.fence, nullptr);
+    }
+
+    vkDestroyCommandPool(device_, cmdPool_, nullptr);
+
+    vkUnmapMemory(device_, memory_);
+    vkDestroyBuffer(device_, buffer_, nullptr);
+    vkFreeMemory(device_, memory_, nullptr);
+
+    *this = StagingRing{};
+}
+
+VkCommandBuffer StagingRing::begin() noexcept
+{
+    Slot& slot = slots_[current_];
+
+    // Slots are used round robin, so a pending current slot is the oldest submit
+    if(slot.pending)
+    {
+        vkWaitForFences(device_, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+        retire(slot);
+    }
+
+    vkResetFences(device_, 1, &slot.fence);
+    vkResetCommandBuffer(slot.cmdBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(slot.cmdBuffer, &beginInfo);
+
+    return slot.cmdBuffer;
+}
+
+void* StagingRing::allocate(VkDeviceSize size, VkDeviceSize& offset) noexcept
+{
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+    if(size > size_)
+    {
+        return nullptr;
+    }
+
+    for(;;)
+    {
+        // An allocation never wraps, what is left at the end of the ring is skipped
+        uint64_t start = head_;
+        const VkDeviceSize ringOffset = start % size_;
+        if(ringOffset + size > size_)
+        {
+            start += size_ - ringOffset;
+        }
+
+        if(start + size - tail_ <= size_)
+        {
+            head_ = start + size;
+            offset = start % size_;
+            return mapped_ + offset;
+        }
+
+        // Full with only the submit being recorded left, it needs more than the ring holds
+        if(!retireOldest())
+        {
+            return nullptr;
+        }
+    }
+}
+
+void StagingRing::submit(VkQueue queue) noexcept
+{
+    Slot& slot = slots_[current_];
+
+    vkEndCommandBuffer(slot.cmdBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &slot.cmdBuffer;
+
+    if(VK_SUCCESS != vkQueueSubmit(queue, 1, &submitInfo, slot.fence))
+    {
+        fail("Error while submitting a staging ring upload");
+    }
+
+    slot.end = head_;
+    slot.pending = true;
+
+    current_ = (current_ + 1) % MAX_IN_FLIGHT;
+}
+
+bool StagingRing::retireOldest() noexcept
+{
+    // The slot at current_ is either being recorded or, between submits, the oldest one
+    for(uint32_t k = 0; k < MAX_IN_FLIGHT; ++k)
+    {
+        Slot& slot = slots_[(current_ + k) % MAX_IN_FLIGHT];
+
+        if(slot.pending)
+        {
+            vkWaitForFences(device_, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+            retire(slot);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void StagingRing::retire(Slot& slot) noexcept
+{
+    tail_ = slot.end > tail_ ? slot.end : tail_;
+    slot.pending = false;
+}
+
+VkBuffer StagingRing::buffer() const noexcept
+{
+    return buffer_;
+}
+
+VkDeviceSize StagingRing::size() const noexcept
+{
+    return size_;
+}
@@ -0,0 +1,68 @@
+#ifndef STAGING_RING_H
+#define STAGING_RING_H
+
+#include <array>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+// Persistently mapped host visible buffer that uploads are carved out of front to back.
+// Every submit that reads from the ring gets its own command buffer and fence, and the bytes
+// it used are reclaimed once that fence has signalled, so an upload neither creates buffers
+// nor waits for the queue to go idle.
+struct StagingRing
+{
+    // Submits that may be in flight at once, begin() waits for the oldest one past this
+    static constexpr uint32_t MAX_IN_FLIGHT = 8;
+
+    static constexpr VkDeviceSize ALIGNMENT = 16;
+
+    void create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, VkDeviceSize size) noexcept;
+
+    void destroy() noexcept;
+
+    // Starts recording the next submit
+    VkCommandBuffer begin() noexcept;
+
+    // Reserves size bytes for the submit being recorded, waiting for older submits when the
+    // ring is full. Returns nullptr when size is larger than the whole ring.
+    void* allocate(VkDeviceSize size, VkDeviceSize& offset) noexcept;
+
+    // Ends the command buffer from begin() and submits it to queue
+    void submit(VkQueue queue) noexcept;
+
+    VkBuffer buffer() const noexcept;
+
+    VkDeviceSize size() const noexcept;
+
+private:
+    struct Slot
+    {
+        VkCommandBuffer cmdBuffer{VK_NULL_HANDLE};
+        VkFence fence{VK_NULL_HANDLE};
+        // Value of head_ when the slot was submitted, everything before it is freed with the slot
+        uint64_t end{0};
+        bool pending{false};
+    };
+
+    // Waits for the oldest pending submit and frees its bytes, false when nothing is pending
+    bool retireOldest() noexcept;
+
+    void retire(Slot& slot) noexcept;
+
+    VkDevice device_{VK_NULL_HANDLE};
+    VkBuffer buffer_{VK_NULL_HANDLE};
+    VkDeviceMemory memory_{VK_NULL_HANDLE};
+    uint8_t* mapped_{nullptr};
+    VkDeviceSize size_{0};
+
+    VkCommandPool cmdPool_{VK_NULL_HANDLE};
+    std::array<Slot, MAX_IN_FLIGHT> slots_{};
+    uint32_t current_{0};
+
+    // Bytes handed out and bytes freed since create, both only grow
+    uint64_t head_{0};
+    uint64_t tail_{0};
+};
+
+#endif
@@ -4,13 +4,22 @@
 // #define GLM_FORCE_DEAULT_ALIGNED_GENTYPES
 #include <glm/glm.hpp>
 
-struct UniformBuffObject
+// Camera of a frame, shared by every draw through descriptor set 0
+struct ViewUniform
 {
-    glm::mat4 model;
     glm::mat4 view;
     glm::mat4 proj;
 
 };
 
+// Per draw transform, pushed right before the draw to the vertex stage
+struct DrawPushConstants
+{
+    glm::mat4 model;
+    // Texture coordinates are xy + zw * the vertex ones, see VertexDequantization
+    glm::vec4 texCoordTransform{0.f, 0.f, 1.f, 1.f};
+
+};
+
 
-#endif
\ No newline at end of file
+#endif
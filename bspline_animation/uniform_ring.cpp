@@ -0,0 +1,124 @@
+#include "uniform_ring.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static void fail(const char* msg) noexcept
+{
+    fprintf(stderr, "%s\n", msg);
+    abort();
+}
+
+static uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties) noexcept
+{
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    for(uint32_t i = 0; i < memProperties.memoryTypeCount; ++i)
+    {
+        if((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+
+    fail("Error while trying to find the suitable memory type for the uniform ring");
+    return 0;
+}
+
+static VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment) noexcept
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+void UniformRing::create(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize, uint32_t blocksPerFrame, uint32_t frames) noexcept
+{
+    device_ = device;
+    frames_ = frames;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    // Always a power of two, 1 would mean any offset
+    alignment_ = properties.limits.minUniformBufferOffsetAlignment > 0 ? properties.limits.minUniformBufferOffsetAlignment : 1;
+    frameSize_ = alignUp(blockSize, alignment_) * blocksPerFrame;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = frameSize_ * frames_;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if(VK_SUCCESS != vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer_))
+    {
+        fail("Error while trying to create the uniform ring buffer");
+    }
+
+    VkMemoryRequirements memReqs;
+    vkGetBufferMemoryRequirements(device_, buffer_, &memReqs);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memReqs.size;
+    allocInfo.memoryTypeIndex = findMemoryType(physicalDevice,
+                                               memReqs.memoryTypeBits,
+                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    if(VK_SUCCESS != vkAllocateMemory(device_, &allocInfo, nullptr, &memory_))
+    {
+        fail("Failed to allocate memory for the uniform ring");
+    }
+
+    vkBindBufferMemory(device_, buffer_, memory_, 0);
+
+    // Mapped for the whole lifetime, coherent so nothing has to be flushed either
+    void* data;
+    vkMapMemory(device_, memory_, 0, VK_WHOLE_SIZE, 0, &data);
+    mapped_ = static_cast<uint8_t*>(data);
+
+    begin(0);
+}
+
+void UniformRing::destroy() noexcept
+{
+    if(VK_NULL_HANDLE == device_)
+    {
+        return;
+    }
+
+    vkUnmapMemory(device_, memory_);
+    vkDestroyBuffer(device_, buffer_, nullptr);
+    vkFreeMemory(device_, memory_, nullptr);
+
+    *this = UniformRing{};
+}
+
+void UniformRing::begin(uint32_t frame) noexcept
+{
+    head_ = frameSize_ * (frame % frames_);
+    end_ = head_ + frameSize_;
+}
+
+void* UniformRing::allocate(VkDeviceSize size, uint32_t& offset) noexcept
+{
+    size = alignUp(size, alignment_);
+
+    if(head_ + size > end_)
+    {
+        return nullptr;
+    }
+
+    offset = static_cast<uint32_t>(head_);
+    head_ += size;
+    return mapped_ + offset;
+}
+
+VkBuffer UniformRing::buffer() const noexcept
+{
+    return buffer_;
+}
+
+VkDeviceSize UniformRing::frameSize() const noexcept
+{
+    return frameSize_;
+}
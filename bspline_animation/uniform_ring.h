@@ -0,0 +1,46 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+// One persistently mapped, host coherent uniform buffer split into a region per frame.
+// Per draw data is carved out of a frame's region at minUniformBufferOffsetAlignment and
+// bound through a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor, so a single
+// descriptor set serves every draw and frame and writing uniforms is a plain memcpy.
+struct UniformRing
+{
+    // Every frame's region fits blocksPerFrame allocations of up to blockSize bytes
+    void create(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize, uint32_t blocksPerFrame, uint32_t frames) noexcept;
+
+    void destroy() noexcept;
+
+    // Starts handing out the region of frame from its beginning
+    void begin(uint32_t frame) noexcept;
+
+    // Reserves size bytes in the region of the current frame, offset is the dynamic offset
+    // to bind it with. Returns nullptr when the region is full.
+    void* allocate(VkDeviceSize size, uint32_t& offset) noexcept;
+
+    VkBuffer buffer() const noexcept;
+
+    // Size of a frame's region, at most this much can be allocated between two begin() calls
+    VkDeviceSize frameSize() const noexcept;
+
+private:
+    VkDevice device_{VK_NULL_HANDLE};
+    VkBuffer buffer_{VK_NULL_HANDLE};
+    VkDeviceMemory memory_{VK_NULL_HANDLE};
+    uint8_t* mapped_{nullptr};
+
+    VkDeviceSize alignment_{1};
+    VkDeviceSize frameSize_{0};
+    uint32_t frames_{0};
+
+    // Next free byte and end of the current frame's region
+    VkDeviceSize head_{0};
+    VkDeviceSize end_{0};
+};
+
+#endif
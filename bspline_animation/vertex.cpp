@@ -0,0 +1,86 @@
+#include "vertex.h"
+
+#include <algorithm>
+#include <cmath>
+
+static inline uint16_t quantizeUnorm16(float value) noexcept
+{
+    return static_cast<uint16_t>(std::lround(std::clamp(value, 0.f, 1.f) * 65535.f));
+}
+
+static inline uint8_t quantizeUnorm8(float value) noexcept
+{
+    return static_cast<uint8_t>(std::lround(std::clamp(value, 0.f, 1.f) * 255.f));
+}
+
+// Where value lies in [min, max]. Flat ranges store 0, which their scale of 0 brings back to min.
+static inline float fraction(float value, float min, float max) noexcept
+{
+    return max > min ? (value - min) / (max - min) : 0.f;
+}
+
+VertexDequantization PackedVertex::dequantization(const VertexBounds& bounds) noexcept
+{
+    const glm::vec3 extent = bounds.posMax - bounds.posMin;
+    const glm::vec2 texCoordExtent = bounds.texCoordMax - bounds.texCoordMin;
+
+    VertexDequantization dequantization;
+    dequantization.position = glm::mat4(1.f);
+    dequantization.position[0][0] = extent.x;
+    dequantization.position[1][1] = extent.y;
+    dequantization.position[2][2] = extent.z;
+    dequantization.position[3] = glm::vec4(bounds.posMin, 1.f);
+    dequantization.texCoord = glm::vec4(bounds.texCoordMin.x, bounds.texCoordMin.y, texCoordExtent.x, texCoordExtent.y);
+
+    return dequantization;
+}
+
+PackedVertex PackedVertex::pack(const Vertex& vertex, const VertexBounds& bounds) noexcept
+{
+    PackedVertex packed{};
+
+    for(int k = 0; k < 3; ++k)
+    {
+        packed.pos.value[k] = quantizeUnorm16(fraction(vertex.pos[k], bounds.posMin[k], bounds.posMax[k]));
+        packed.color.value[k] = quantizeUnorm8(vertex.color[k]);
+    }
+    packed.color.value[3] = 255;
+
+    for(int k = 0; k < 2; ++k)
+    {
+        packed.texCoord.value[k] = quantizeUnorm16(fraction(vertex.texCoord[k], bounds.texCoordMin[k], bounds.texCoordMax[k]));
+    }
+
+    return packed;
+}
+
+VertexBounds vertexBounds(const std::vector<Vertex>& vertices) noexcept
+{
+    VertexBounds bounds;
+    if(vertices.empty())
+    {
+        return bounds;
+    }
+
+    bounds.posMin = bounds.posMax = vertices[0].pos;
+    bounds.texCoordMin = bounds.texCoordMax = vertices[0].texCoord;
+
+    for(const Vertex& vertex : vertices)
+    {
+        bounds.posMin = glm::min(bounds.posMin, vertex.pos);
+        bounds.posMax = glm::max(bounds.posMax, vertex.pos);
+        bounds.texCoordMin = glm::min(bounds.texCoordMin, vertex.texCoord);
+        bounds.texCoordMax = glm::max(bounds.texCoordMax, vertex.texCoord);
+    }
+
+    return bounds;
+}
+
+void packVertices(const std::vector<Vertex>& vertices, const VertexBounds& bounds, std::vector<GpuVertex>& packed) noexcept
+{
+    packed.resize(vertices.size());
+    for(size_t i = 0; i < vertices.size(); ++i)
+    {
+        packed[i] = GpuVertex::pack(vertices[i], bounds);
+    }
+}
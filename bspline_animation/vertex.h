@@ -2,11 +2,38 @@
 #define VERTEX_H
 
 #include <array>
+#include <cstdint>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
 #include <vulkan/vulkan.h>
 
+#include "vertex_layout.h"
+
+// 1 uploads PackedVertex, 0 uploads Vertex as it is. texturedModel.vert reads both.
+#ifndef BSPLINE_PACKED_VERTICES
+#define BSPLINE_PACKED_VERTICES 1
+#endif
+
+// Maps the vertex buffer back to model space. position goes in front of the model matrix,
+// texture coordinates are texCoord.xy + texCoord.zw * the stored ones.
+struct VertexDequantization
+{
+    glm::mat4 position{1.f};
+    glm::vec4 texCoord{0.f, 0.f, 1.f, 1.f};
+};
+
+// Ranges of the mesh attributes, PackedVertex stores fractions of them
+struct VertexBounds
+{
+    glm::vec3 posMin{0.f};
+    glm::vec3 posMax{0.f};
+    glm::vec2 texCoordMin{0.f};
+    glm::vec2 texCoordMax{0.f};
+};
+
+// Full precision vertex the mesh is welded and optimized with
 struct Vertex
 {
     glm::vec3 pos;
@@ -22,41 +49,68 @@ struct Vertex
 
     static constexpr VkVertexInputBindingDescription getBindingDescription() noexcept
     {
-        VkVertexInputBindingDescription description{};
-        description.binding = 0;
-        description.stride = sizeof(Vertex);
-        description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-        
-        return description;
+        return makeBindingDescription<Vertex>();
     }
 
-    static constexpr std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() noexcept
+    static constexpr auto getAttributeDescriptions() noexcept
     {
-        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+        return makeAttributeDescriptions(VERTEX_ATTRIBUTE(Vertex, pos),
+                                         VERTEX_ATTRIBUTE(Vertex, color),
+                                         VERTEX_ATTRIBUTE(Vertex, texCoord));
+    };
 
-        // describe inPosition
-        attributeDescriptions[0].binding  = 0;
-        attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format   = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[0].offset   = offsetof(Vertex, pos);
+    static VertexDequantization dequantization(const VertexBounds&) noexcept
+    {
+        return VertexDequantization{};
+    }
 
-        // describe inColor
-        attributeDescriptions[1].binding  = 0;
-        attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format   = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[1].offset   = offsetof(Vertex, color);
+    static Vertex pack(const Vertex& vertex, const VertexBounds&) noexcept
+    {
+        return vertex;
+    }
 
-        attributeDescriptions[2].binding  = 0;
-        attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format   = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[2].offset   = offsetof(Vertex, texCoord);
+};
 
-        return attributeDescriptions;
+// Vertex buffer layout at half the size of Vertex, 16 bytes: positions and texture coordinates
+// as 16 bit fractions of the mesh bounds, the color in 8 bits per channel
+struct PackedVertex
+{
+    // w is always 0, 3 component 16 bit formats are optional for vertex buffers
+    Unorm16x4 pos;
+    // alpha is always 1
+    Unorm8x4 color;
+    Unorm16x2 texCoord;
 
-    };
+    static constexpr VkVertexInputBindingDescription getBindingDescription() noexcept
+    {
+        return makeBindingDescription<PackedVertex>();
+    }
 
+    static constexpr auto getAttributeDescriptions() noexcept
+    {
+        return makeAttributeDescriptions(VERTEX_ATTRIBUTE(PackedVertex, pos),
+                                         VERTEX_ATTRIBUTE(PackedVertex, color),
+                                         VERTEX_ATTRIBUTE(PackedVertex, texCoord));
+    }
+
+    static VertexDequantization dequantization(const VertexBounds& bounds) noexcept;
+
+    static PackedVertex pack(const Vertex& vertex, const VertexBounds& bounds) noexcept;
 };
 
+static_assert(sizeof(PackedVertex) == sizeof(Vertex) / 2, "PackedVertex is meant to halve the vertex buffer");
+
+#if BSPLINE_PACKED_VERTICES
+using GpuVertex = PackedVertex;
+#else
+using GpuVertex = Vertex;
+#endif
+
+VertexBounds vertexBounds(const std::vector<Vertex>& vertices) noexcept;
+
+// Converts the vertices to the vertex buffer layout, relative to bounds
+void packVertices(const std::vector<Vertex>& vertices, const VertexBounds& bounds, std::vector<GpuVertex>& packed) noexcept;
+
 
 
 namespace std
@@ -80,4 +134,4 @@ namespace std
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,172 @@
+#include "mapped_file.h"
+
+#include <utility>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if(this != &other)
+    {
+        close();
+
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        open_ = std::exchange(other.open_, false);
+#ifdef _WIN32
+        file_ = std::exchange(other.file_, nullptr);
+        mapping_ = std::exchange(other.mapping_, nullptr);
+#endif
+    }
+
+    return *this;
+}
+
+bool MappedFile::open(const char* path) noexcept
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(INVALID_HANDLE_VALUE == file)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    file_ = file;
+    size_ = static_cast<size_t>(size.QuadPart);
+    open_ = true;
+
+    // Empty files can't be mapped, they stay open with no data
+    if(0 == size_)
+    {
+        return true;
+    }
+
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!mapping_)
+    {
+        close();
+        return false;
+    }
+
+    data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if(!data_)
+    {
+        close();
+        return false;
+    }
+#else
+    int fd = ::open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size_ = static_cast<size_t>(info.st_size);
+    open_ = true;
+
+    if(size_ > 0)
+    {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(MAP_FAILED == data)
+        {
+            ::close(fd);
+            size_ = 0;
+            open_ = false;
+            return false;
+        }
+
+        madvise(data, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(data);
+    }
+
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+#endif
+
+    return true;
+}
+
+void MappedFile::close() noexcept
+{
+#ifdef _WIN32
+    if(data_)
+    {
+        UnmapViewOfFile(data_);
+    }
+    if(mapping_)
+    {
+        CloseHandle(mapping_);
+    }
+    if(file_)
+    {
+        CloseHandle(file_);
+    }
+    file_ = nullptr;
+    mapping_ = nullptr;
+#else
+    if(data_)
+    {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+}
+
+bool MappedFile::isOpen() const noexcept
+{
+    return open_;
+}
+
+const char* MappedFile::data() const noexcept
+{
+    return data_;
+}
+
+const char* MappedFile::end() const noexcept
+{
+    return data_ + size_;
+}
+
+size_t MappedFile::size() const noexcept
+{
+    return size_;
+}
@@ -0,0 +1,42 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file
+struct MappedFile
+{
+    MappedFile() = default;
+
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const char* path) noexcept;
+
+    void close() noexcept;
+
+    bool isOpen() const noexcept;
+
+    const char* data() const noexcept;
+
+    const char* end() const noexcept;
+
+    size_t size() const noexcept;
+
+private:
+    const char* data_{nullptr};
+    size_t size_{0};
+    bool open_{false};
+#ifdef _WIN32
+    void* file_{nullptr};
+    void* mapping_{nullptr};
+#endif
+};
+
+#endif
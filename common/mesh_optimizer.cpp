@@ -0,0 +1,344 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+
+// FIFO cache as insertion timestamps, a vertex is cached while fewer than size vertices were
+// inserted after it. Moving the clock forward by more than size empties it.
+struct FifoCache
+{
+    FifoCache(size_t vertexCount, uint32_t size) : insertedAt(vertexCount, 0), size(size), clock(size + 1) {}
+
+    // True when v had to be shaded
+    bool access(uint32_t v) noexcept
+    {
+        if(clock - insertedAt[v] <= size)
+        {
+            return false;
+        }
+
+        insertedAt[v] = clock++;
+        return true;
+    }
+
+    // Misses of the triangles [begin, end)
+    uint32_t access(const std::vector<uint32_t>& indices, size_t begin, size_t end) noexcept
+    {
+        uint32_t misses = 0;
+        for(size_t i = 3 * begin; i < 3 * end; ++i)
+        {
+            misses += access(indices[i]) ? 1 : 0;
+        }
+        return misses;
+    }
+
+    void flush() noexcept
+    {
+        clock += size + 1;
+    }
+
+    std::vector<uint32_t> insertedAt;
+    uint32_t size;
+    uint32_t clock;
+};
+
+// Triangles of every vertex, those of v are triangles[offsets[v], offsets[v + 1])
+struct Adjacency
+{
+    Adjacency(const std::vector<uint32_t>& indices, size_t vertexCount) : offsets(vertexCount + 1, 0), triangles(indices.size())
+    {
+        for(uint32_t v : indices)
+        {
+            ++offsets[v + 1];
+        }
+
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+        for(size_t i = 0; i < indices.size(); ++i)
+        {
+            triangles[next[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+};
+
+}
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) noexcept
+{
+    FifoCache cache(vertexCount, cacheSize);
+    const uint32_t misses = cache.access(indices, 0, indices.size() / 3);
+
+    std::vector<bool> used(vertexCount, false);
+    size_t usedCount = 0;
+    for(uint32_t v : indices)
+    {
+        usedCount += used[v] ? 0 : 1;
+        used[v] = true;
+    }
+
+    VertexCacheStats stats{0.f, 0.f};
+    if(!indices.empty())
+    {
+        stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+        stats.atvr = static_cast<float>(misses) / static_cast<float>(usedCount);
+    }
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize,
+                         std::vector<uint32_t>& clusters) noexcept
+{
+    const Adjacency adjacency(indices, vertexCount);
+
+    // Triangles of every vertex that are not emitted yet
+    std::vector<uint32_t> live(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v)
+    {
+        live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+
+    std::vector<bool> emitted(indices.size() / 3, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    // Same clock as FifoCache, the position of a cached vertex is clock - insertedAt
+    std::vector<uint32_t> insertedAt(vertexCount, 0);
+    uint32_t clock = cacheSize + 1;
+
+    // Next vertex in index order to try once the dead end stack is empty
+    size_t cursor = 0;
+
+    // Most recently used vertex that still has triangles, else the next one in index order
+    auto skipDeadEnd = [&]() -> int64_t
+    {
+        while(!deadEnds.empty())
+        {
+            const uint32_t v = deadEnds.back();
+            deadEnds.pop_back();
+            if(live[v] > 0)
+            {
+                return v;
+            }
+        }
+
+        for(; cursor < vertexCount; ++cursor)
+        {
+            if(live[cursor] > 0)
+            {
+                return static_cast<int64_t>(cursor);
+            }
+        }
+
+        return -1;
+    };
+
+    clusters.clear();
+
+    for(int64_t fan = skipDeadEnd(); fan >= 0;)
+    {
+        if(clusters.empty() || clusters.back() != result.size() / 3)
+        {
+            clusters.push_back(static_cast<uint32_t>(result.size() / 3));
+        }
+
+        // Fans around the chosen vertex until it runs out of triangles or none of the
+        // candidates would still be cached after its own fan
+        while(fan >= 0)
+        {
+            candidates.clear();
+
+            for(uint32_t k = adjacency.offsets[fan]; k < adjacency.offsets[fan + 1]; ++k)
+            {
+                const uint32_t triangle = adjacency.triangles[k];
+                if(emitted[triangle])
+                {
+                    continue;
+                }
+
+                emitted[triangle] = true;
+                for(uint32_t c = 0; c < 3; ++c)
+                {
+                    const uint32_t v = indices[3 * triangle + c];
+                    result.push_back(v);
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+
+                    if(clock - insertedAt[v] > cacheSize)
+                    {
+                        insertedAt[v] = clock++;
+                    }
+                }
+            }
+
+            // The candidate that will have been cached the longest after fanning it, as
+            // long as it survives its own fan (two new vertices per live triangle)
+            int64_t next = -1;
+            int64_t bestPriority = -1;
+            for(uint32_t v : candidates)
+            {
+                if(0 == live[v])
+                {
+                    continue;
+                }
+
+                int64_t priority = 0;
+                if(clock - insertedAt[v] + 2 * live[v] <= cacheSize)
+                {
+                    priority = clock - insertedAt[v];
+                }
+
+                if(priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    next = v;
+                }
+            }
+
+            fan = next;
+        }
+
+        // Dead end, which starts a new cluster
+        fan = skipDeadEnd();
+    }
+
+    indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, const float* positions, size_t stride, size_t vertexCount,
+                      const std::vector<uint32_t>& clusters, uint32_t cacheSize, float threshold) noexcept
+{
+    const size_t triangleCount = indices.size() / 3;
+    if(0 == triangleCount || clusters.empty())
+    {
+        return;
+    }
+
+    auto clusterEnd = [&](const std::vector<uint32_t>& starts, size_t k) -> size_t
+    {
+        return k + 1 < starts.size() ? starts[k + 1] : triangleCount;
+    };
+
+    // Every time a prefix of the cluster reaches its ACMR (with some slack) the rest becomes
+    // a new cluster. The remainder after the last split is usually a few triangles with a
+    // bad ACMR, so it stays with the part before it.
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<uint32_t> splits;
+
+    for(size_t k = 0; k < clusters.size(); ++k)
+    {
+        const size_t begin = clusters[k];
+        const size_t end = clusterEnd(clusters, k);
+
+        cache.flush();
+        const float clusterAcmr = static_cast<float>(cache.access(indices, begin, end)) / static_cast<float>(end - begin);
+
+        splits.push_back(static_cast<uint32_t>(begin));
+        cache.flush();
+
+        uint32_t misses = 0;
+        uint32_t triangles = 0;
+        for(size_t t = begin; t < end; ++t)
+        {
+            misses += cache.access(indices, t, t + 1);
+            ++triangles;
+
+            if(static_cast<float>(misses) <= threshold * clusterAcmr * static_cast<float>(triangles))
+            {
+                splits.push_back(static_cast<uint32_t>(t + 1));
+                cache.flush();
+                misses = 0;
+                triangles = 0;
+            }
+        }
+
+        if(splits.back() != begin)
+        {
+            splits.pop_back();
+        }
+    }
+
+    auto position = [&](uint32_t v)
+    {
+        const float* p = positions + v * stride;
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+
+    glm::vec3 meshCentroid(0.f);
+    for(uint32_t v : indices)
+    {
+        meshCentroid += position(v);
+    }
+    meshCentroid /= static_cast<float>(indices.size());
+
+    // How much a cluster faces away from the centroid, from its area weighted centroid and normal
+    std::vector<float> outwardness(splits.size());
+    for(size_t k = 0; k < splits.size(); ++k)
+    {
+        glm::vec3 centroid(0.f);
+        glm::vec3 normal(0.f);
+        float area = 0.f;
+
+        for(size_t t = splits[k]; t < clusterEnd(splits, k); ++t)
+        {
+            const glm::vec3 a = position(indices[3 * t + 0]);
+            const glm::vec3 b = position(indices[3 * t + 1]);
+            const glm::vec3 c = position(indices[3 * t + 2]);
+
+            const glm::vec3 cross = glm::cross(b - a, c - a);
+            const float triangleArea = glm::length(cross);
+
+            centroid += (a + b + c) * (triangleArea / 3.f);
+            normal += cross;
+            area += triangleArea;
+        }
+
+        centroid = area > 0.f ? centroid / area : centroid;
+        const float normalLength = glm::length(normal);
+        normal = normalLength > 0.f ? normal / normalLength : normal;
+
+        outwardness[k] = glm::dot(centroid - meshCentroid, normal);
+    }
+
+    std::vector<uint32_t> order(splits.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+    {
+        return outwardness[a] > outwardness[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for(uint32_t k : order)
+    {
+        result.insert(result.end(), indices.begin() + 3 * splits[k], indices.begin() + 3 * clusterEnd(splits, k));
+    }
+
+    indices.swap(result);
+}
+
+size_t optimizeVertexFetchRemap(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& remap) noexcept
+{
+    remap.assign(vertexCount, UINT32_MAX);
+
+    uint32_t next = 0;
+    for(uint32_t& v : indices)
+    {
+        if(UINT32_MAX == remap[v])
+        {
+            remap[v] = next++;
+        }
+        v = remap[v];
+    }
+
+    return next;
+}
@@ -0,0 +1,87 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// FIFO post-transform cache the index order is optimized for and measured with
+static constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+// Clusters are split further while their own ACMR stays within this factor of the whole
+// cluster's, overdraw ordering gets more freedom for at most 5% more vertex shading
+static constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+struct VertexCacheStats
+{
+    // Vertex shader runs per triangle, 0.5 is the best a regular grid can do and 3 the worst
+    float acmr;
+    // Vertex shader runs per referenced vertex, 1 means every vertex is shaded once
+    float atvr;
+};
+
+struct MeshOptimizationStats
+{
+    VertexCacheStats before;
+    VertexCacheStats after;
+};
+
+// Simulates a FIFO cache of cacheSize entries over the triangle list
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) noexcept;
+
+// Tipsify (Sander, Nehab, Barczak 2007), reorders the triangles for a cache of cacheSize entries.
+// clusters receives the first triangle of every run that ended in a dead end, those runs can be
+// reordered between themselves without hurting the cache much.
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize,
+                         std::vector<uint32_t>& clusters) noexcept;
+
+// Splits the clusters at points where a cluster's prefix is shaded about as well as the whole
+// cluster, then orders them front to back from outside the mesh: the clusters that face away
+// from the mesh centroid first, so they occlude the inner and back facing ones.
+// positions are vertexCount vec3s, stride floats apart.
+void optimizeOverdraw(std::vector<uint32_t>& indices, const float* positions, size_t stride, size_t vertexCount,
+                      const std::vector<uint32_t>& clusters, uint32_t cacheSize, float threshold) noexcept;
+
+// Numbers the vertices in order of first use, so the vertex fetches walk the buffer forward.
+// remap[old] is the new index of old, or UINT32_MAX when old is unused. Returns the used count.
+size_t optimizeVertexFetchRemap(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& remap) noexcept;
+
+// Vertex cache, overdraw and vertex fetch order of a welded indexed triangle list, in that
+// order. Unused vertices are dropped.
+template<typename V>
+MeshOptimizationStats optimizeMesh(std::vector<V>& vertices, std::vector<uint32_t>& indices) noexcept
+{
+    static_assert(std::is_same_v<decltype(V::pos), glm::vec3> && 0 == sizeof(V) % sizeof(float),
+                  "optimizeMesh reads the positions from V::pos");
+
+    MeshOptimizationStats stats;
+    stats.before = analyzeVertexCache(indices, vertices.size(), VERTEX_CACHE_SIZE);
+
+    std::vector<uint32_t> clusters;
+    optimizeVertexCache(indices, vertices.size(), VERTEX_CACHE_SIZE, clusters);
+
+    const float* positions = vertices.empty() ? nullptr : &vertices[0].pos.x;
+    optimizeOverdraw(indices, positions, sizeof(V) / sizeof(float), vertices.size(), clusters,
+                     VERTEX_CACHE_SIZE, OVERDRAW_THRESHOLD);
+
+    std::vector<uint32_t> remap;
+    const size_t used = optimizeVertexFetchRemap(indices, vertices.size(), remap);
+
+    std::vector<V> reordered(used);
+    for(size_t v = 0; v < vertices.size(); ++v)
+    {
+        if(UINT32_MAX != remap[v])
+        {
+            reordered[remap[v]] = vertices[v];
+        }
+    }
+    vertices.swap(reordered);
+
+    stats.after = analyzeVertexCache(indices, vertices.size(), VERTEX_CACHE_SIZE);
+    return stats;
+}
+
+#endif
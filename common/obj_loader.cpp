@@ -0,0 +1,385 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+// Small files are parsed as one chunk, splitting them costs more than it saves
+static constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+// More chunks than threads so a thread that drew slow chunks does not hold up the rest
+static constexpr size_t CHUNKS_PER_THREAD = 4;
+
+namespace
+{
+
+enum Attribute : uint8_t
+{
+    POSITION = 1,
+    TEXCOORD = 2,
+    NORMAL = 4
+};
+
+// Corner of the chunk with a negative (relative) index, it counts from the start of the
+// chunk until the number of elements in the chunks before it is known
+struct Fixup
+{
+    uint32_t corner;
+    uint8_t attributes;
+};
+
+struct ShapeStart
+{
+    size_t corner;
+    std::string name;
+};
+
+struct Chunk
+{
+    const char* begin;
+    const char* end;
+
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    std::vector<ObjIndex> corners;
+    std::vector<Fixup> fixups;
+    std::vector<ShapeStart> shapes;
+    size_t errors{0};
+
+    // Elements (not floats) and corners of the chunks before this one
+    size_t vertexBase{0};
+    size_t normalBase{0};
+    size_t texcoordBase{0};
+    size_t cornerBase{0};
+};
+
+}
+
+static inline bool isBlank(char c) noexcept
+{
+    return ' ' == c || '\t' == c || '\r' == c;
+}
+
+static const char* skipBlanks(const char* cur, const char* end) noexcept
+{
+    while(cur < end && isBlank(*cur))
+    {
+        ++cur;
+    }
+    return cur;
+}
+
+static const char* parseFloat(const char* cur, const char* end, float& value) noexcept
+{
+    cur = skipBlanks(cur, end);
+
+    // from_chars does not accept a leading plus
+    if(cur < end && '+' == *cur)
+    {
+        ++cur;
+    }
+
+    const auto [ptr, ec] = std::from_chars(cur, end, value);
+    return ec == std::errc() ? ptr : nullptr;
+}
+
+static const char* parseFloats(const char* cur, const char* end, std::vector<float>& out, int count) noexcept
+{
+    float values[3];
+    for(int k = 0; k < count && cur; ++k)
+    {
+        cur = parseFloat(cur, end, values[k]);
+    }
+
+    // Optional w and vertex colors after them are ignored
+    if(cur)
+    {
+        out.insert(out.end(), values, values + count);
+    }
+    return cur;
+}
+
+// 1 based or negative relative OBJ index to 0 based. A relative one counts back from the
+// count elements parsed so far, which are only the ones of this chunk.
+static bool resolveIndex(const char*& cur, const char* end, size_t count, int& index, bool& relative) noexcept
+{
+    int raw;
+    const auto [ptr, ec] = std::from_chars(cur, end, raw);
+    if(ec != std::errc() || 0 == raw)
+    {
+        return false;
+    }
+
+    cur = ptr;
+    relative = raw < 0;
+    index = relative ? static_cast<int>(count) + raw : raw - 1;
+    return true;
+}
+
+// v, v/vt, v//vn or v/vt/vn
+static const char* parseCorner(const char* cur, const char* end, const Chunk& chunk, ObjIndex& corner, uint8_t& relative) noexcept
+{
+    corner = ObjIndex{-1, -1, -1};
+    relative = 0;
+
+    bool rel;
+    if(!resolveIndex(cur, end, chunk.vertices.size() / 3, corner.vertex_index, rel))
+    {
+        return nullptr;
+    }
+    relative |= rel ? POSITION : 0;
+
+    if(cur < end && '/' == *cur)
+    {
+        ++cur;
+        if(cur < end && '/' != *cur)
+        {
+            if(!resolveIndex(cur, end, chunk.texcoords.size() / 2, corner.texcoord_index, rel))
+            {
+                return nullptr;
+            }
+            relative |= rel ? TEXCOORD : 0;
+        }
+
+        if(cur < end && '/' == *cur)
+        {
+            ++cur;
+            if(!resolveIndex(cur, end, chunk.normals.size() / 3, corner.normal_index, rel))
+            {
+                return nullptr;
+            }
+            relative |= rel ? NORMAL : 0;
+        }
+    }
+
+    return cur;
+}
+
+static bool parseFace(const char* cur, const char* end, Chunk& chunk, std::vector<ObjIndex>& face, std::vector<uint8_t>& relative) noexcept
+{
+    face.clear();
+    relative.clear();
+
+    for(cur = skipBlanks(cur, end); cur < end; cur = skipBlanks(cur, end))
+    {
+        ObjIndex corner;
+        uint8_t rel;
+        cur = parseCorner(cur, end, chunk, corner, rel);
+        if(!cur || (cur < end && !isBlank(*cur)))
+        {
+            return false;
+        }
+
+        face.push_back(corner);
+        relative.push_back(rel);
+    }
+
+    // Fan around the first corner, same as the triangulation for convex polygons
+    for(size_t k = 2; k < face.size(); ++k)
+    {
+        for(size_t c : {size_t(0), k - 1, k})
+        {
+            if(relative[c])
+            {
+                chunk.fixups.push_back(Fixup{static_cast<uint32_t>(chunk.corners.size()), relative[c]});
+            }
+            chunk.corners.push_back(face[c]);
+        }
+    }
+
+    return true;
+}
+
+static void parseChunk(Chunk& chunk) noexcept
+{
+    // Rough guess from the usual line lengths, saves most of the regrowth
+    const size_t bytes = chunk.end - chunk.begin;
+    chunk.vertices.reserve(bytes / 12);
+    chunk.corners.reserve(bytes / 8);
+
+    std::vector<ObjIndex> face;
+    std::vector<uint8_t> relative;
+
+    for(const char* line = chunk.begin; line < chunk.end;)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(line, '\n', chunk.end - line));
+        if(!lineEnd)
+        {
+            lineEnd = chunk.end;
+        }
+
+        const char* cur = skipBlanks(line, lineEnd);
+        line = lineEnd + 1;
+
+        if(lineEnd - cur < 2)
+        {
+            continue;
+        }
+
+        bool ok = true;
+
+        if('v' == cur[0] && isBlank(cur[1]))
+        {
+            ok = parseFloats(cur + 2, lineEnd, chunk.vertices, 3);
+        }
+        else if('v' == cur[0] && 'n' == cur[1])
+        {
+            ok = parseFloats(cur + 2, lineEnd, chunk.normals, 3);
+        }
+        else if('v' == cur[0] && 't' == cur[1])
+        {
+            ok = parseFloats(cur + 2, lineEnd, chunk.texcoords, 2);
+        }
+        else if('f' == cur[0] && isBlank(cur[1]))
+        {
+            ok = parseFace(cur + 2, lineEnd, chunk, face, relative);
+        }
+        else if(('o' == cur[0] || 'g' == cur[0]) && isBlank(cur[1]))
+        {
+            const char* nameBegin = skipBlanks(cur + 2, lineEnd);
+            const char* nameEnd = lineEnd;
+            while(nameEnd > nameBegin && isBlank(nameEnd[-1]))
+            {
+                --nameEnd;
+            }
+
+            chunk.shapes.push_back(ShapeStart{chunk.corners.size(), std::string(nameBegin, nameEnd)});
+        }
+
+        chunk.errors += ok ? 0 : 1;
+    }
+}
+
+template<typename T>
+static void copyInto(const std::vector<T>& src, std::vector<T>& dst, size_t offset) noexcept
+{
+    std::copy(src.begin(), src.end(), dst.begin() + offset);
+}
+
+bool loadObj(const char* path, ObjAttributes& attributes, std::vector<ObjShape>& shapes, size_t& errors) noexcept
+{
+    MappedFile file;
+    if(!file.open(path))
+    {
+        return false;
+    }
+
+    WorkerPool& pool = WorkerPool::shared();
+
+    const size_t chunkCount = std::max<size_t>(1, std::min(file.size() / MIN_CHUNK_BYTES, pool.size() * CHUNKS_PER_THREAD));
+    std::vector<Chunk> chunks(chunkCount);
+
+    // Equal byte ranges moved forward to the next line start
+    const char* cur = file.data();
+    for(size_t k = 0; k < chunkCount; ++k)
+    {
+        const char* end = file.end();
+        if(k + 1 < chunkCount)
+        {
+            const char* target = std::max(cur, file.data() + file.size() * (k + 1) / chunkCount);
+            const char* newline = static_cast<const char*>(memchr(target, '\n', file.end() - target));
+            end = newline ? newline + 1 : file.end();
+        }
+
+        chunks[k].begin = cur;
+        chunks[k].end = end;
+        cur = end;
+    }
+
+    pool.parallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t k = begin; k < end; ++k)
+        {
+            parseChunk(chunks[k]);
+        }
+    });
+
+    // Where every chunk goes in the merged arrays
+    size_t vertexCount = 0;
+    size_t normalCount = 0;
+    size_t texcoordCount = 0;
+    size_t cornerCount = 0;
+    errors = 0;
+
+    for(Chunk& chunk : chunks)
+    {
+        chunk.vertexBase = vertexCount;
+        chunk.normalBase = normalCount;
+        chunk.texcoordBase = texcoordCount;
+        chunk.cornerBase = cornerCount;
+
+        vertexCount += chunk.vertices.size() / 3;
+        normalCount += chunk.normals.size() / 3;
+        texcoordCount += chunk.texcoords.size() / 2;
+        cornerCount += chunk.corners.size();
+        errors += chunk.errors;
+    }
+
+    // Faces before the first o/g go to an unnamed shape, empty shapes are dropped
+    std::vector<size_t> shapeBegins;
+    shapes.clear();
+
+    size_t begin = 0;
+    std::string name;
+    auto addShape = [&](size_t end)
+    {
+        if(end > begin)
+        {
+            shapes.push_back(ObjShape{std::move(name), ObjMesh{std::vector<ObjIndex>(end - begin)}});
+            shapeBegins.push_back(begin);
+        }
+    };
+
+    for(Chunk& chunk : chunks)
+    {
+        for(ShapeStart& start : chunk.shapes)
+        {
+            addShape(chunk.cornerBase + start.corner);
+            begin = chunk.cornerBase + start.corner;
+            name = std::move(start.name);
+        }
+    }
+    addShape(cornerCount);
+
+    attributes.vertices.resize(3 * vertexCount);
+    attributes.normals.resize(3 * normalCount);
+    attributes.texcoords.resize(2 * texcoordCount);
+
+    pool.parallelFor(chunkCount, 1, [&](size_t first, size_t last)
+    {
+        for(size_t k = first; k < last; ++k)
+        {
+            Chunk& chunk = chunks[k];
+
+            copyInto(chunk.vertices, attributes.vertices, 3 * chunk.vertexBase);
+            copyInto(chunk.normals, attributes.normals, 3 * chunk.normalBase);
+            copyInto(chunk.texcoords, attributes.texcoords, 2 * chunk.texcoordBase);
+
+            for(const Fixup& fixup : chunk.fixups)
+            {
+                ObjIndex& corner = chunk.corners[fixup.corner];
+                corner.vertex_index += (fixup.attributes & POSITION) ? static_cast<int>(chunk.vertexBase) : 0;
+                corner.texcoord_index += (fixup.attributes & TEXCOORD) ? static_cast<int>(chunk.texcoordBase) : 0;
+                corner.normal_index += (fixup.attributes & NORMAL) ? static_cast<int>(chunk.normalBase) : 0;
+            }
+
+            // The chunk's corners may span several shapes
+            size_t shape = std::upper_bound(shapeBegins.begin(), shapeBegins.end(), chunk.cornerBase) - shapeBegins.begin() - 1;
+            for(size_t corner = 0; corner < chunk.corners.size(); ++shape)
+            {
+                std::vector<ObjIndex>& indices = shapes[shape].mesh.indices;
+                const size_t offset = chunk.cornerBase + corner - shapeBegins[shape];
+                const size_t count = std::min(chunk.corners.size() - corner, indices.size() - offset);
+
+                std::copy(chunk.corners.begin() + corner, chunk.corners.begin() + corner + count, indices.begin() + offset);
+                corner += count;
+            }
+        }
+    });
+
+    return true;
+}
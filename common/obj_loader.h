@@ -0,0 +1,45 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Wavefront OBJ geometry in the layout tinyobj::LoadObj produced, so the code that walks
+// shapes and attributes did not change: attributes as flat float arrays, faces triangulated
+// into per shape corner lists. Materials, lines and points are not read.
+
+struct ObjIndex
+{
+    // Into attributes, -1 when the corner has no such attribute
+    int vertex_index;
+    int normal_index;
+    int texcoord_index;
+};
+
+struct ObjAttributes
+{
+    std::vector<float> vertices;  // x y z
+    std::vector<float> normals;   // x y z
+    std::vector<float> texcoords; // u v
+};
+
+struct ObjMesh
+{
+    // Three per triangle
+    std::vector<ObjIndex> indices;
+};
+
+// Faces between two o/g records, shapes without faces are dropped
+struct ObjShape
+{
+    std::string name;
+    ObjMesh mesh;
+};
+
+// Maps path and parses it in line aligned chunks on WorkerPool::shared(), the chunks are
+// merged into attributes and shapes sized up front. Polygons become triangle fans.
+// Malformed lines are skipped and counted in errors. Returns false when path cannot be read.
+bool loadObj(const char* path, ObjAttributes& attributes, std::vector<ObjShape>& shapes, size_t& errors) noexcept;
+
+#endif
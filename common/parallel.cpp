@@ -0,0 +1,93 @@
+#include "parallel.h"
+
+WorkerPool::WorkerPool(size_t threads)
+{
+    if(0 == threads)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+
+    for(size_t i = 1; i < threads; ++i)
+    {
+        workers_.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+
+    for(auto& worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+size_t WorkerPool::size() const noexcept
+{
+    return workers_.size() + 1;
+}
+
+WorkerPool& WorkerPool::shared()
+{
+    static WorkerPool pool;
+    return pool;
+}
+
+void WorkerPool::drain() noexcept
+{
+    for(size_t chunk = nextChunk_.fetch_add(1); chunk < chunks_; chunk = nextChunk_.fetch_add(1))
+    {
+        (*task_)(chunk);
+    }
+}
+
+void WorkerPool::run(const std::function<void(size_t)>& task, size_t chunks)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        chunks_ = chunks;
+        nextChunk_ = 0;
+        busy_ = workers_.size();
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    drain();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return 0 == busy_; });
+    task_ = nullptr;
+}
+
+void WorkerPool::workerLoop() noexcept
+{
+    uint64_t seen = 0;
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+
+            if(stop_)
+            {
+                return;
+            }
+            seen = generation_;
+        }
+
+        drain();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(0 == --busy_)
+        {
+            done_.notify_one();
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that split index ranges between themselves and the calling thread
+struct WorkerPool
+{
+    // 0 uses one thread per hardware core, counting the caller
+    explicit WorkerPool(size_t threads = 0);
+
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Threads that take part in parallelFor, including the caller
+    size_t size() const noexcept;
+
+    // Calls fn(begin, end) for consecutive chunks of [0, count) with grain elements each
+    // (the last one may be shorter) and waits for all of them. Chunk boundaries depend
+    // only on count and grain, never on the number of threads.
+    template<typename Fn>
+    void parallelFor(size_t count, size_t grain, Fn&& fn)
+    {
+        if(0 == count)
+        {
+            return;
+        }
+
+        grain = grain > 0 ? grain : 1;
+        const size_t chunks = (count + grain - 1) / grain;
+
+        if(1 == chunks || workers_.empty())
+        {
+            for(size_t begin = 0; begin < count; begin += grain)
+            {
+                fn(begin, begin + grain < count ? begin + grain : count);
+            }
+            return;
+        }
+
+        run([&](size_t chunk)
+            {
+                const size_t begin = chunk * grain;
+                fn(begin, begin + grain < count ? begin + grain : count);
+            },
+            chunks);
+    }
+
+    static WorkerPool& shared();
+
+private:
+
+    void run(const std::function<void(size_t)>& task, size_t chunks);
+
+    void drain() noexcept;
+
+    void workerLoop() noexcept;
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+
+    const std::function<void(size_t)>* task_{nullptr};
+    size_t chunks_{0};
+    std::atomic<size_t> nextChunk_{0};
+    size_t busy_{0};
+    uint64_t generation_{0};
+    bool stop_{false};
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+// Vertex input descriptions built from the member types of a vertex struct. A layout lists
+// its members with VERTEX_ATTRIBUTE, the formats, offsets and locations follow at compile time.
+
+// Storage of packed attributes, the shaders read all of them as floats
+struct Unorm16x4
+{
+    uint16_t value[4]; // [0, 65535] -> [0, 1]
+};
+
+struct Unorm16x2
+{
+    uint16_t value[2]; // [0, 65535] -> [0, 1]
+};
+
+struct Snorm16x2
+{
+    int16_t value[2]; // [-32767, 32767] -> [-1, 1]
+};
+
+struct Unorm8x4
+{
+    uint8_t value[4]; // [0, 255] -> [0, 1]
+};
+
+// Format a member of type T is fetched with. Only formats Vulkan requires for vertex buffers
+// are used, which is why there are no 3 component 16 or 8 bit ones.
+template<typename T>
+struct VertexFormat;
+
+template<> struct VertexFormat<float>     { static constexpr VkFormat value = VK_FORMAT_R32_SFLOAT; };
+template<> struct VertexFormat<glm::vec2> { static constexpr VkFormat value = VK_FORMAT_R32G32_SFLOAT; };
+template<> struct VertexFormat<glm::vec3> { static constexpr VkFormat value = VK_FORMAT_R32G32B32_SFLOAT; };
+template<> struct VertexFormat<glm::vec4> { static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_SFLOAT; };
+template<> struct VertexFormat<Unorm16x4> { static constexpr VkFormat value = VK_FORMAT_R16G16B16A16_UNORM; };
+template<> struct VertexFormat<Unorm16x2> { static constexpr VkFormat value = VK_FORMAT_R16G16_UNORM; };
+template<> struct VertexFormat<Snorm16x2> { static constexpr VkFormat value = VK_FORMAT_R16G16_SNORM; };
+template<> struct VertexFormat<Unorm8x4>  { static constexpr VkFormat value = VK_FORMAT_R8G8B8A8_UNORM; };
+
+struct VertexAttribute
+{
+    uint32_t offset;
+    VkFormat format;
+};
+
+#define VERTEX_ATTRIBUTE(vertex, member) \
+    VertexAttribute{static_cast<uint32_t>(offsetof(vertex, member)), VertexFormat<decltype(vertex::member)>::value}
+
+// One description per attribute on binding 0, at locations 0, 1, ... in the order listed
+template<typename... Attributes>
+constexpr std::array<VkVertexInputAttributeDescription, sizeof...(Attributes)>
+makeAttributeDescriptions(const Attributes&... attributes) noexcept
+{
+    const VertexAttribute listed[] = {attributes...};
+    std::array<VkVertexInputAttributeDescription, sizeof...(Attributes)> descriptions{};
+
+    for(uint32_t i = 0; i < descriptions.size(); ++i)
+    {
+        descriptions[i].binding  = 0;
+        descriptions[i].location = i;
+        descriptions[i].format   = listed[i].format;
+        descriptions[i].offset   = listed[i].offset;
+    }
+
+    return descriptions;
+}
+
+template<typename V>
+constexpr VkVertexInputBindingDescription makeBindingDescription() noexcept
+{
+    VkVertexInputBindingDescription description{};
+    description.binding = 0;
+    description.stride = sizeof(V);
+    description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return description;
+}
+
+#endif
@@ -0,0 +1,274 @@
+#include "weld.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Corners per block of the parallel passes
+static constexpr size_t BLOCK_CORNERS = 1 << 16;
+
+// Shards per thread, so a thread whose shards got the crowded vertices does not hold up the rest
+static constexpr size_t SHARDS_PER_THREAD = 4;
+
+static constexpr uint32_t EMPTY = UINT32_MAX;
+
+namespace
+{
+
+// Open addressing slot, corner is the first corner of the vertex
+struct Slot
+{
+    uint32_t tag;
+    uint32_t corner;
+};
+
+// Linear probing table sized for every corner being distinct at a load of at most 2/3
+struct Table
+{
+    explicit Table(size_t corners)
+    {
+        size_t capacity = 16;
+        while(capacity < corners + corners / 2)
+        {
+            capacity *= 2;
+        }
+
+        slots.assign(capacity, Slot{0, EMPTY});
+        mask = capacity - 1;
+    }
+
+    // First corner with the same vertex as corner, corner itself when there is none yet
+    uint32_t insert(const float* corners, size_t floatsPerVertex, uint32_t corner, uint64_t hash) noexcept;
+
+    std::vector<Slot> slots;
+    size_t mask;
+};
+
+}
+
+static inline uint64_t rotl(uint64_t x, int r) noexcept
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// Hash of the float bits with -0 folded into 0 so it agrees with ==. Four independent lanes
+// without a dependency between consecutive words, the compiler keeps them in vector registers.
+static uint64_t hashVertex(const float* vertex, size_t floatsPerVertex) noexcept
+{
+    static constexpr uint64_t PRIME1 = 0x9e3779b185ebca87ull;
+    static constexpr uint64_t PRIME2 = 0xc2b2ae3d27d4eb4full;
+
+    uint64_t lanes[4] = {PRIME1, PRIME2, 0, ~PRIME1};
+
+    for(size_t k = 0; k < floatsPerVertex; ++k)
+    {
+        uint32_t bits;
+        memcpy(&bits, vertex + k, sizeof(bits));
+        bits = (bits & 0x7fffffffu) ? bits : 0;
+
+        uint64_t& lane = lanes[k & 3];
+        lane = rotl(lane + bits * PRIME2, 31) * PRIME1;
+    }
+
+    uint64_t hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+
+    // Final avalanche, the slot comes from the low bits and the shard from the high ones
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static inline bool equalVertices(const float* a, const float* b, size_t floatsPerVertex) noexcept
+{
+    for(size_t k = 0; k < floatsPerVertex; ++k)
+    {
+        if(!(a[k] == b[k]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t Table::insert(const float* corners, size_t floatsPerVertex, uint32_t corner, uint64_t hash) noexcept
+{
+    const float* vertex = corners + corner * floatsPerVertex;
+    const uint32_t tag = static_cast<uint32_t>(hash);
+
+    for(size_t pos = hash & mask;; pos = (pos + 1) & mask)
+    {
+        Slot& slot = slots[pos];
+
+        if(EMPTY == slot.corner)
+        {
+            slot = Slot{tag, corner};
+            return corner;
+        }
+
+        if(tag == slot.tag && equalVertices(vertex, corners + slot.corner * floatsPerVertex, floatsPerVertex))
+        {
+            return slot.corner;
+        }
+    }
+}
+
+static void weldSerial(const float* corners, size_t floatsPerVertex, size_t count,
+                       std::vector<uint32_t>& indices, std::vector<uint32_t>& firstCorners) noexcept
+{
+    Table table(count);
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        const uint32_t corner = static_cast<uint32_t>(i);
+        const uint32_t first = table.insert(corners, floatsPerVertex, corner, hashVertex(corners + i * floatsPerVertex, floatsPerVertex));
+
+        if(first == corner)
+        {
+            indices[i] = static_cast<uint32_t>(firstCorners.size());
+            firstCorners.push_back(corner);
+        }
+        else
+        {
+            // The first corner comes earlier, so its index is already written
+            indices[i] = indices[first];
+        }
+    }
+}
+
+// Equal vertices hash equally and so land in the same shard, every shard finds the first
+// corner of each of its corners on its own. Numbering the corners that are their own first
+// one in corner order then reproduces the serial numbering.
+static void weldSharded(WorkerPool& pool, const float* corners, size_t floatsPerVertex, size_t count,
+                        std::vector<uint32_t>& indices, std::vector<uint32_t>& firstCorners) noexcept
+{
+    size_t shardBits = 0;
+    while((size_t(1) << shardBits) < pool.size() * SHARDS_PER_THREAD)
+    {
+        ++shardBits;
+    }
+
+    const size_t shards = size_t(1) << shardBits;
+    const size_t blocks = (count + BLOCK_CORNERS - 1) / BLOCK_CORNERS;
+
+    auto shardOf = [shardBits](uint64_t hash)
+    {
+        return static_cast<size_t>(hash >> (63 - shardBits) >> 1);
+    };
+
+    std::vector<uint64_t> hashes(count);
+    std::vector<uint32_t> offsets(blocks * shards, 0);
+
+    pool.parallelFor(count, BLOCK_CORNERS, [&](size_t begin, size_t end)
+    {
+        uint32_t* blockCounts = &offsets[begin / BLOCK_CORNERS * shards];
+        for(size_t i = begin; i < end; ++i)
+        {
+            hashes[i] = hashVertex(corners + i * floatsPerVertex, floatsPerVertex);
+            ++blockCounts[shardOf(hashes[i])];
+        }
+    });
+
+    // Shard major, so the corners of a shard are contiguous and in corner order
+    std::vector<uint32_t> shardBegins(shards + 1);
+    uint32_t total = 0;
+    for(size_t s = 0; s < shards; ++s)
+    {
+        shardBegins[s] = total;
+        for(size_t b = 0; b < blocks; ++b)
+        {
+            const uint32_t blockCount = offsets[b * shards + s];
+            offsets[b * shards + s] = total;
+            total += blockCount;
+        }
+    }
+    shardBegins[shards] = total;
+
+    std::vector<uint32_t> order(count);
+    pool.parallelFor(count, BLOCK_CORNERS, [&](size_t begin, size_t end)
+    {
+        uint32_t* next = &offsets[begin / BLOCK_CORNERS * shards];
+        for(size_t i = begin; i < end; ++i)
+        {
+            order[next[shardOf(hashes[i])]++] = static_cast<uint32_t>(i);
+        }
+    });
+
+    // first corner of every corner, kept in indices until the vertices are numbered
+    pool.parallelFor(shards, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t s = begin; s < end; ++s)
+        {
+            Table table(shardBegins[s + 1] - shardBegins[s]);
+            for(uint32_t k = shardBegins[s]; k < shardBegins[s + 1]; ++k)
+            {
+                const uint32_t corner = order[k];
+                indices[corner] = table.insert(corners, floatsPerVertex, corner, hashes[corner]);
+            }
+        }
+    });
+
+    std::vector<uint64_t>().swap(hashes);
+
+    // Vertex of every first corner, reusing order
+    std::vector<uint32_t>& vertexOf = order;
+    std::vector<uint32_t> blockVertices(blocks + 1, 0);
+
+    pool.parallelFor(count, BLOCK_CORNERS, [&](size_t begin, size_t end)
+    {
+        uint32_t distinct = 0;
+        for(size_t i = begin; i < end; ++i)
+        {
+            distinct += indices[i] == i ? 1 : 0;
+        }
+        blockVertices[begin / BLOCK_CORNERS + 1] = distinct;
+    });
+
+    for(size_t b = 0; b < blocks; ++b)
+    {
+        blockVertices[b + 1] += blockVertices[b];
+    }
+
+    firstCorners.resize(blockVertices[blocks]);
+
+    pool.parallelFor(count, BLOCK_CORNERS, [&](size_t begin, size_t end)
+    {
+        uint32_t vertex = blockVertices[begin / BLOCK_CORNERS];
+        for(size_t i = begin; i < end; ++i)
+        {
+            if(indices[i] == i)
+            {
+                vertexOf[i] = vertex;
+                firstCorners[vertex++] = static_cast<uint32_t>(i);
+            }
+        }
+    });
+
+    pool.parallelFor(count, BLOCK_CORNERS, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+        {
+            indices[i] = vertexOf[indices[i]];
+        }
+    });
+}
+
+void weldCorners(const float* corners, size_t floatsPerVertex, size_t count,
+                 std::vector<uint32_t>& indices, std::vector<uint32_t>& firstCorners) noexcept
+{
+    indices.resize(count);
+    firstCorners.clear();
+
+    // Sharding pays off even on a single thread, the per shard tables and streaming passes
+    // miss the cache less than one table over every corner
+    if(count < WELD_SHARDED_MIN_CORNERS)
+    {
+        weldSerial(corners, floatsPerVertex, count, indices, firstCorners);
+    }
+    else
+    {
+        weldSharded(WorkerPool::shared(), corners, floatsPerVertex, count, indices, firstCorners);
+    }
+}
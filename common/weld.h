@@ -0,0 +1,49 @@
+#ifndef WELD_H
+#define WELD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Meshes with fewer corners are welded on the calling thread through a single table
+static constexpr size_t WELD_SHARDED_MIN_CORNERS = 1 << 18;
+
+// Finds the corners that share a vertex. corners holds count vertices of floatsPerVertex
+// floats each, compared float by float with == like the glm operators, so -0 equals 0 and
+// a NaN vertex never equals anything. indices[i] becomes the vertex of corner i and
+// firstCorners[v] the corner vertex v is taken from. Vertices are numbered in the order of
+// their first corner, the numbering inserting the corners one by one into a hash map gives,
+// whether the table is built on one thread or sharded over WorkerPool::shared().
+void weldCorners(const float* corners, size_t floatsPerVertex, size_t count,
+                 std::vector<uint32_t>& indices, std::vector<uint32_t>& firstCorners) noexcept;
+
+// Appends the distinct vertices of corners to vertices and the index of every corner to indices
+template<typename V>
+void weldVertices(const std::vector<V>& corners, std::vector<V>& vertices, std::vector<uint32_t>& indices) noexcept
+{
+    static_assert(std::is_trivially_copyable_v<V> && 0 == sizeof(V) % sizeof(float),
+                  "weldVertices compares vertices as a run of floats");
+
+    std::vector<uint32_t> cornerIndices;
+    std::vector<uint32_t> firstCorners;
+    weldCorners(reinterpret_cast<const float*>(corners.data()), sizeof(V) / sizeof(float), corners.size(),
+                cornerIndices, firstCorners);
+
+    const uint32_t base = static_cast<uint32_t>(vertices.size());
+
+    vertices.resize(base + firstCorners.size());
+    for(size_t v = 0; v < firstCorners.size(); ++v)
+    {
+        vertices[base + v] = corners[firstCorners[v]];
+    }
+
+    const size_t indexBase = indices.size();
+    indices.resize(indexBase + cornerIndices.size());
+    for(size_t i = 0; i < cornerIndices.size(); ++i)
+    {
+        indices[indexBase + i] = base + cornerIndices[i];
+    }
+}
+
+#endif
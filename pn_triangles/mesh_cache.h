@@ -0,0 +1,354 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "mapped_file.h"
+#include "parallel.h"
+#include "vertex.h"
+
+// Welded and optimized mesh of a model file in a .mvkmesh next to it, so later starts skip
+// parsing, welding and optimizing and copy the vertex and index blobs straight out of the
+// mapping:
+//
+//   MeshCacheHeader
+//   vertices  (vertex_count * sizeof(GpuVertex) at vertex_offset)
+//   indices   (index_count * uint32_t at index_offset)
+//
+// Blobs start at multiples of BLOB_ALIGNMENT. The cache belongs to the size and write time of
+// the source file it was built from and is rebuilt when either changed. The bounds are those of
+// the full precision positions, PackedVertex positions are relative to them.
+
+// Bump whenever GpuVertex, the packing, the welding or the mesh optimization changes, older
+// caches are then rebuilt. A cache of the other PN_PACKED_VERTICES layout fails the stride check.
+constexpr uint32_t MESH_CACHE_VERSION = 3;
+
+struct MeshCacheHeader
+{
+	static constexpr char MAGIC[4] = { 'M', 'V', 'K', 'M' };
+	static constexpr uint64_t BLOB_ALIGNMENT = 64;
+
+	char magic[4];
+	uint32_t version;
+	uint32_t vertex_stride;
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t reserved;
+	uint64_t source_size;
+	int64_t source_time;
+	// Of the vertex blob followed by the index blob, see mesh_cache_detail::CopyAndHash
+	uint64_t content_hash;
+	uint64_t vertex_offset;
+	uint64_t index_offset;
+	float bounds_min[3];
+	float bounds_max[3];
+};
+
+namespace mesh_cache_detail
+{
+	// Blobs are copied and hashed in blocks of this size, one block per worker task.
+	// It is part of the format since the content hash combines the hashes of the blocks.
+	constexpr size_t BLOCK_BYTES = 1 << 18;
+
+	inline uint64_t Rotl(uint64_t x, int r) noexcept
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t Mix(uint64_t hash) noexcept
+	{
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdull;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53ull;
+		hash ^= hash >> 33;
+		return hash;
+	}
+
+	// Four independent lanes over 8 byte words, the tail is folded in byte by byte
+	inline uint64_t HashBlock(const char* data, size_t size) noexcept
+	{
+		constexpr uint64_t PRIME1 = 0x9e3779b185ebca87ull;
+		constexpr uint64_t PRIME2 = 0xc2b2ae3d27d4eb4full;
+
+		uint64_t lanes[4] = { PRIME1, PRIME2, 0, ~PRIME1 };
+
+		size_t offset = 0;
+		for (; offset + 32 <= size; offset += 32)
+		{
+			for (int k = 0; k < 4; ++k)
+			{
+				uint64_t word;
+				memcpy(&word, data + offset + 8 * k, sizeof(word));
+				lanes[k] = Rotl(lanes[k] + word * PRIME2, 31) * PRIME1;
+			}
+		}
+
+		uint64_t hash = Rotl(lanes[0], 1) + Rotl(lanes[1], 7) + Rotl(lanes[2], 12) + Rotl(lanes[3], 18) + size;
+		for (; offset < size; ++offset)
+		{
+			hash = (hash ^ static_cast<unsigned char>(data[offset])) * PRIME1;
+		}
+
+		return Mix(hash);
+	}
+
+	struct Blob
+	{
+		const char* src;
+		char* dst;
+		size_t size;
+	};
+
+	// Copies every blob to its dst (when not null) and returns their combined hash. The
+	// blocks are copied in parallel and hashed while they are still in the cache.
+	inline uint64_t CopyAndHash(const Blob* blobs, size_t blob_count) noexcept
+	{
+		struct Block
+		{
+			const Blob* blob;
+			size_t offset;
+		};
+
+		std::vector<Block> blocks;
+		for (size_t b = 0; b < blob_count; ++b)
+		{
+			for (size_t offset = 0; offset < blobs[b].size; offset += BLOCK_BYTES)
+			{
+				blocks.push_back(Block{ blobs + b, offset });
+			}
+		}
+
+		std::vector<uint64_t> block_hashes(blocks.size());
+		WorkerPool::shared().parallelFor(blocks.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t k = begin; k < end; ++k)
+			{
+				const Block& block = blocks[k];
+				const char* src = block.blob->src + block.offset;
+				const size_t size = std::min(BLOCK_BYTES, block.blob->size - block.offset);
+
+				if (block.blob->dst)
+				{
+					memcpy(block.blob->dst + block.offset, src, size);
+				}
+				block_hashes[k] = HashBlock(src, size);
+			}
+		});
+
+		uint64_t hash = MESH_CACHE_VERSION;
+		for (uint64_t block_hash : block_hashes)
+		{
+			hash = Mix(hash ^ block_hash);
+		}
+		return hash;
+	}
+
+	inline uint64_t AlignUp(uint64_t offset) noexcept
+	{
+		return (offset + MeshCacheHeader::BLOB_ALIGNMENT - 1) & ~(MeshCacheHeader::BLOB_ALIGNMENT - 1);
+	}
+}
+
+// Size and write time of the source file, what a cache is checked against
+struct MeshSourceStamp
+{
+	uint64_t size{ 0 };
+	int64_t time{ 0 };
+
+	static bool Of(const char* path, MeshSourceStamp& stamp) noexcept
+	{
+		std::error_code error;
+		const auto size = std::filesystem::file_size(path, error);
+		if (error)
+		{
+			return false;
+		}
+
+		const auto time = std::filesystem::last_write_time(path, error);
+		if (error)
+		{
+			return false;
+		}
+
+		stamp.size = static_cast<uint64_t>(size);
+		stamp.time = static_cast<int64_t>(time.time_since_epoch().count());
+		return true;
+	}
+};
+
+class MeshCache
+{
+public:
+	static std::string PathFor(const char* model_path)
+	{
+		return std::string(model_path) + ".mvkmesh";
+	}
+
+	// Maps the cache at path, false when it is missing, damaged or does not belong to source
+	bool Open(const char* path, const MeshSourceStamp& source) noexcept
+	{
+		Close();
+
+		if (!file_.open(path) || file_.size() < sizeof(MeshCacheHeader))
+		{
+			Close();
+			return false;
+		}
+
+		memcpy(&header_, file_.data(), sizeof(header_));
+
+		const uint64_t vertex_bytes = uint64_t(header_.vertex_count) * sizeof(GpuVertex);
+		const uint64_t index_bytes = uint64_t(header_.index_count) * sizeof(uint32_t);
+
+		const bool valid =
+			0 == memcmp(header_.magic, MeshCacheHeader::MAGIC, sizeof(header_.magic)) &&
+			MESH_CACHE_VERSION == header_.version &&
+			sizeof(GpuVertex) == header_.vertex_stride &&
+			source.size == header_.source_size &&
+			source.time == header_.source_time &&
+			0 == header_.vertex_offset % MeshCacheHeader::BLOB_ALIGNMENT &&
+			0 == header_.index_offset % MeshCacheHeader::BLOB_ALIGNMENT &&
+			header_.vertex_offset >= sizeof(MeshCacheHeader) &&
+			header_.vertex_offset <= header_.index_offset &&
+			header_.index_offset <= file_.size() &&
+			vertex_bytes <= header_.index_offset - header_.vertex_offset &&
+			index_bytes <= file_.size() - header_.index_offset;
+
+		if (!valid)
+		{
+			Close();
+		}
+		return valid;
+	}
+
+	void Close() noexcept
+	{
+		file_.close();
+		header_ = MeshCacheHeader{};
+	}
+
+	[[nodiscard]]
+	bool IsOpen() const noexcept
+	{
+		return file_.isOpen();
+	}
+
+	[[nodiscard]]
+	const MeshCacheHeader& Header() const noexcept
+	{
+		return header_;
+	}
+
+	[[nodiscard]]
+	VertexBounds Bounds() const noexcept
+	{
+		VertexBounds bounds{};
+		memcpy(&bounds.min, header_.bounds_min, sizeof(header_.bounds_min));
+		memcpy(&bounds.max, header_.bounds_max, sizeof(header_.bounds_max));
+		return bounds;
+	}
+
+	[[nodiscard]]
+	size_t VertexBytes() const noexcept
+	{
+		return size_t(header_.vertex_count) * sizeof(GpuVertex);
+	}
+
+	[[nodiscard]]
+	size_t IndexBytes() const noexcept
+	{
+		return size_t(header_.index_count) * sizeof(uint32_t);
+	}
+
+	// Copies the blobs to vertices and indices, VertexBytes() and IndexBytes() each, and checks
+	// the content hash on the way. False means the cache was damaged and dst holds garbage.
+	bool CopyTo(void* vertices, void* indices) const noexcept
+	{
+		using namespace mesh_cache_detail;
+
+		const Blob blobs[2] =
+		{
+			{ file_.data() + header_.vertex_offset, static_cast<char*>(vertices), VertexBytes() },
+			{ file_.data() + header_.index_offset, static_cast<char*>(indices), IndexBytes() }
+		};
+
+		return CopyAndHash(blobs, 2) == header_.content_hash;
+	}
+
+	// Writes the cache through a temporary file renamed over path, so a reader never sees a
+	// partial one. False when it could not be written, which only costs the next start time.
+	static bool Write(const char* path,
+					  const MeshSourceStamp& source,
+					  const std::vector<GpuVertex>& vertices,
+					  const std::vector<uint32_t>& indices,
+					  const VertexBounds& bounds) noexcept
+	{
+		using namespace mesh_cache_detail;
+
+		MeshCacheHeader header{};
+		memcpy(header.magic, MeshCacheHeader::MAGIC, sizeof(header.magic));
+		header.version = MESH_CACHE_VERSION;
+		header.vertex_stride = sizeof(GpuVertex);
+		header.vertex_count = static_cast<uint32_t>(vertices.size());
+		header.index_count = static_cast<uint32_t>(indices.size());
+		header.source_size = source.size;
+		header.source_time = source.time;
+		header.vertex_offset = AlignUp(sizeof(MeshCacheHeader));
+		header.index_offset = AlignUp(header.vertex_offset + vertices.size() * sizeof(GpuVertex));
+		memcpy(header.bounds_min, &bounds.min, sizeof(header.bounds_min));
+		memcpy(header.bounds_max, &bounds.max, sizeof(header.bounds_max));
+
+		const Blob blobs[2] =
+		{
+			{ reinterpret_cast<const char*>(vertices.data()), nullptr, vertices.size() * sizeof(GpuVertex) },
+			{ reinterpret_cast<const char*>(indices.data()), nullptr, indices.size() * sizeof(uint32_t) }
+		};
+		header.content_hash = CopyAndHash(blobs, 2);
+
+		const std::string temp_path = std::string(path) + ".tmp";
+		FILE* file = fopen(temp_path.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+
+		static constexpr char PADDING[MeshCacheHeader::BLOB_ALIGNMENT]{};
+		auto write = [file](const void* data, size_t size)
+		{
+			return size == fwrite(data, 1, size, file);
+		};
+
+		bool ok = write(&header, sizeof(header));
+		ok = ok && write(PADDING, header.vertex_offset - sizeof(header));
+		ok = ok && write(blobs[0].src, blobs[0].size);
+		ok = ok && write(PADDING, header.index_offset - header.vertex_offset - blobs[0].size);
+		ok = ok && write(blobs[1].src, blobs[1].size);
+		ok = (0 == fclose(file)) && ok;
+
+		std::error_code error;
+		if (ok)
+		{
+			std::filesystem::rename(temp_path, path, error);
+		}
+		if (!ok || error)
+		{
+			std::filesystem::remove(temp_path, error);
+			return false;
+		}
+		return true;
+	}
+
+private:
+	MappedFile file_{};
+	MeshCacheHeader header_{};
+};
+
+#endif // MESH_CACHE_H
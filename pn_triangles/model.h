@@ -1,42 +1,37 @@
 #ifndef MODEL_H
 #define MODEL_H
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#include "obj_loader.h"
 
+#include <cstdio>
+#include <cstdlib>
 #include <vector>
-#include <string>
 
-using Attributes = tinyobj::attrib_t;
-using Shape = tinyobj::shape_t;
-using Material = tinyobj::material_t;
+using Attributes = ObjAttributes;
+using Shape = ObjShape;
 
 struct Model
 {
 
     Attributes attributes;
     std::vector<Shape> shapes;
-    std::vector<Material> materials;
 
 	static Model Load(const char* path) noexcept
 	{
-        std::string err;
-        std::string warn;
-
         Model model{};
 
-        if (!tinyobj::LoadObj(&model.attributes,
-            &model.shapes,
-            &model.materials,
-            &warn,
-            &err,
-            path))
+        size_t errors = 0;
+        if (!loadObj(path, model.attributes, model.shapes, errors))
         {
-            fprintf(stderr, "Object loading - WARN  - %s", warn.c_str());
-            fprintf(stderr, "Object loading - ERROR - %s", err.c_str());
+            fprintf(stderr, "Object loading - ERROR - cannot read %s\n", path);
             abort();
         }
 
+        if (errors > 0)
+        {
+            fprintf(stderr, "Object loading - WARN  - %zu malformed lines skipped in %s\n", errors, path);
+        }
+
         return model;
 	}
 
@@ -127,6 +127,15 @@ namespace mvk
                 vkCmdBindDescriptorSets(cmd_buffer_, bind_point, layout, first_set, set_count, sets, dynamic_off_count, dynamic_offs);
     		}
 
+    		void PushConstants(VkPipelineLayout layout,
+							   const VkShaderStageFlags stages,
+							   const void* data,
+							   const uint32_t size,
+							   const uint32_t offset = 0) const noexcept
+    		{
+                vkCmdPushConstants(cmd_buffer_, layout, stages, offset, size, data);
+    		}
+
     		void BindVertexBuffers(Buffer* buffers,
 								   const uint32_t buff_count = 1,
 								   const uint32_t first_bind = 0,
@@ -9,8 +9,11 @@
 #include <glm/gtx/string_cast.hpp>
 
 
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
 #include "model.h"
 #include "vertex.h"
+#include "weld.h"
 #include "mvk/camera.h"
 
 struct PNTriangledObject
@@ -59,9 +62,12 @@ private:
 
 	void InitFramebuffers() noexcept;
 	
-	void LoadMesh(const Model& model) noexcept;
+	void LoadModel(const char* model_path, bool use_cache = true) noexcept;
+
+	void LoadMesh(const Model& model, std::vector<Vertex>& vertices) noexcept;
 	
-	void InitBuffers() noexcept;
+	[[nodiscard]]
+	bool InitBuffers() noexcept;
 	
 	void InitUniforms() noexcept;
 	
@@ -106,8 +112,12 @@ private:
 	std::vector<mvk::CommandBuffer> command_buffers_{};
 	bool wireframe_enabled_{ false };
 
-	std::vector<Vertex> vertices_{};
+	// The welded mesh until InitBuffers uploads it, either in the vectors or in the open cache
+	std::vector<GpuVertex> vertices_{};
 	std::vector<uint32_t> indices_{};
+	MeshCache mesh_cache_{};
+	uint32_t index_count_{ 0 };
+	VertexDequantization dequantization_{};
 
 	struct UniformTes
 	{
@@ -164,10 +174,13 @@ void PNTriangleApp::Run(int width, int height, const char* model_path) noexcept
 	InitCommandPools();
 
 	//static constexpr const char* MODEL_LOCATION = "D:/FER/diplomski/3.semestar/RG/labosi/lab3/Lab3/models/teddy.obj";
-	const Model model = Model::Load(model_path);
-	LoadMesh(model);
-	
-	InitBuffers();
+	LoadModel(model_path);
+	if (!InitBuffers())
+	{
+		// The cache was damaged, the mesh comes from the model file again and replaces it
+		LoadModel(model_path, false);
+		MVK_CHECK_FATAL(InitBuffers(), "PNTriangleApp::Run - Failed to upload the mesh");
+	}
 
 	InitUniforms();
 	InitDescriptorSets();
@@ -384,12 +397,12 @@ void PNTriangleApp::InitPipelines() noexcept
 	VkShaderModule tcs_shader = context_.device.CreateShaderModule(TESSELLATION_CONTROL_SHADER_LOCATION);
 	VkShaderModule tes_shader = context_.device.CreateShaderModule(TESSELLATION_EVALUATION_SHADER_LOCATION);
 
-	const std::array<VkPipelineShaderStageCreateInfo, 2> base_shaders
+	std::array<VkPipelineShaderStageCreateInfo, 2> base_shaders
 	{
 		mvk::pipe::NewShaderStage(mvk::ShaderStage::Vertex, vert_shader),
 		mvk::pipe::NewShaderStage(mvk::ShaderStage::Fragment, frag_shader)
 	};
-	const std::array<VkPipelineShaderStageCreateInfo, 4> pn_shaders
+	std::array<VkPipelineShaderStageCreateInfo, 4> pn_shaders
 	{
 		mvk::pipe::NewShaderStage(mvk::ShaderStage::Vertex, pn_vert_shader),
 		mvk::pipe::NewShaderStage(mvk::ShaderStage::TessellationControl, tcs_shader),
@@ -397,8 +410,21 @@ void PNTriangleApp::InitPipelines() noexcept
 		mvk::pipe::NewShaderStage(mvk::ShaderStage::Fragment, frag_shader)
 	};
 
-	const auto attribute_description = Vertex::GetAtributeDescriptions();
-	const VkVertexInputBindingDescription binding_description = Vertex::GetBindingDescription();
+	// PACKED_NORMALS of the vertex shaders, whether in_normal is octahedral
+	const VkBool32 packed_normals = PN_PACKED_VERTICES ? VK_TRUE : VK_FALSE;
+	const VkSpecializationMapEntry packed_normals_entry{ 0, 0, sizeof(packed_normals) };
+
+	VkSpecializationInfo vertex_specialization{};
+	vertex_specialization.mapEntryCount = 1;
+	vertex_specialization.pMapEntries = &packed_normals_entry;
+	vertex_specialization.dataSize = sizeof(packed_normals);
+	vertex_specialization.pData = &packed_normals;
+
+	base_shaders[0].pSpecializationInfo = &vertex_specialization;
+	pn_shaders[0].pSpecializationInfo = &vertex_specialization;
+
+	constexpr auto attribute_description = GpuVertex::GetAtributeDescriptions();
+	constexpr VkVertexInputBindingDescription binding_description = GpuVertex::GetBindingDescription();
 
 	VkPipelineVertexInputStateCreateInfo vertex_input{ mvk::pipe::NewVertexInput() };
 
@@ -462,9 +488,14 @@ void PNTriangleApp::InitPipelines() noexcept
 	dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_enables.size());
 	dynamic_state.pDynamicStates = dynamic_enables.data();
 
+	// VertexDequantization of the mesh, both pipelines read positions through it
+	const VkPushConstantRange dequantization_range{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VertexDequantization) };
+
 	VkPipelineLayoutCreateInfo layout_info{ mvk::pipe::NewLayout() };
 	layout_info.setLayoutCount = 1;
 	layout_info.pSetLayouts = &base_object_.descriptor_set_layout;
+	layout_info.pushConstantRangeCount = 1;
+	layout_info.pPushConstantRanges = &dequantization_range;
 
 	base_object_.layout = context_.device.CreatePipelineLayout(layout_info);
 
@@ -549,9 +580,52 @@ void PNTriangleApp::InitFramebuffers() noexcept
 	}
 }
 
-void PNTriangleApp::LoadMesh(const Model& model) noexcept
+void PNTriangleApp::LoadModel(const char* model_path, bool use_cache) noexcept
 {
-	std::unordered_map<Vertex, uint32_t> unique_vertices{};
+	const std::string cache_path = MeshCache::PathFor(model_path);
+
+	MeshSourceStamp source{};
+	const bool has_source = MeshSourceStamp::Of(model_path, source);
+
+	if (use_cache && has_source && mesh_cache_.Open(cache_path.c_str(), source))
+	{
+		index_count_ = mesh_cache_.Header().index_count;
+		dequantization_ = GpuVertex::Dequantization(mesh_cache_.Bounds());
+		return;
+	}
+
+	const Model model = Model::Load(model_path);
+	std::vector<Vertex> vertices{};
+	LoadMesh(model, vertices);
+	index_count_ = static_cast<uint32_t>(indices_.size());
+
+	// Once per model file, the cache keeps the optimized order
+	const MeshOptimizationStats stats = optimizeMesh(vertices, indices_);
+	printf("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (FIFO cache of %u)\n",
+		model_path, stats.before.acmr, stats.after.acmr, stats.before.atvr, stats.after.atvr, VERTEX_CACHE_SIZE);
+
+	// Welding and optimizing compare full precision vertices, only the upload is packed
+	const VertexBounds bounds = BoundsOf(vertices);
+	PackVertices(vertices, bounds, vertices_);
+	dequantization_ = GpuVertex::Dequantization(bounds);
+
+	if (!has_source || !MeshCache::Write(cache_path.c_str(), source, vertices_, indices_, bounds))
+	{
+		fprintf(stderr, "Mesh cache - WARN  - cannot write %s\n", cache_path.c_str());
+	}
+}
+
+void PNTriangleApp::LoadMesh(const Model& model, std::vector<Vertex>& vertices) noexcept
+{
+	size_t corner_count = 0;
+	for (const auto& shape : model.shapes)
+	{
+		corner_count += shape.mesh.indices.size();
+	}
+
+	std::vector<Vertex> corners{};
+	corners.reserve(corner_count);
+
 	for (const auto& shape : model.shapes)
 	{
 		for (const auto& index : shape.mesh.indices)
@@ -587,30 +661,28 @@ void PNTriangleApp::LoadMesh(const Model& model) noexcept
 
 			//vertex.color = { 1.0f, 1.0f, 1.0f };
 
-			const auto [emplace_it, emplace_happened] = unique_vertices.try_emplace(vertex, static_cast<uint32_t>(vertices_.size()));
-			if (emplace_happened)
-			{
-				vertices_.emplace_back(std::move(vertex));
-			}
-			indices_.emplace_back(emplace_it->second);
+			corners.push_back(vertex);
 
 		}
 	}
+
+	weldVertices(corners, vertices, indices_);
 }
 
-void PNTriangleApp::InitBuffers() noexcept
+bool PNTriangleApp::InitBuffers() noexcept
 {	
-	mvk::CommandBuffer transfer_cmd_buffer{};
-	context_.device.CreateCommandBuffers(transfer_command_pool_, &transfer_cmd_buffer, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	const bool from_cache = mesh_cache_.IsOpen();
+	const size_t vertex_bytes = from_cache ? mesh_cache_.VertexBytes() : sizeof(GpuVertex) * vertices_.size();
+	const size_t index_bytes = from_cache ? mesh_cache_.IndexBytes() : sizeof(uint32_t) * indices_.size();
 
 	mvk::BufferUsageFlags usages{ mvk::BufferUsage::TransferDst, mvk::BufferUsage::Vertex };
 
-	auto vertex_buffer_info = mvk::Buffer::CreateInfo(sizeof(Vertex) * vertices_.size(), usages);
+	auto vertex_buffer_info = mvk::Buffer::CreateInfo(vertex_bytes, usages);
 	auto alloc_info = mvk::Allocation::CreateInfo(VMA_MEMORY_USAGE_GPU_ONLY, mvk::DeviceMemoryProperty::DeviceLocal);
 	context_.device.CreateBuffer(vert_buffer_, vert_alloc_, vertex_buffer_info, alloc_info);
 
 	usages = { mvk::BufferUsage::TransferDst, mvk::BufferUsage::Index };
-	auto index_buffer_info = mvk::Buffer::CreateInfo(sizeof(uint32_t) * indices_.size(), usages);
+	auto index_buffer_info = mvk::Buffer::CreateInfo(index_bytes, usages);
 
 	
 	context_.device.CreateBuffer(index_buffer_, index_alloc_, index_buffer_info, alloc_info);
@@ -627,11 +699,37 @@ void PNTriangleApp::InitBuffers() noexcept
 	
 	mvk::AllocObj<mvk::Buffer> transfer_buff = context_.device.CreateBuffer(transfer_buffer_info, transfer_buffer_alloc_info);
 	
-	MVK_CHECK_FATAL(transfer_buff.Fill(vertices_.data(), vertex_buffer_info.size, 0),
-		"PNTriangleApp::InitBuffers - Failed to fill transfer buffer with vertex data");
-	
-	MVK_CHECK_FATAL(transfer_buff.Fill(indices_.data(), index_buffer_info.size, vertex_buffer_info.size),
-		"App::InitBuffers - Failed to fill transfer buffer with index data");
+	if (from_cache)
+	{
+		// Straight from the mapping into the transfer buffer, the content hash is checked on the way
+		char* staging = static_cast<char*>(transfer_buff.allocation.alloc_info.pMappedData);
+		const bool intact = mesh_cache_.CopyTo(staging, staging + vertex_buffer_info.size);
+		mesh_cache_.Close();
+
+		if (!intact)
+		{
+			fprintf(stderr, "Mesh cache - WARN  - content hash mismatch, rebuilding\n");
+			context_.device.DestroyBuffer(transfer_buff.object, transfer_buff.allocation);
+			context_.device.DestroyBuffer(vert_buffer_, vert_alloc_);
+			context_.device.DestroyBuffer(index_buffer_, index_alloc_);
+			return false;
+		}
+	}
+	else
+	{
+		MVK_CHECK_FATAL(transfer_buff.Fill(vertices_.data(), vertex_buffer_info.size, 0),
+			"PNTriangleApp::InitBuffers - Failed to fill transfer buffer with vertex data");
+		
+		MVK_CHECK_FATAL(transfer_buff.Fill(indices_.data(), index_buffer_info.size, vertex_buffer_info.size),
+			"App::InitBuffers - Failed to fill transfer buffer with index data");
+
+		// Only the GPU copies are used from here on
+		std::vector<GpuVertex>().swap(vertices_);
+		std::vector<uint32_t>().swap(indices_);
+	}
+
+	mvk::CommandBuffer transfer_cmd_buffer{};
+	context_.device.CreateCommandBuffers(transfer_command_pool_, &transfer_cmd_buffer, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 	
 	auto commands = transfer_cmd_buffer.Record(mvk::CommandBufferUsage::OneTime);
 	
@@ -659,6 +757,8 @@ void PNTriangleApp::InitBuffers() noexcept
 
 	context_.device.DestroyCommandBuffers(transfer_command_pool_, &transfer_cmd_buffer);
 	context_.device.DestroyBuffer(transfer_buff.object, transfer_buff.allocation);
+
+	return true;
 }
 
 void PNTriangleApp::InitDescriptorSetLayouts() noexcept
@@ -786,10 +886,12 @@ inline void PNTriangleApp::RecordCommands(const mvk::CommandBuffer::Recording& c
 		layout,
 		descriptor);
 
+	commands.PushConstants(layout, VK_SHADER_STAGE_VERTEX_BIT, &dequantization_, sizeof(dequantization_));
+
 	commands.BindVertexBuffers(&vert_buffer_, 1);
 	commands.BindIndexBuffers(index_buffer_);
 
-	commands.SubmitDrawIndexed(indices_.size());
+	commands.SubmitDrawIndexed(index_count_);
 }
 
 void PNTriangleApp::InitUniforms() noexcept
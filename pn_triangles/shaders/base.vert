@@ -10,17 +10,49 @@ layout(binding = 0) uniform UniformBufferObject
 
 } ubo;
 
+// Whether in_normal is stored octahedral (PackedVertex) or as it is (Vertex)
+layout(constant_id = 0) const bool PACKED_NORMALS = true;
+
+// Positions in the vertex buffer are offset + scale * in_position, see VertexDequantization
+layout(push_constant) uniform Dequantization
+{
+    vec4 offset;
+    vec4 scale;
+
+} dequantization;
+
 layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_normal;
 
 layout(location = 0) out vec4 out_normal;
 layout(location = 1) out vec4 out_position;
 
+// Inverse of OctEncode in vertex.h
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+vec3 DecodePosition()
+{
+    return dequantization.offset.xyz + dequantization.scale.xyz * in_position;
+}
+
+vec3 DecodeNormal()
+{
+    return PACKED_NORMALS ? OctDecode(in_normal.xy) : in_normal;
+}
+
 
 void main()
 {
     
-     gl_Position  = ubo.proj * ubo.view * ubo.model * vec4(in_position, 1.0);
-     out_position = ubo.model * vec4(in_position, 1.0);
-     out_normal = normalize(ubo.model * vec4(in_normal, 0.0));
+     vec3 position = DecodePosition();
+
+     gl_Position  = ubo.proj * ubo.view * ubo.model * vec4(position, 1.0);
+     out_position = ubo.model * vec4(position, 1.0);
+     out_normal = normalize(ubo.model * vec4(DecodeNormal(), 0.0));
 }
\ No newline at end of file
@@ -1,13 +1,44 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// Whether in_normal is stored octahedral (PackedVertex) or as it is (Vertex)
+layout(constant_id = 0) const bool PACKED_NORMALS = true;
+
+// Positions in the vertex buffer are offset + scale * in_position, see VertexDequantization
+layout(push_constant) uniform Dequantization
+{
+    vec4 offset;
+    vec4 scale;
+
+} dequantization;
+
 layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_normal;
 
 layout(location = 0) out vec3 out_normal;
 
+// Inverse of OctEncode in vertex.h
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+vec3 DecodePosition()
+{
+    return dequantization.offset.xyz + dequantization.scale.xyz * in_position;
+}
+
+vec3 DecodeNormal()
+{
+    return PACKED_NORMALS ? OctDecode(in_normal.xy) : in_normal;
+}
+
 void main() 
 {
-    gl_Position = vec4(in_position.xyz, 1.0);
-    out_normal = in_normal;
+    // The patch is built in object space, so both are decoded before the tessellation stages
+    gl_Position = vec4(DecodePosition(), 1.0);
+    out_normal = DecodeNormal();
 }
\ No newline at end of file
@@ -1,12 +1,40 @@
 #ifndef VERTEX_H
 #define VERTEX_H
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
 #include <vulkan/vulkan.h>
 
+#include "vertex_layout.h"
+
+// 1 uploads PackedVertex, 0 uploads Vertex as it is. The shaders follow through the
+// PACKED_NORMALS specialization constant.
+#ifndef PN_PACKED_VERTICES
+    #define PN_PACKED_VERTICES 1
+#endif
+
+// Position transform of the vertex buffer, the vertex shaders compute
+// offset + scale * in_position. Pushed to the vertex stage before the draw.
+struct VertexDequantization
+{
+    glm::vec4 offset{ 0.f };
+    glm::vec4 scale{ 1.f };
+};
+
+// Bounds of the mesh positions, what PackedVertex positions are relative to
+struct VertexBounds
+{
+    glm::vec3 min{ 0.f };
+    glm::vec3 max{ 0.f };
+};
+
+// Full precision vertex the mesh is welded and optimized with
 struct Vertex
 {
     glm::vec3 pos;
@@ -22,41 +50,141 @@ struct Vertex
 
     static constexpr VkVertexInputBindingDescription GetBindingDescription() noexcept
     {
-        VkVertexInputBindingDescription description{};
-        description.binding = 0;
-        description.stride = sizeof(Vertex);
-        description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return makeBindingDescription<Vertex>();
+    }
+
+    static constexpr auto GetAtributeDescriptions() noexcept
+    {
+        return makeAttributeDescriptions(VERTEX_ATTRIBUTE(Vertex, pos), VERTEX_ATTRIBUTE(Vertex, normal));
+    };
 
-        return description;
+    static constexpr VertexDequantization Dequantization(const VertexBounds&) noexcept
+    {
+        return VertexDequantization{};
     }
 
-    static constexpr std::array<VkVertexInputAttributeDescription, 2> GetAtributeDescriptions() noexcept
+    static Vertex Pack(const Vertex& vertex, const VertexBounds&) noexcept
     {
-        std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions{};
+        return vertex;
+    }
+
+};
 
-        // describe inPosition
-        attribute_descriptions[0].binding = 0;
-        attribute_descriptions[0].location = 0;
-        attribute_descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attribute_descriptions[0].offset = offsetof(Vertex, pos);
+namespace vertex_detail
+{
+    inline uint16_t QuantizeUnorm16(float value) noexcept
+    {
+        return static_cast<uint16_t>(std::lround(std::clamp(value, 0.f, 1.f) * 65535.f));
+    }
 
-        attribute_descriptions[1].binding = 0;
-        attribute_descriptions[1].location = 1;
-        attribute_descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attribute_descriptions[1].offset = offsetof(Vertex, normal);
+    inline int16_t QuantizeSnorm16(float value) noexcept
+    {
+        return static_cast<int16_t>(std::lround(std::clamp(value, -1.f, 1.f) * 32767.f));
+    }
 
-        // describe inColor
-        //attribute_descriptions[2].binding = 0;
-        //attribute_descriptions[2].location = 2;
-        //attribute_descriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-        //attribute_descriptions[2].offset = offsetof(Vertex, color);
+    // Octahedral mapping (Cigolle et al. 2014): the unit sphere projected onto the octahedron
+    // |x| + |y| + |z| = 1, with the lower half folded over the diagonals of the upper one.
+    // Must match OctDecode in the vertex shaders.
+    inline glm::vec2 OctEncode(const glm::vec3& normal) noexcept
+    {
+        const float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if (0.f == l1)
+        {
+            return glm::vec2{ 0.f };
+        }
 
-        return attribute_descriptions;
+        glm::vec2 e{ normal.x / l1, normal.y / l1 };
+        if (normal.z < 0.f)
+        {
+            e = glm::vec2
+            {
+                (1.f - std::abs(e.y)) * (e.x >= 0.f ? 1.f : -1.f),
+                (1.f - std::abs(e.x)) * (e.y >= 0.f ? 1.f : -1.f)
+            };
+        }
+        return e;
+    }
+}
 
-    };
+// Vertex buffer layout at half the size of Vertex: positions as 16 bit fractions of the mesh
+// bounds and octahedral normals in two 16 bit components, 12 bytes
+struct PackedVertex
+{
+    // w is always 0, 3 component 16 bit formats are optional for vertex buffers
+    Unorm16x4 pos;
+    Snorm16x2 normal;
 
+    static constexpr VkVertexInputBindingDescription GetBindingDescription() noexcept
+    {
+        return makeBindingDescription<PackedVertex>();
+    }
+
+    static constexpr auto GetAtributeDescriptions() noexcept
+    {
+        return makeAttributeDescriptions(VERTEX_ATTRIBUTE(PackedVertex, pos), VERTEX_ATTRIBUTE(PackedVertex, normal));
+    }
+
+    static VertexDequantization Dequantization(const VertexBounds& bounds) noexcept
+    {
+        return VertexDequantization{ glm::vec4(bounds.min, 0.f), glm::vec4(bounds.max - bounds.min, 0.f) };
+    }
+
+    static PackedVertex Pack(const Vertex& vertex, const VertexBounds& bounds) noexcept
+    {
+        using namespace vertex_detail;
+
+        const glm::vec3 extent = bounds.max - bounds.min;
+        PackedVertex packed{};
+
+        for (int k = 0; k < 3; ++k)
+        {
+            // Flat axes keep 0, which the scale of 0 brings back to the bound
+            const float fraction = extent[k] > 0.f ? (vertex.pos[k] - bounds.min[k]) / extent[k] : 0.f;
+            packed.pos.value[k] = QuantizeUnorm16(fraction);
+        }
+
+        const glm::vec2 normal = OctEncode(vertex.normal);
+        packed.normal.value[0] = QuantizeSnorm16(normal.x);
+        packed.normal.value[1] = QuantizeSnorm16(normal.y);
+
+        return packed;
+    }
 };
 
+static_assert(sizeof(PackedVertex) == sizeof(Vertex) / 2, "PackedVertex is meant to halve the vertex buffer");
+
+#if PN_PACKED_VERTICES
+using GpuVertex = PackedVertex;
+#else
+using GpuVertex = Vertex;
+#endif
+
+inline VertexBounds BoundsOf(const std::vector<Vertex>& vertices) noexcept
+{
+    VertexBounds bounds{};
+    if (!vertices.empty())
+    {
+        bounds.min = bounds.max = vertices[0].pos;
+    }
+    for (const Vertex& vertex : vertices)
+    {
+        bounds.min = glm::min(bounds.min, vertex.pos);
+        bounds.max = glm::max(bounds.max, vertex.pos);
+    }
+    return bounds;
+}
+
+// Converts the vertices to the vertex buffer layout, relative to bounds
+inline void PackVertices(const std::vector<Vertex>& vertices, const VertexBounds& bounds,
+                         std::vector<GpuVertex>& packed) noexcept
+{
+    packed.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        packed[i] = GpuVertex::Pack(vertices[i], bounds);
+    }
+}
+
 
 
 namespace std
@@ -80,4 +208,4 @@ namespace std
 
 
 
-#endif
\ No newline at end of file
+#endif